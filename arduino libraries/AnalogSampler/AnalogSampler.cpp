@@ -0,0 +1,225 @@
+//--------------------------------------------------------------
+//-- AnalogSampler.cpp
+//-- Background sampling of analog inputs in the ADC interrupt
+//--------------------------------------------------------------
+#include "AnalogSampler.h"
+#include <util/atomic.h>
+
+#define ADC_MUX(channel)  (_BV(REFS0) | ((channel) & 0x07))   //-- AVcc reference, as analogRead()
+#define ADC_TRIGGER_T0A   (_BV(ADTS1) | _BV(ADTS0))
+
+struct AnalogSamplerSlot {
+  uint8_t channel;
+  AnalogSamplerCallback callback;
+  void *context;
+  volatile uint16_t value;
+};
+
+static AnalogSamplerSlot _slots[ANALOG_SAMPLER_CHANNELS];
+static volatile uint8_t _count;
+static volatile uint8_t _current;       //-- Slot being converted
+static volatile unsigned long _samples;
+static bool _running;
+
+//-- Block capture
+#define CAPTURE_IDLE      0
+#define CAPTURE_PENDING   1     //-- Starts after the background conversion in progress
+#define CAPTURE_SETTLING  2     //-- First conversion on the new channel, dropped
+#define CAPTURE_RUNNING   3
+#define CAPTURE_DRAINING  4     //-- Last free running conversion, dropped
+static volatile uint8_t _captureState;
+static uint8_t _captureChannel;
+static uint8_t *_captureBuffer;
+static uint8_t _captureCount;
+static uint8_t _captureIndex;
+
+static void startCapture()
+{
+  ADMUX = ADC_MUX(_captureChannel);
+  ADCSRB &= ~0x07;                                     //-- Free running
+  ADCSRA |= _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADSC);
+  _captureIndex = 0;
+  _captureState = CAPTURE_SETTLING;
+}
+
+//-- A conversion of the block: store it, and give the ADC back
+//-- to the background channels when the block is full
+static void captured(uint16_t value)
+{
+  switch (_captureState) {
+    case CAPTURE_SETTLING:
+      _captureState = CAPTURE_RUNNING;
+      break;
+    case CAPTURE_RUNNING:
+      _captureBuffer[_captureIndex++] = value >> 2;
+      if (_captureIndex < _captureCount) break;
+      if (_running) {
+        ADMUX = ADC_MUX(_slots[_current].channel);
+        ADCSRB = (ADCSRB & ~0x07) | ADC_TRIGGER_T0A;
+        TIFR0 = _BV(OCF0A);
+      } else {
+        ADCSRA &= ~_BV(ADATE);
+      }
+      _captureState = CAPTURE_DRAINING;
+      break;
+    default:
+      if (!_running) ADCSRA &= ~_BV(ADIE);
+      _captureState = CAPTURE_IDLE;
+      break;
+  }
+}
+
+ISR(ADC_vect)
+{
+  AnalogSampler::conversionDone();
+}
+
+//---------------------------------------------------------
+//-- A conversion has finished: store it, select the next
+//-- channel for the next trigger and re-arm the trigger
+//---------------------------------------------------------
+void AnalogSampler::conversionDone()
+{
+  uint16_t value = ADC;
+  uint8_t slot = _current;
+
+  if (_captureState >= CAPTURE_SETTLING) {
+    captured(value);
+    return;
+  }
+
+  //-- The multiplexer is switched before the callback so the
+  //-- next conversion always sees a settled input
+  _current = (slot + 1 < _count) ? slot + 1 : 0;
+  ADMUX = ADC_MUX(_slots[_current].channel);
+
+  //-- The trigger is the rising edge of OCF0A: clear it for the next one
+  TIFR0 = _BV(OCF0A);
+
+  _slots[slot].value = value;
+  _samples++;
+  if (_slots[slot].callback) _slots[slot].callback(_slots[slot].context, value);
+
+  if (_captureState == CAPTURE_PENDING) startCapture();
+}
+
+int8_t AnalogSampler::add(uint8_t pin, AnalogSamplerCallback callback, void *context)
+{
+  uint8_t channel = (pin >= A0) ? pin - A0 : pin;
+  int8_t slot = -1;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (_count < ANALOG_SAMPLER_CHANNELS) {
+      slot = _count;
+      _slots[slot].channel = channel;
+      _slots[slot].callback = callback;
+      _slots[slot].context = context;
+      _slots[slot].value = 0;
+      _count++;
+    }
+  }
+  return slot;
+}
+
+void AnalogSampler::begin()
+{
+  if (_running || _count == 0) return;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _current = 0;
+    _samples = 0;
+    ADMUX = ADC_MUX(_slots[0].channel);
+    OCR0A = 0x40;                                      //-- Away from ZowiButtons' compare B
+    ADCSRB = (ADCSRB & ~0x07) | ADC_TRIGGER_T0A;
+    ADCSRA |= _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADIF);
+    TIFR0 = _BV(OCF0A);
+    _running = true;
+  }
+}
+
+void AnalogSampler::end()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
+    _running = false;
+  }
+}
+
+uint16_t AnalogSampler::read(uint8_t slot)
+{
+  uint16_t value;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    value = _slots[slot].value;
+  }
+  return value;
+}
+
+unsigned long AnalogSampler::getSamples()
+{
+  unsigned long samples;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    samples = _samples;
+  }
+  return samples;
+}
+
+//---------------------------------------------------------
+//-- Stops the trigger, lets a background conversion in
+//-- progress finish (its sample is lost), converts the pin
+//-- and puts the sampler back on its channel
+//---------------------------------------------------------
+uint16_t AnalogSampler::analogRead(uint8_t pin)
+{
+  while (_captureState != CAPTURE_IDLE) {              //-- A block in progress: ~10 ms at most
+    delayMicroseconds(10);
+  }
+
+  if (!_running) return ::analogRead(pin);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ADCSRA &= ~(_BV(ADATE) | _BV(ADIE));
+  }
+  while (ADCSRA & _BV(ADSC)) {
+    delayMicroseconds(4);
+  }
+
+  uint16_t value = ::analogRead(pin);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ADMUX = ADC_MUX(_slots[_current].channel);
+    TIFR0 = _BV(OCF0A);
+    ADCSRA |= _BV(ADATE) | _BV(ADIE) | _BV(ADIF);
+  }
+  return value;
+}
+
+//---------------------------------------------------------
+//-- Starts a block capture: right away if the ADC is free,
+//-- otherwise as soon as the background conversion finishes
+//---------------------------------------------------------
+bool AnalogSampler::capture(uint8_t pin, uint8_t *buffer, uint8_t count)
+{
+  bool started = false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (_captureState == CAPTURE_IDLE && count > 0) {
+      _captureChannel = (pin >= A0) ? pin - A0 : pin;
+      _captureBuffer = buffer;
+      _captureCount = count;
+      if (_running) {
+        _captureState = CAPTURE_PENDING;
+      } else {
+        startCapture();
+      }
+      started = true;
+    }
+  }
+  return started;
+}
+
+bool AnalogSampler::captureDone()
+{
+  return _captureState == CAPTURE_IDLE;
+}
@@ -0,0 +1,60 @@
+//--------------------------------------------------------------
+//-- AnalogSampler.h
+//-- Background sampling of analog inputs in the ADC interrupt
+//--------------------------------------------------------------
+//-- The ADC is auto-triggered by timer 0 compare A, once per
+//-- millis() tick (~1 kHz), and the registered channels are
+//-- converted in turn: each one is sampled at 1 kHz / channels.
+//-- Every result is kept for read() and handed to the channel's
+//-- callback from the interrupt.
+//--
+//-- While the sampler runs, code that needs a one-off conversion
+//-- must use AnalogSampler::analogRead() instead of analogRead():
+//-- it pauses the background conversions so that both do not
+//-- fight over the ADC multiplexer.
+//--
+//-- capture() borrows the ADC for a block of samples of one pin
+//-- at the full free running rate (~9.6 kHz, prescaler 128):
+//-- the background channels miss their samples for that long
+//-- and carry on afterwards.
+//--------------------------------------------------------------
+#ifndef AnalogSampler_h
+#define AnalogSampler_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define ANALOG_SAMPLER_CHANNELS  4
+#define ANALOG_CAPTURE_RATE      9615    //-- Hz, free running conversions
+
+//-- Called from the ADC interrupt with every new sample
+typedef void (*AnalogSamplerCallback)(void *context, uint16_t value);
+
+class AnalogSampler
+{
+  public:
+    //-- Registers an analog pin (A0..A7); returns its slot or -1
+    //-- if the table is full. Safe to call while running
+    static int8_t add(uint8_t pin, AnalogSamplerCallback callback=0, void *context=0);
+    static void begin();                        //-- Starts sampling (does nothing if running)
+    static void end();
+
+    static uint16_t read(uint8_t slot);         //-- Latest sample of a slot
+    static unsigned long getSamples();          //-- Conversions done since begin()
+
+    //-- One-off conversion of any pin that does not disturb the
+    //-- background sampling (a plain analogRead() if not running)
+    static uint16_t analogRead(uint8_t pin);
+
+    //-- Block of count samples (8 bits) of a pin, filled in the
+    //-- interrupt. false if a block is already being captured
+    static bool capture(uint8_t pin, uint8_t *buffer, uint8_t count);
+    static bool captureDone();
+
+    static void conversionDone();               //-- Called from ADC_vect
+};
+
+#endif //AnalogSampler_h
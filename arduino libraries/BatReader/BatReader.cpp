@@ -7,6 +7,8 @@
 ******************************************************************************/
 
 #include "BatReader.h"
+#include <AnalogSampler.h>
+#include <util/atomic.h>
 
 #if defined(ARDUINO) && ARDUINO >= 100
   #include "Arduino.h"
@@ -14,18 +16,116 @@
   #include "WProgram.h"
 #endif
 
+// ADC steps to mV: BAT_MV_REF / 1024 = 625 / 128
+#define BAT_STEP_MV(value)	(((uint32_t)(value) * 625) >> 7)
+
 BatReader::BatReader() {
+	_filtered = 0;
+	_voltage = 0;
+	_sag = 0;
+	_lowMv = BAT_PERCENT_MV(BAT_LOW_PERCENT);
+	_criticalMv = BAT_PERCENT_MV(BAT_CRITICAL_PERCENT);
+	_level = BAT_OK;
+	_changed = false;
+}
+
+void BatReader::init(void) {
+	// The first read of the battery is often wrong: discard it
+	AnalogSampler::analogRead(BAT_PIN);
+	uint16_t voltage = BAT_STEP_MV(AnalogSampler::analogRead(BAT_PIN)) + _sag;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_filtered = (uint32_t)voltage << 8;
+		_voltage = voltage;
+		_level = levelOf(voltage);
+		_changed = false;
+	}
+
+	AnalogSampler::add(BAT_PIN, sampled, this);
+	AnalogSampler::begin();
+}
+
+void BatReader::setThresholds(uint8_t low, uint8_t critical) {
+	uint16_t lowMv = BAT_PERCENT_MV(low);
+	uint16_t criticalMv = BAT_PERCENT_MV(critical);
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_lowMv = lowMv;
+		_criticalMv = criticalMv;
+		updateLevel();
+	}
+}
+
+void BatReader::setLoad(uint8_t servos) {
+	uint16_t sag = servos * BAT_SAG_MV;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		_sag = sag;
+	}
+}
+
+void BatReader::sampled(void *reader, uint16_t value) {
+	((BatReader *)reader)->sample(value);
+}
+
+void BatReader::sample(uint16_t value) {
+	uint32_t input = (BAT_STEP_MV(value) + _sag) << 8;
+
+	if (input > _filtered) _filtered += (input - _filtered) >> BAT_FILTER_SHIFT;
+	else _filtered -= (_filtered - input) >> BAT_FILTER_SHIFT;
+	_voltage = _filtered >> 8;
+	updateLevel();
+}
+
+void BatReader::updateLevel(void) {
+	// Worse at once, better only BAT_HYSTERESIS_MV above the threshold
+	uint8_t worse = levelOf(_voltage);
+	uint8_t better = levelOf((_voltage > BAT_HYSTERESIS_MV) ? _voltage - BAT_HYSTERESIS_MV : 0);
+	if (worse > _level || better < _level) {
+		_level = (worse > _level) ? worse : better;
+		_changed = true;
+	}
+}
+
+uint8_t BatReader::levelOf(uint16_t voltage) {
+	if (voltage < _criticalMv) return BAT_CRITICAL;
+	if (voltage < _lowMv) return BAT_LOW;
+	return BAT_OK;
+}
+
+uint16_t BatReader::getVoltage(void) {
+	uint16_t voltage;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		voltage = _voltage;
+	}
+	return voltage;
+}
+
+uint16_t BatReader::getPercent(void) {
+	uint16_t voltage = getVoltage();
+	if (voltage <= BAT_MV_MIN) return 0;
+	if (voltage >= BAT_MV_MAX) return 10000;
+	return (uint32_t)(voltage - BAT_MV_MIN) * 10000 / (BAT_MV_MAX - BAT_MV_MIN);
+}
+
+uint8_t BatReader::getLevel(void) {
+	return _level;
+}
+
+bool BatReader::levelChanged(uint8_t &level) {
+	bool changed;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		changed = _changed;
+		level = _level;
+		_changed = false;
+	}
+	return changed;
 }
 
 double BatReader::readBatVoltage(void) {
-	double readed = (double)(analogRead(BAT_PIN)*ANA_REF)/1024;
-	if(readed > BAT_MAX) return BAT_MAX;
-	else return readed;
+	uint16_t voltage = getVoltage();
+	if(voltage > BAT_MV_MAX) return BAT_MAX;
+	else return voltage / 1000.0;
 }
 
 double BatReader::readBatPercent(void) {
-	double value = (SLOPE*readBatVoltage()) - OFFSET;
-	if(value < 0) return 0;
-	else return value;
+	return getPercent() / 100.0;
 }
-
@@ -4,6 +4,18 @@
 * @version 20150824
 * @author Raul de Pablos Martin
 *
+* The battery input is sampled in the background (AnalogSampler) and
+* filtered in the ADC interrupt: an exponential average in millivolts,
+* 1/256 of the difference per sample (about a second with the wheel
+* encoders sharing the ADC). The sag of the servos is added back to
+* every sample while they run (setLoad), so the level does not drop
+* each time Zowi moves. The readings are the cached average: no ADC
+* conversion, no waiting.
+*
+* The level (OK, LOW, CRITICAL) changes as soon as the voltage falls
+* below a threshold, and goes back only when it is BAT_HYSTERESIS_MV
+* above it. Each crossing is kept until read by levelChanged(); the
+* level found by init() is not a crossing (ask getLevel()).
 ******************************************************************************/
 #ifndef __BATREADER_H__
 #define __BATREADER_H__
@@ -25,12 +37,24 @@
 #define SLOPE	100/(BAT_MAX - BAT_MIN)
 #define OFFSET	(100*BAT_MIN)/(BAT_MAX - BAT_MIN)
 
+#define BAT_MV_MAX            4200
+#define BAT_MV_MIN            3250
+#define BAT_MV_REF            5000
+#define BAT_FILTER_SHIFT      8       // 1/256 of the difference per sample
+#define BAT_SAG_MV            60      // Drop per running servo (estimated)
+#define BAT_LOW_PERCENT       45
+#define BAT_CRITICAL_PERCENT  15
+#define BAT_HYSTERESIS_MV     50
+
+#define BAT_PERCENT_MV(p)     (BAT_MV_MIN + (long)(BAT_MV_MAX - BAT_MV_MIN) * (p) / 100)
+
 class BatReader
 {
 public:
 	////////////////////////////
 	// Enumerations           //
 	////////////////////////////
+	enum { BAT_OK, BAT_LOW, BAT_CRITICAL };
 
 	////////////////////////////
 	// Variables              //
@@ -42,13 +66,35 @@ public:
 	// BatReader -- BatReader class constructor
 	BatReader();
 
-	// readBatPercent
+	// init -- Seeds the average and starts the background sampling
+	void init(void);
+
+	// setThresholds -- Levels LOW and CRITICAL start below these (%)
+	void setThresholds(uint8_t low, uint8_t critical);
+
+	// setLoad -- Number of servos running (sag compensation)
+	void setLoad(uint8_t servos);
+
+	// getVoltage -- Filtered voltage, mV
+	uint16_t getVoltage(void);
+
+	// getPercent -- Filtered level, 1/100 % (0..10000)
+	uint16_t getPercent(void);
+
+	// getLevel -- BAT_OK, BAT_LOW or BAT_CRITICAL
+	uint8_t getLevel(void);
+
+	// levelChanged -- true once after every level change
+	bool levelChanged(uint8_t &level);
+
+	// readBatVoltage -- Filtered voltage, V
 	double readBatVoltage(void);
 	
-	// readBatPercent
+	// readBatPercent -- Filtered level, %
 	double readBatPercent(void);
 	
-	
+	// sample -- Called with every new sample (interrupt)
+	void sample(uint16_t value);
 
 private:	
 	////////////////////////////
@@ -59,12 +105,20 @@ private:
 	////////////////////////////
 	// Variables              //
 	////////////////////////////
-	
+	uint32_t _filtered;          // mV, 8 fraction bits
+	volatile uint16_t _voltage;  // mV
+	uint16_t _sag;
+	uint16_t _lowMv;
+	uint16_t _criticalMv;
+	volatile uint8_t _level;
+	volatile bool _changed;
 	
 	////////////////////////////
 	// Functions              //
 	////////////////////////////
-	
+	uint8_t levelOf(uint16_t voltage);
+	void updateLevel(void);
+	static void sampled(void *reader, uint16_t value);
 	
 };
 
@@ -0,0 +1,131 @@
+//--------------------------------------------------------------
+//-- ClapDetector.cpp
+//-- Streaming sound level and clap patterns from the noise sensor
+//--------------------------------------------------------------
+#include "ClapDetector.h"
+#include <AnalogSampler.h>
+#include <util/atomic.h>
+
+void ClapDetector::init(uint8_t pin)
+{
+  uint16_t value = AnalogSampler::analogRead(pin);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _average = value << 4;
+    _envelope = 0;
+    _floor = 0;
+    _armed = true;
+    _lastClap = 0;
+    _claps = 0;
+    _head = 0;
+    _tail = 0;
+    _dropped = 0;
+  }
+
+  AnalogSampler::add(pin, sampled, this);
+  AnalogSampler::begin();
+}
+
+void ClapDetector::sampled(void *detector, uint16_t value)
+{
+  ((ClapDetector *)detector)->sample(value);
+}
+
+void ClapDetector::sample(uint16_t value)
+{
+  uint16_t input = value << 4;
+
+  //-- Level around the slow average
+  _average += ((int16_t)(input - _average)) >> CLAP_AVERAGE_SHIFT;
+  uint16_t level = (input > _average) ? input - _average : _average - input;
+
+  //-- Envelope: half way up at once, slowly down
+  if (level > _envelope) _envelope += (level - _envelope + 1) >> 1;
+  else _envelope -= (_envelope - level) >> CLAP_DECAY_SHIFT;
+
+  //-- Noise floor
+  if (_envelope > _floor) _floor += (_envelope - _floor) >> CLAP_FLOOR_SHIFT;
+  else _floor -= (_floor - _envelope) >> 4;
+
+  unsigned long now = millis();
+  uint16_t threshold = CLAP_RATIO * _floor + (CLAP_MARGIN << 4);
+
+  if (_envelope > threshold) {
+    if (_armed && now - _lastClap >= CLAP_REFRACTORY_MS) {
+      if (_claps == 0) _firstClap = now;
+      if (_claps < 255) _claps++;
+      _lastClap = now;
+    }
+    _armed = false;
+  } else {
+    _armed = true;
+  }
+
+  //-- A pattern ends when no clap follows in time
+  if (_claps && now - _lastClap > CLAP_PATTERN_MS) {
+    push();
+    _claps = 0;
+  }
+}
+
+void ClapDetector::push()
+{
+  if ((uint8_t)(_head - _tail) >= CLAP_QUEUE_SIZE) {
+    if (_dropped < 255) _dropped++;
+    return;
+  }
+  ClapEvent &e = _queue[_head & (CLAP_QUEUE_SIZE - 1)];
+  e.time = _firstClap;
+  e.duration = _lastClap - _firstClap;
+  e.claps = _claps;
+  _head++;
+}
+
+bool ClapDetector::available()
+{
+  return _head != _tail;
+}
+
+bool ClapDetector::read(ClapEvent &event)
+{
+  bool found = false;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (_head != _tail) {
+      event = _queue[_tail & (CLAP_QUEUE_SIZE - 1)];
+      _tail++;
+      found = true;
+    }
+  }
+  return found;
+}
+
+void ClapDetector::flush()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _tail = _head;
+    _claps = 0;
+  }
+}
+
+uint16_t ClapDetector::getEnvelope()
+{
+  uint16_t envelope;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    envelope = _envelope;
+  }
+  return envelope >> 4;
+}
+
+uint16_t ClapDetector::getFloor()
+{
+  uint16_t floor;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    floor = _floor;
+  }
+  return floor >> 4;
+}
+
+uint8_t ClapDetector::getDropped()
+{
+  return _dropped;
+}
@@ -0,0 +1,79 @@
+//--------------------------------------------------------------
+//-- ClapDetector.h
+//-- Streaming sound level and clap patterns from the noise sensor
+//--------------------------------------------------------------
+//-- The sensor is sampled in the ADC interrupt (AnalogSampler,
+//-- 250 Hz with the wheel encoders and the battery) and every
+//-- sample goes through, all in integer math (levels are 1/16
+//-- ADC step):
+//--     level     |sample - slow average|
+//--     envelope  fast attack, slow decay of the level
+//--     floor     the envelope when nothing happens: follows it
+//--               down quickly and up very slowly
+//-- An onset (a clap) is an envelope above CLAP_RATIO times the
+//-- floor plus CLAP_MARGIN. The next one needs the envelope to
+//-- fall back below that and CLAP_REFRACTORY_MS to pass, so the
+//-- ringing of one clap is not counted twice.
+//--
+//-- Claps closer than CLAP_PATTERN_MS make a pattern, queued as
+//-- one event (time of the first clap, number of claps) when no
+//-- clap follows.
+//--------------------------------------------------------------
+#ifndef ClapDetector_h
+#define ClapDetector_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define CLAP_AVERAGE_SHIFT   8       //-- Slow average: 1/256 of the difference per sample
+#define CLAP_DECAY_SHIFT     5       //-- Envelope decay: 1/32 per sample
+#define CLAP_FLOOR_SHIFT     9       //-- Floor rise: 1/512 per sample
+#define CLAP_RATIO           3
+#define CLAP_MARGIN          40      //-- ADC steps
+#define CLAP_REFRACTORY_MS   100
+#define CLAP_PATTERN_MS      600     //-- Longest gap between the claps of a pattern
+#define CLAP_QUEUE_SIZE      4       //-- Must be a power of 2
+
+struct ClapEvent {
+  unsigned long time;     //-- millis() of the first clap
+  unsigned int duration;  //-- ms from the first to the last clap
+  uint8_t claps;
+};
+
+class ClapDetector
+{
+  public:
+    void init(uint8_t pin);
+
+    bool available();
+    bool read(ClapEvent &event);     //-- Pops the oldest pattern
+    void flush();                    //-- Drops the queue and any pattern in progress
+
+    uint16_t getEnvelope();          //-- ADC steps
+    uint16_t getFloor();
+    uint8_t getDropped();
+
+    void sample(uint16_t value);     //-- Called with every new sample (interrupt)
+
+  private:
+    uint16_t _average;               //-- 1/16 ADC step
+    uint16_t _envelope;
+    uint16_t _floor;
+    bool _armed;
+    unsigned long _lastClap;
+    unsigned long _firstClap;
+    uint8_t _claps;                  //-- Claps in the pattern in progress
+
+    ClapEvent _queue[CLAP_QUEUE_SIZE];
+    volatile uint8_t _head;
+    volatile uint8_t _tail;
+    uint8_t _dropped;
+
+    void push();
+    static void sampled(void *detector, uint16_t value);
+};
+
+#endif //ClapDetector_h
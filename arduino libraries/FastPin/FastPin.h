@@ -0,0 +1,97 @@
+//--------------------------------------------------------------
+//-- FastPin.h
+//-- Pins resolved at compile time: port, bit and ADC channel
+//--------------------------------------------------------------
+//-- FastPin<13> is a type: its port, mask and ADC channel are
+//-- constants, so FastPin<13>::high() compiles to a single sbi
+//-- (ports B, C and D are in the I/O space) instead of the table
+//-- lookups of digitalWrite(). The drivers take their pins as
+//-- template arguments (LedMatrixT, IRT, UST).
+//--
+//-- RuntimePin has the same interface for a pin only known at
+//-- run time: port and mask are looked up once, when it is
+//-- created, and every access is a load/store through a pointer.
+//-- The classes with runtime pins (LedMatrix, IR, US) use it.
+//--
+//-- ATmega328P (Uno, Nano, Zowi) layout: D0..D7 = PD0..7,
+//-- D8..D13 = PB0..5, A0..A5 (D14..D19) = PC0..5. A6 and A7
+//-- are analog only.
+//--
+//-- Unlike digitalWrite(), nothing turns off a PWM output on
+//-- the pin. Writes do not disable interrupts: sbi/cbi are
+//-- atomic, but with a runtime pin (read-modify-write) an
+//-- interrupt that writes the same port in between would be
+//-- undone. A runtime pin without a port (A6, A7) does nothing.
+//--------------------------------------------------------------
+#ifndef FastPin_h
+#define FastPin_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+template<uint8_t PIN>
+struct FastPin
+{
+  enum {
+    number  = PIN,
+    bit     = (PIN < 8) ? PIN : ((PIN < 14) ? PIN - 8 : PIN - 14),
+    mask    = 1 << bit,
+    channel = (PIN >= 14) ? PIN - 14 : -1      //-- ADC channel, -1 if none
+  };
+
+  static volatile uint8_t &port() { static_assert(PIN < 20, "A6 and A7 are analog only"); return (PIN < 8) ? PORTD : ((PIN < 14) ? PORTB : PORTC); }
+  static volatile uint8_t &ddr()  { static_assert(PIN < 20, "A6 and A7 are analog only"); return (PIN < 8) ? DDRD : ((PIN < 14) ? DDRB : DDRC); }
+  static volatile uint8_t &in()   { static_assert(PIN < 20, "A6 and A7 are analog only"); return (PIN < 8) ? PIND : ((PIN < 14) ? PINB : PINC); }
+
+  static void output()       { ddr() |= mask; }
+  static void input()        { ddr() &= ~mask; port() &= ~mask; }
+  static void inputPullup()  { ddr() &= ~mask; port() |= mask; }
+
+  static void high()         { port() |= mask; }
+  static void low()          { port() &= ~mask; }
+  static void write(bool v)  { if (v) high(); else low(); }
+  static bool read()         { return (in() & mask) != 0; }
+};
+
+class RuntimePin
+{
+  public:
+    RuntimePin(uint8_t pin=0)
+    {
+      uint8_t p = digitalPinToPort(pin);
+      number = pin;
+      if (p == NOT_A_PORT) {
+        mask = 0;
+        _port = _ddr = _in = nowhere();
+        return;
+      }
+      mask = digitalPinToBitMask(pin);
+      _port = portOutputRegister(p);
+      _ddr = portModeRegister(p);
+      _in = portInputRegister(p);
+    }
+
+    void output()       { *_ddr |= mask; }
+    void input()        { *_ddr &= ~mask; *_port &= ~mask; }
+    void inputPullup()  { *_ddr &= ~mask; *_port |= mask; }
+
+    void high()         { *_port |= mask; }
+    void low()          { *_port &= ~mask; }
+    void write(bool v)  { if (v) high(); else low(); }
+    bool read()         { return (*_in & mask) != 0; }
+
+    uint8_t number;
+    uint8_t mask;
+
+  private:
+    volatile uint8_t *_port;
+    volatile uint8_t *_ddr;
+    volatile uint8_t *_in;
+
+    static volatile uint8_t *nowhere() { static volatile uint8_t none; return &none; }
+};
+
+#endif //FastPin_h
@@ -0,0 +1,85 @@
+//--------------------------------------------------------------
+//-- FixedPoint.cpp
+//-- Integer math shared by the Zowi libraries
+//--------------------------------------------------------------
+#include "FixedPoint.h"
+#include <avr/pgmspace.h>
+
+//-- First quarter of a sine wave, 64 steps, Q15
+static const int16_t quarterSine[65] PROGMEM = {
+      0,   804,  1608,  2411,  3212,  4011,  4808,  5602,  6393,
+   7180,  7962,  8740,  9512, 10279, 11039, 11793, 12540, 13279,
+  14010, 14733, 15447, 16151, 16846, 17531, 18205, 18868, 19520,
+  20160, 20788, 21403, 22006, 22595, 23170, 23732, 24279, 24812,
+  25330, 25833, 26320, 26791, 27246, 27684, 28106, 28511, 28899,
+  29269, 29622, 29957, 30274, 30572, 30853, 31114, 31357, 31581,
+  31786, 31972, 32138, 32286, 32413, 32522, 32610, 32679, 32729,
+  32758, 32767
+};
+
+int16_t fix_sin(uint16_t angle)
+{
+  //-- Fold into the first quarter: 0..16384
+  uint16_t x = angle & 0x7FFF;
+  if (x > 0x4000) x = 0x8000 - x;
+
+  uint8_t step = x >> 8;
+  uint8_t fraction = x & 0xFF;
+  int16_t value = pgm_read_word(&quarterSine[step]);
+  if (fraction) {
+    int16_t next = pgm_read_word(&quarterSine[step + 1]);
+    value += ((uint16_t)(next - value) * fraction + 128) >> 8;
+  }
+  return (angle & 0x8000) ? -value : value;
+}
+
+//---------------------------------------------------------
+//-- x = d 2^(16-shift) with d in [0.5, 1). 1/d = 1 + r/65536
+//-- from a linear first guess (4 bits) and two Newton steps,
+//-- r' = r + r (1 - d r), each one 16x16 bit multiplies
+//---------------------------------------------------------
+uint32_t fix_recip(uint16_t x)
+{
+  if (x == 0) return 0xFFFFFFFF;
+
+  uint8_t shift = 0;
+  uint16_t n = x;
+  while (!(n & 0x8000)) {
+    n <<= 1;
+    shift++;
+  }
+  if (n == 0x8000) return 1UL << (shift + 9);     //-- A power of 2: exact
+
+  //-- 1/d ~ 48/17 - 32/17 d, never below 1
+  long guess = 119504L - n - (((uint32_t)n * 57826U) >> 16);
+  uint16_t r = (guess > 0) ? guess : 0;
+
+  for (uint8_t i = 0; i < 2; i++) {
+    uint32_t dr = n + (((uint32_t)n * r) >> 16);      //-- d r in Q16, about 65536
+    int16_t e = 65536L - (long)dr;
+    long next = (long)r + e + (((int32_t)e * r) >> 16);
+    r = (next < 0) ? 0 : ((next > 0xFFFF) ? 0xFFFF : next);
+  }
+
+  uint32_t inverse = 0x10000UL + r;                 //-- 1/d in Q16
+  if (shift >= 8) return inverse << (shift - 8);
+  return (inverse + (1U << (7 - shift))) >> (8 - shift);
+}
+
+uint32_t fix_div(uint32_t num, uint32_t den, uint8_t frac)
+{
+  uint32_t quotient = num / den;
+  uint32_t remainder = num % den;
+
+  //-- One bit of the quotient per fraction bit
+  while (frac--) {
+    quotient <<= 1;
+    remainder <<= 1;
+    if (remainder >= den) {
+      remainder -= den;
+      quotient |= 1;
+    }
+  }
+  if (remainder >= den - remainder) quotient++;
+  return quotient;
+}
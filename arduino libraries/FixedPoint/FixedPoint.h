@@ -0,0 +1,73 @@
+//--------------------------------------------------------------
+//-- FixedPoint.h
+//-- Integer math shared by the Zowi libraries
+//--------------------------------------------------------------
+//-- On the ATmega every float operation is a library call of
+//-- hundreds of cycles, and the first one used pulls ~1 KB of
+//-- float code into the flash. The libraries work in fixed
+//-- point instead; these are the pieces they share.
+//--
+//-- A Qn value is an integer with n fraction bits: 1.0 is 1 << n.
+//-- Angles are binary angles, 65536 per turn, so they wrap by
+//-- themselves. FIX() converts a constant at compile time, it
+//-- must not be used on variables (that would be float math).
+//--------------------------------------------------------------
+#ifndef FixedPoint_h
+#define FixedPoint_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+//-- Constant x in Qfrac, rounded to nearest
+#define FIX(x, frac)        ((long)((x) * (1L << (frac)) + ((x) < 0 ? -0.5 : 0.5)))
+
+//-- Degrees and radians (constants) to binary angles
+#define FIX_ANGLE_DEG(d)    ((uint16_t)FIX((d) / 360.0, 16))
+#define FIX_ANGLE_RAD(r)    ((uint16_t)FIX((r) / (2 * M_PI), 16))
+
+#define FIX_Q15_MAX         32767
+
+//-- Sine and cosine of a binary angle, Q15 (-32767..32767).
+//-- Quarter wave table in flash with linear interpolation:
+//-- within 3 LSB of the true value
+int16_t fix_sin(uint16_t angle);
+inline int16_t fix_cos(uint16_t angle) { return fix_sin(angle + 16384); }
+
+//-- Saturation to a symmetric Q15 range, so that the result
+//-- can always be negated
+inline int16_t fix_sat16(long value)
+{
+  if (value > FIX_Q15_MAX) return FIX_Q15_MAX;
+  if (value < -FIX_Q15_MAX) return -FIX_Q15_MAX;
+  return value;
+}
+
+inline int16_t fix_add16(int16_t a, int16_t b) { return fix_sat16((long)a + b); }
+inline int16_t fix_sub16(int16_t a, int16_t b) { return fix_sat16((long)a - b); }
+
+inline uint8_t fix_satu8(int value)
+{
+  return (value < 0) ? 0 : ((value > 255) ? 255 : value);
+}
+
+//-- a * b of two Qfrac values, rounded, in Qfrac
+inline long fix_mul16(int16_t a, int16_t b, uint8_t frac)
+{
+  return ((long)a * b + (1L << (frac - 1))) >> frac;
+}
+
+//-- 2^24 / x for x >= 1, within 1 part in 2^15 (then rounded to
+//-- an integer; 0 gives 0xFFFFFFFF). Newton-Raphson
+//-- on 16 bit multiplies: several times faster than a 32 bit
+//-- division on the ATmega, for the divisions in the interrupts
+uint32_t fix_recip(uint16_t x);
+
+//-- (num << frac) / den rounded, without overflowing on the way
+//-- (den < 2^31, the result must fit in 32 bits). For the setup
+//-- of constants from run-time parameters
+uint32_t fix_div(uint32_t num, uint32_t den, uint8_t frac);
+
+#endif //FixedPoint_h
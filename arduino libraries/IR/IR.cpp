@@ -10,11 +10,5 @@ IR::IR(int pinTrigger) {
 
 void IR::init(int pinTrigger)
 {
-  _pinTrigger = pinTrigger;
-  pinMode( _pinTrigger , INPUT);
-}
-
-uint8_t IR::read(){
-  return digitalRead(_pinTrigger);
-
+  IRT<RuntimePin>::init(RuntimePin(pinTrigger));
 }
@@ -1,17 +1,29 @@
 #ifndef IR_h
 #define IR_h
 #include "Arduino.h"
+#include <FastPin.h>
 
-class IR
+//-- IR sensor on a pin type (FastPin<n> or RuntimePin)
+template<class Pin>
+class IRT
+{
+public:
+	IRT() {}
+	IRT(Pin pin) { init(pin); }
+	void init(Pin pin=Pin()) { _pin = pin; _pin.input(); }
+	uint8_t read() { return _pin.read(); }
+
+private:
+	Pin _pin;
+
+};
+
+class IR : public IRT<RuntimePin>
 {
 public:
 	IR();
 	void init(int pinTrigger);
 	IR(int pinTrigger);
-	uint8_t read();
-
-private:
-	int _pinTrigger;
 
 };
 
@@ -5,6 +5,9 @@
 * @author Raul de Pablos Martin
 *		  José Alberca Pita-Romero (Mouth's definitions)
 *
+* LedMatrixT takes its three pins as types (see FastPin.h): with
+* FastPin<n> every bit shifted into the 74HC595 is a couple of sbi/cbi.
+* LedMatrix is the same driver on pins given at run time.
 ******************************************************************************/
 #ifndef __LEDMATRIX_H__
 #define __LEDMATRIX_H__
@@ -16,6 +19,8 @@
   #include "pins_arduino.h"
 #endif
 
+#include <FastPin.h>
+
 ////////////////////////////
 // Definitions            //
 ////////////////////////////
@@ -23,11 +28,12 @@
 #define COLUMNS 6
 #define MATRIX_LENGTH ROWS*COLUMNS
 
+#define LED_BIT(row, column) (1L << (MATRIX_LENGTH - (row-1)*COLUMNS - (column)))
 
 
 
-
-class LedMatrix
+template<class SerPin, class ClkPin, class RckPin>
+class LedMatrixT
 {
 public:
 	////////////////////////////
@@ -41,29 +47,81 @@ public:
 	////////////////////////////
 	// Functions              //
 	////////////////////////////
-	// LedMatrix -- LedMatrix class constructor
-	LedMatrix(char ser_pin=11, char clk_pin=13, char rck_pin=12);
+	// LedMatrixT -- LedMatrixT class constructor
+	LedMatrixT(SerPin ser_pin=SerPin(), ClkPin clk_pin=ClkPin(), RckPin rck_pin=RckPin())
+		: SER(ser_pin), CLK(clk_pin), RCK(rck_pin) {
+		memory = 0x00000000;
+		mask = 0x3FFFFFFF;
+		SER.output();
+		CLK.output();
+		RCK.output();
+		SER.low();
+		CLK.low();
+		RCK.low();
+		sendMemory();
+	}
 		
 	// writeFull
-	void writeFull(unsigned long value);
+	void writeFull(unsigned long value) {
+		memory = value;
+		sendMemory();
+	}
 	
 	// readFull
-	unsigned long readFull(void);
+	unsigned long readFull(void) {
+		return memory;
+	}
 	
 	// setLed
-	void setLed(char row, char column);
+	void setLed(char row, char column) {
+		if(row >= 1 && row <= ROWS && column >= 1 && column <= COLUMNS) {
+			memory |= LED_BIT(row, column);
+			sendMemory();
+		}
+	}
 	
 	// unsetLed
-	void unsetLed(char row, char column);
+	void unsetLed(char row, char column) {
+		if(row >= 1 && row <= ROWS && column >= 1 && column <= COLUMNS) {
+			memory &= ~LED_BIT(row, column);
+			sendMemory();
+		}
+	}
 	
 	// readLed
-	bool readLed(char row, char column);
+	bool readLed(char row, char column) {
+		if(row >= 1 && row <= ROWS && column >= 1 && column <= COLUMNS)
+			return (memory & LED_BIT(row, column)) != 0;
+		return false;
+	}
 	
 	// clearMatrix
-	void clearMatrix(void);
+	void clearMatrix(void) {
+		memory = 0x00000000;
+		sendMemory();
+	}
 	
 	// setEntireMatrix
-	void setEntireMatrix(void);
+	void setEntireMatrix(void) {
+		memory = 0x3FFFFFFF;
+		sendMemory();
+	}
+
+	// setDuty -- Share of the lit LEDs really on (percent): an
+	// ordered 2x2 pattern, so the average current scales with it
+	void setDuty(uint8_t percent) {
+		// Order in which the LEDs of each 2x2 block go off
+		static const uint8_t order[2][2] = {{0, 2}, {3, 1}};
+
+		mask = 0;
+		for(char row = 1; row <= ROWS; row++) {
+			for(char column = 1; column <= COLUMNS; column++) {
+				if(order[row & 1][column & 1] * 25 < percent)
+					mask |= LED_BIT(row, column);
+			}
+		}
+		sendMemory();
+	}
 
 
 
@@ -77,17 +135,48 @@ private:
 	// Variables              //
 	////////////////////////////
     unsigned long memory;
-    char SER;
-    char CLK;
-    char RCK;
+    unsigned long mask;
+    SerPin SER;
+    ClkPin CLK;
+    RckPin RCK;
 	
 	
 	////////////////////////////
 	// Functions              //
 	////////////////////////////
-	void sendMemory(void);
+	void sendMemory(void) {
+		unsigned long shown = memory & mask;
+		
+		for(uint8_t i = 0; i < MATRIX_LENGTH; i++) {
+			SER.write(1L & (shown >> i));	
+			// ## adjust this delay to match with 74HC595 timing
+			asm volatile ("nop");
+			asm volatile ("nop");
+			asm volatile ("nop");
+			CLK.high();
+			// ## adjust this delay to match with 74HC595 timing
+			asm volatile ("nop");
+			asm volatile ("nop");
+			asm volatile ("nop");
+			CLK.low();	
+		}
+		
+		RCK.high();
+		// ## adjust this delay to match with 74HC595 timing
+		asm volatile ("nop");
+		asm volatile ("nop");
+		asm volatile ("nop");
+		RCK.low();	
+	}
 	
 	
 };
 
+class LedMatrix : public LedMatrixT<RuntimePin, RuntimePin, RuntimePin>
+{
+public:
+	// LedMatrix -- LedMatrix class constructor
+	LedMatrix(char ser_pin=11, char clk_pin=13, char rck_pin=12);
+};
+
 #endif // LEDMATRIX_H //
@@ -0,0 +1,113 @@
+//--------------------------------------------------------------
+//-- LineFollower.cpp
+//-- PD line following on two digital IR sensors
+//--------------------------------------------------------------
+#include "LineFollower.h"
+
+void LineFollower::init(uint8_t leftPin, uint8_t rightPin)
+{
+  pinMode(leftPin, INPUT);
+  pinMode(rightPin, INPUT);
+
+  _leftPort = portInputRegister(digitalPinToPort(leftPin));
+  _rightPort = portInputRegister(digitalPinToPort(rightPin));
+  _leftMask = digitalPinToBitMask(leftPin);
+  _rightMask = digitalPinToBitMask(rightPin);
+
+  reset();
+}
+
+void LineFollower::reset()
+{
+  memset(_history, 0, sizeof(_history));
+  _index = 0;
+  _position = 0;
+  _previous = 0;
+  _lastSide = 0;
+  _state = LINE_FOLLOWING;
+  _lastUpdate = millis();
+}
+
+//---------------------------------------------------------
+//-- The two input registers are read back to back with
+//-- interrupts off (the sensors sit on different ports):
+//-- both bits belong to the same instant
+//---------------------------------------------------------
+uint8_t LineFollower::readSensors()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  uint8_t left = *_leftPort;
+  uint8_t right = *_rightPort;
+  SREG = oldSREG;
+
+  uint8_t sensors = 0;
+  if (!(left & _leftMask)) sensors |= LINE_LEFT;
+  if (!(right & _rightMask)) sensors |= LINE_RIGHT;
+  return sensors;
+}
+
+bool LineFollower::update(int &left, int &right)
+{
+  unsigned long now = millis();
+  if (now - _lastUpdate < LINE_PERIOD_MS) return false;
+
+  //-- Fixed rate, unless the caller fell behind by more than
+  //-- a period: then restart the clock instead of catching up
+  _lastUpdate += LINE_PERIOD_MS;
+  if (now - _lastUpdate >= LINE_PERIOD_MS) _lastUpdate = now;
+
+  uint8_t sensors = readSensors();
+  int8_t side;
+  switch (sensors) {
+    case LINE_LEFT | LINE_RIGHT: side = 0; break;
+    case LINE_LEFT:              side = 1; break;
+    case LINE_RIGHT:             side = -1; break;
+    default:                     side = 2 * _lastSide; break;
+  }
+
+  //-- The sample leaving the position moves into the previous sum
+  uint8_t middle = (_index + LINE_HISTORY) % (2 * LINE_HISTORY);
+  _previous += _history[middle] - _history[_index];
+  _position += side - _history[middle];
+  _history[_index] = side;
+  _index = (_index + 1) % (2 * LINE_HISTORY);
+
+  //-- Lost line: timed search, then stop
+  if (sensors != 0) {
+    _lastSide = side;
+    _state = LINE_FOLLOWING;
+  } else if (_state == LINE_FOLLOWING) {
+    _state = LINE_SEARCHING;
+    _searchStart = now;
+  } else if (_state == LINE_SEARCHING && now - _searchStart >= LINE_SEARCH_MS) {
+    _state = LINE_LOST;
+  }
+
+  if (_state == LINE_LOST) {
+    left = 0;
+    right = 0;
+    return true;
+  }
+
+  int rate = _position - _previous;
+  int turn = LINE_KP * _position + LINE_KD * rate;
+  left = LINE_SPEED - turn;
+  right = LINE_SPEED + turn;
+  return true;
+}
+
+uint8_t LineFollower::getState()
+{
+  return _state;
+}
+
+int LineFollower::getPosition()
+{
+  return _position;
+}
+
+int LineFollower::getRate()
+{
+  return _position - _previous;
+}
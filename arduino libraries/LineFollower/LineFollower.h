@@ -0,0 +1,76 @@
+//--------------------------------------------------------------
+//-- LineFollower.h
+//-- PD line following on two digital IR sensors
+//--------------------------------------------------------------
+//-- Both sensors are sampled together every LINE_PERIOD_MS and
+//-- each sample gives the side of the line:
+//--     both over the line      0
+//--     right one off it       +1 (line to the left)
+//--     left one off it        -1 (line to the right)
+//--     both off              +-2 towards where it was last seen
+//-- The position is the sum of the last LINE_HISTORY samples and
+//-- the rate its change against the LINE_HISTORY before, so a
+//-- sensor that flickers on the edge reads as a fraction.
+//--
+//-- The wheel speeds (deg/s, positive forward) are LINE_SPEED
+//-- plus/minus KP * position + KD * rate. With both sensors off
+//-- the line the robot keeps turning where it was last seen for
+//-- LINE_SEARCH_MS, then gives up (LINE_LOST, speeds 0).
+//--------------------------------------------------------------
+#ifndef LineFollower_h
+#define LineFollower_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define LINE_PERIOD_MS    5       //-- Control period (200 Hz)
+#define LINE_HISTORY      8       //-- Samples in the position
+#define LINE_SPEED        150     //-- Wheel deg/s on a straight line
+#define LINE_KP           8       //-- Wheel deg/s per position step
+#define LINE_KD           16      //-- Wheel deg/s per rate step
+#define LINE_SEARCH_MS    1500    //-- Time looking for a lost line
+
+//-- Sensor bits from readSensors(): 1 = over the line
+#define LINE_LEFT         0x01
+#define LINE_RIGHT        0x02
+
+//-- States
+#define LINE_FOLLOWING    0
+#define LINE_SEARCHING    1
+#define LINE_LOST         2
+
+class LineFollower
+{
+  public:
+    //-- The sensors read LOW over the line
+    void init(uint8_t leftPin, uint8_t rightPin);
+    void reset();                //-- Forgets the history, back to following
+
+    uint8_t readSensors();       //-- Both sensors at the same instant
+    //-- Once per period: true with new wheel speeds
+    bool update(int &left, int &right);
+
+    uint8_t getState();
+    int getPosition();           //-- -2*LINE_HISTORY..2*LINE_HISTORY, positive to the left
+    int getRate();
+
+  private:
+    volatile uint8_t *_leftPort;
+    volatile uint8_t *_rightPort;
+    uint8_t _leftMask;
+    uint8_t _rightMask;
+
+    int8_t _history[2 * LINE_HISTORY];
+    uint8_t _index;
+    int _position;               //-- Sum of the newest LINE_HISTORY samples
+    int _previous;               //-- Sum of the LINE_HISTORY before them
+    int8_t _lastSide;
+    uint8_t _state;
+    unsigned long _lastUpdate;
+    unsigned long _searchStart;
+};
+
+#endif //LineFollower_h
@@ -0,0 +1,102 @@
+//--------------------------------------------------------------
+//-- Odometry.cpp
+//-- Pose of a differential drive robot from its wheel encoders
+//--------------------------------------------------------------
+#include "Odometry.h"
+#include <util/atomic.h>
+
+void Odometry::init(ServoEncoder *left, ServoEncoder *right, int wheelDiameter, int track)
+{
+  //-- pi D / 720 in 1/65536 mm, D / (720 track) of a turn in 2^32
+  _travel = (wheelDiameter * FIX(PI, 16) + 360) / 720;
+  _turn = fix_div(wheelDiameter, 720UL * track, 32);
+  _degreesPerMm = fix_div(360, wheelDiameter * FIX(PI, 16), 32);
+  reset();
+
+  left->onMove(leftMoved, this);
+  right->onMove(rightMoved, this);
+}
+
+void Odometry::reset()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _x = 0;
+    _y = 0;
+    _heading = 0;
+    _distance = 0;
+  }
+}
+
+void Odometry::leftMoved(void *odometry, int delta)
+{
+  ((Odometry *)odometry)->moved(LEFT_POS, delta);
+}
+
+void Odometry::rightMoved(void *odometry, int delta)
+{
+  ((Odometry *)odometry)->moved(RIGHT_POS, delta);
+}
+
+//---------------------------------------------------------
+//-- One wheel turned delta degrees (forward positive): the
+//-- middle of the axle moves half its travel, along the
+//-- heading halfway through the turn
+//---------------------------------------------------------
+void Odometry::moved(int8_t side, int delta)
+{
+  long turn = delta * _turn;
+  if (side == LEFT_POS) turn = -turn;
+
+  uint16_t angle = (_heading + turn / 2 + 0x8000UL) >> 16;
+  long step = (delta * _travel + 128) >> 8;            //-- 1/256 mm
+
+  _x += (step * fix_cos(angle) + 64) >> 7;
+  _y += (step * fix_sin(angle) + 64) >> 7;
+  _heading += turn;
+  _distance += step;
+}
+
+void Odometry::getPose(OdometryPose &pose)
+{
+  long x, y, distance;
+  uint32_t heading;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    x = _x;
+    y = _y;
+    heading = _heading;
+    distance = _distance;
+  }
+
+  pose.x = (x + 0x8000) >> 16;
+  pose.y = (y + 0x8000) >> 16;
+  pose.heading = ((heading >> 16) * 360UL + 0x8000) >> 16;
+  if (pose.heading == 360) pose.heading = 0;
+  pose.distance = (distance + 128) >> 8;
+}
+
+uint16_t Odometry::getHeading()
+{
+  uint32_t heading;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    heading = _heading;
+  }
+  return heading >> 16;
+}
+
+long Odometry::getDistance()
+{
+  long distance;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    distance = _distance;
+  }
+  return (distance + 128) >> 8;
+}
+
+long Odometry::wheelDegrees(long mm)
+{
+  long degrees = ((uint32_t)labs(mm) * _degreesPerMm) >> 16;
+  return (mm < 0) ? -degrees : degrees;
+}
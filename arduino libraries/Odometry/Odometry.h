@@ -0,0 +1,61 @@
+//--------------------------------------------------------------
+//-- Odometry.h
+//-- Pose of a differential drive robot from its wheel encoders
+//--------------------------------------------------------------
+//-- Every encoder step (in the ADC interrupt, see ServoEncoder)
+//-- moves the pose by half the wheel travel along the heading,
+//-- and turns it by the wheel travel over the track width.
+//-- All fixed point: x, y in 1/65536 mm, heading as a binary
+//-- angle (2^32 per turn, so it wraps by itself).
+//--
+//-- x points forward from where the pose was reset, y to the
+//-- left, and the heading grows counterclockwise.
+//--------------------------------------------------------------
+#ifndef Odometry_h
+#define Odometry_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#include <ServoEncoder.h>
+#include <FixedPoint.h>
+
+struct OdometryPose {
+  long x;             //-- mm
+  long y;             //-- mm
+  int heading;        //-- Degrees, 0..359 counterclockwise
+  long distance;      //-- mm driven by the middle of the axle, backwards negative
+};
+
+class Odometry
+{
+  public:
+    //-- Wheel diameter and distance between the wheels, mm
+    void init(ServoEncoder *left, ServoEncoder *right, int wheelDiameter, int track);
+    void reset();
+
+    void getPose(OdometryPose &pose);
+    uint16_t getHeading();       //-- Binary angle, 65536 per turn
+    long getDistance();          //-- mm
+
+    //-- Wheel degrees that move the robot mm straight (up to 32 m)
+    long wheelDegrees(long mm);
+
+    void moved(int8_t side, int delta);     //-- Wheel step, degrees (interrupt)
+
+  private:
+    long _x, _y;                 //-- 1/65536 mm
+    uint32_t _heading;           //-- Binary angle
+    long _distance;              //-- 1/256 mm
+    long _travel;                //-- Half the wheel travel per degree, 1/65536 mm
+    long _turn;                  //-- Heading change per wheel degree, binary angle
+    uint32_t _degreesPerMm;      //-- Wheel degrees per mm, Q16
+
+    static void leftMoved(void *odometry, int delta);
+    static void rightMoved(void *odometry, int delta);
+};
+
+#endif //Odometry_h
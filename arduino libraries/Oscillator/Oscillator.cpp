@@ -47,9 +47,7 @@ void Oscillator::attach(int pin, bool rev)
 
       //-- Initialization of oscilaltor parameters
       _TS=30;
-      _T=2000;
-      _N = _T/_TS;
-      _inc = 2*M_PI/_N;
+      SetT(2000);
 
       _previousMillis=0;
 
@@ -83,9 +81,10 @@ void Oscillator::SetT(unsigned int T)
   //-- Assign the new period
   _T=T;
   
-  //-- Recalculate the parameters
-  _N = _T/_TS;
-  _inc = 2*M_PI/_N;
+  //-- Recalculate the parameters: a turn in T/TS samples
+  unsigned int N = _T/_TS;
+  if (N == 0) N = 1;
+  _inc = (65536UL + N/2) / N;
 };
 
 /*******************************/
@@ -112,7 +111,7 @@ void Oscillator::refresh()
       //-- If the oscillator is not stopped, calculate the servo position
       if (!_stop) {
         //-- Sample the sine function and set the servo pos
-         _pos = round(_A * sin(_phase + _phase0) + _O);
+         _pos = (((long)_A * fix_sin(_phase + _phase0) + 16384) >> 15) + _O;
 	       if (_rev) _pos=-_pos;
          _servo.write(_pos+90+_trim);
       }
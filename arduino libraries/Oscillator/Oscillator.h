@@ -9,6 +9,7 @@
 #define Oscillator_h
 
 #include <Servo.h>
+#include <FixedPoint.h>
 
 //-- Macro for converting from degrees to radians
 #ifndef DEG2RAD
@@ -24,7 +25,8 @@ class Oscillator
     
     void SetA(unsigned int A) {_A=A;};
     void SetO(unsigned int O) {_O=O;};
-    void SetPh(double Ph) {_phase0=Ph;};
+    void SetPhase(uint16_t phase) {_phase0=phase;};   //-- Binary angle, 65536 per turn
+    void SetPh(double Ph) {_phase0=(uint16_t)(long)(Ph*(32768.0/M_PI));};   //-- Radians (float)
     void SetT(unsigned int T);
     void SetTrim(int trim){_trim=trim;};
     int getTrim() {return _trim;};
@@ -45,14 +47,13 @@ class Oscillator
     unsigned int _A;  //-- Amplitude (degrees)
     unsigned int _O;  //-- Offset (degrees)
     unsigned int _T;  //-- Period (miliseconds)
-    double _phase0;   //-- Phase (radians)
+    uint16_t _phase0; //-- Phase (binary angle)
     
     //-- Internal variables
     int _pos;         //-- Current servo pos
     int _trim;        //-- Calibration offset
-    double _phase;    //-- Current phase
-    double _inc;      //-- Increment of phase
-    double _N;        //-- Number of samples
+    uint16_t _phase;  //-- Current phase (binary angle)
+    uint16_t _inc;    //-- Increment of phase
     unsigned int _TS; //-- sampling period (ms)
     
     long _previousMillis; 
@@ -1,10 +1,19 @@
 #include "ServoEncoder.h"
+#include <AnalogSampler.h>
+#include <FixedPoint.h>
+#include <util/atomic.h>
 
 //****** ServoEncoder ******//
 ServoEncoder::ServoEncoder() {
+  _slot = -1;
+  _velocityCallback = 0;
+  _moveCallback = 0;
 }
 
 ServoEncoder::ServoEncoder(int pinEncoder, int position) {
+  _slot = -1;
+  _velocityCallback = 0;
+  _moveCallback = 0;
   ServoEncoder::init(pinEncoder, position);
 }
 
@@ -15,39 +24,168 @@ void ServoEncoder::init(int pinEncoder, int position)
   lap = 1;
   donelap = true;
   _pos = position;
+
+  _low = 1023;
+  _high = 0;
+  _decay = 0;
+  _angle = 0;
+  _position = 0;
+  _windowPosition = 0;
+  _windowStart = millis();
+  _velocity = 0;
+  _value = 0;
+  _started = false;
+  calibrate();
+
+  //-- Sampled in the background when there is a free channel,
+  //-- otherwise by every call to read()
+  if (_slot < 0) {
+    _slot = AnalogSampler::add(_pinEncoder, sampled, this);
+    AnalogSampler::begin();
+  }
 }
 
-int ServoEncoder::getLap() {
-  return lap;
+void ServoEncoder::onVelocity(void (*callback)(void *context, int velocity), void *context) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _velocityCallback = callback;
+    _velocityContext = context;
+  }
 }
 
-int ServoEncoder::read() {
-  int val;
+void ServoEncoder::onMove(void (*callback)(void *context, int delta), void *context) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _moveCallback = callback;
+    _moveContext = context;
+  }
+}
 
-  val = analogRead(_pinEncoder);
-  if (_pos == LEFT_POS) {
-     if (donelap == false) {
-       if (val >= 0 && val < 50) {
-          lap = lap + 1;
-          donelap = true;
-       }
-     }
+void ServoEncoder::sampled(void *encoder, uint16_t val) {
+  ((ServoEncoder *)encoder)->sample(val);
+}
+
+//-- Thresholds and angle scale from the learnt range, or the
+//-- default one until a whole lap has been seen
+void ServoEncoder::calibrate() {
+  uint16_t low = ENCODER_LOW_DEFAULT;
+  uint16_t high = ENCODER_HIGH_DEFAULT;
+
+  if (lap > 1 && _high > _low + ENCODER_MIN_SPAN) {
+    low = _low;
+    high = _high;
+  }
+
+  uint16_t margin = (high - low) / 16;
+  _lowThreshold = low + margin;
+  _highThreshold = high - margin;
+  _rangeLow = low;
+  _scale = (45 * fix_recip(high - low + 1)) >> 5;    //-- (360 << 16) / span, without a division (interrupt)
+}
+
+void ServoEncoder::sample(uint16_t val) {
+  //-- Learn the range, and let it shrink slowly so that it
+  //-- follows a drifting sensor
+  bool changed = false;
+  if (val < _low) { _low = val; changed = true; }
+  if (val > _high) { _high = val; changed = true; }
+  if (++_decay >= ENCODER_DECAY_SAMPLES) {
+    _decay = 0;
+    if (_high > _low + ENCODER_MIN_SPAN) { _low++; _high--; changed = true; }
+  }
 
-     if (val > 750 && val < 800) {
-          donelap = false;
+  //-- Laps: the value wraps from the top to the bottom of its
+  //-- range (left wheel) or the other way round (right wheel)
+  if (_pos == LEFT_POS) {
+     if (donelap == false && val < _lowThreshold) {
+        lap = lap + 1;
+        donelap = true;
+        changed = true;
      }
+     if (val > _highThreshold) donelap = false;
   } else {
-     if (donelap == false) {
-       if (val >= 750 && val < 800) {
-          lap = lap + 1;
-          donelap = true;
-       }
+     if (donelap == false && val > _highThreshold) {
+        lap = lap + 1;
+        donelap = true;
+        changed = true;
      }
+     if (val < _lowThreshold) donelap = false;
+  }
+  if (changed) calibrate();
 
-     if (val > 0 && val < 50) {
-          donelap = false;
-     }
+  //-- Angle inside the lap and unwrapped position
+  uint16_t offset = (val > _rangeLow) ? val - _rangeLow : 0;
+  int angle = (offset * _scale) >> 16;
+  if (angle > 359) angle = 359;
+  if (_pos != LEFT_POS) angle = (360 - angle) % 360;
+
+  //-- The first sample only sets where the wheel starts
+  int delta = _started ? angle - _angle : 0;
+  if (delta > 180) delta -= 360;
+  else if (delta < -180) delta += 360;
+  _started = true;
+  _position += delta;
+  _angle = angle;
+  if (delta && _moveCallback) _moveCallback(_moveContext, delta);
+
+  //-- Velocity over the last window
+  unsigned long now = millis();
+  unsigned long elapsed = now - _windowStart;
+  if (elapsed >= ENCODER_VELOCITY_MS) {
+    long velocity = ((_position - _windowPosition) << ENCODER_VELOCITY_SHIFT) * 1000 / (long)elapsed;
+    _velocity = fix_sat16(velocity);
+    _windowPosition = _position;
+    _windowStart = now;
+    if (_velocityCallback) _velocityCallback(_velocityContext, _velocity);
   }
 
-  return val;
+  _value = val;
+  _seq++;
+}
+
+//-- Copies the state without disabling interrupts: retried if
+//-- a sample came in the middle of the copy
+void ServoEncoder::snapshot(ServoEncoderState &state) {
+  uint8_t seq;
+
+  if (_slot < 0) sample(AnalogSampler::analogRead(_pinEncoder));
+
+  do {
+    seq = _seq;
+    asm volatile("" ::: "memory");   //-- Read the fields after the sequence
+    state.lap = lap;
+    state.angle = _angle;
+    state.position = _position;
+    state.velocity = _velocity;
+    state.value = _value;
+    asm volatile("" ::: "memory");
+  } while (seq != _seq);
+}
+
+int ServoEncoder::getLap() {
+  ServoEncoderState state;
+  snapshot(state);
+  return state.lap;
+}
+
+int ServoEncoder::read() {
+  ServoEncoderState state;
+  snapshot(state);
+  return state.value;
+}
+
+int ServoEncoder::getAngle() {
+  ServoEncoderState state;
+  snapshot(state);
+  return state.angle;
+}
+
+long ServoEncoder::getPosition() {
+  ServoEncoderState state;
+  snapshot(state);
+  return state.position;
+}
+
+int ServoEncoder::getVelocity() {
+  ServoEncoderState state;
+  snapshot(state);
+  return state.velocity;
 }
@@ -5,6 +5,26 @@
 #define LEFT_POS        1
 #define RIGHT_POS       -1
 
+//-- The encoder is sampled in the ADC interrupt (AnalogSampler:
+//-- 1 kHz shared by the channels, ~333 Hz with both wheels and the
+//-- battery). The lap thresholds
+//-- sit 1/16 of the range inside the lowest and highest values
+//-- seen, and the value between them gives the angle in the lap.
+#define ENCODER_MIN_SPAN        200     //-- Learnt range needed before it replaces the default
+#define ENCODER_LOW_DEFAULT     0       //-- Range until then: thresholds at 50 and 750,
+#define ENCODER_HIGH_DEFAULT    800     //-- the old fixed windows
+#define ENCODER_DECAY_SAMPLES   128     //-- The learnt range shrinks 1 step every N samples
+#define ENCODER_VELOCITY_MS     50      //-- Velocity window (and speed control period)
+#define ENCODER_VELOCITY_SHIFT  4       //-- Velocity fraction bits: 1/16 deg/s
+
+struct ServoEncoderState {
+  int lap;
+  int angle;          //-- Degrees inside the lap, 0..359
+  long position;      //-- Degrees turned since init, laps included
+  int velocity;       //-- Fixed point deg/s (ENCODER_VELOCITY_SHIFT fraction bits)
+  uint16_t value;     //-- Last raw sample
+};
+
 class ServoEncoder
 {
 public:
@@ -12,12 +32,44 @@ public:
 	void init(int pinEncoder, int position);
 	ServoEncoder(int pinTrigger, int position);
 	int getLap();
-	int read();
+	int read();                         //-- Last raw value
+	int getAngle();
+	long getPosition();
+	int getVelocity();                  //-- Fixed point deg/s
+	void snapshot(ServoEncoderState &state);   //-- Consistent copy of everything
+	//-- Called (from the interrupt) with every new velocity
+	void onVelocity(void (*callback)(void *context, int velocity), void *context);
+	//-- Called (from the interrupt) with every change of position, degrees
+	void onMove(void (*callback)(void *context, int delta), void *context);
+
+	void sample(uint16_t val);          //-- Called with every new value (interrupt)
 private:
 	int _pinEncoder;
         int lap;
         int donelap;
 	int _pos;
+	int8_t _slot;                       //-- AnalogSampler slot, -1 = polled by read()
+
+	uint16_t _low, _high;               //-- Learnt range
+	uint16_t _lowThreshold, _highThreshold;
+	uint16_t _rangeLow;                 //-- Bottom of the range used for the angle
+	uint32_t _scale;                    //-- Degrees per value step, 16 fraction bits
+	uint8_t _decay;
+	int _angle;
+	bool _started;
+	long _position;
+	long _windowPosition;
+	unsigned long _windowStart;
+	int _velocity;
+	uint16_t _value;
+	volatile uint8_t _seq;              //-- Changes on every sample (lock-free snapshot)
+	void (*_velocityCallback)(void *context, int velocity);
+	void *_velocityContext;
+	void (*_moveCallback)(void *context, int delta);
+	void *_moveContext;
+
+	void calibrate();
+	static void sampled(void *encoder, uint16_t val);
 };
 
 #endif //ServoEncoder_h
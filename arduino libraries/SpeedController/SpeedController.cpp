@@ -0,0 +1,108 @@
+//--------------------------------------------------------------
+//-- SpeedController.cpp
+//-- Closed-loop speed of a continuous rotation servo wheel
+//--------------------------------------------------------------
+#include "SpeedController.h"
+#include <util/atomic.h>
+
+#define SPEED_OUTPUT_LIMIT   ((long)SPEED_MAX_OUTPUT << 8)       //-- Q8
+#define SPEED_INTEGRAL_LIMIT (SPEED_OUTPUT_LIMIT << ENCODER_VELOCITY_SHIFT)
+
+void SpeedController::init(ServoEncoder *encoder, Oscillator *servo, int8_t direction)
+{
+  this->encoder = encoder;
+  this->servo = servo;
+  this->direction = direction;
+  active = false;
+  target = 0;
+  setpoint = 0;
+  ramp = 0;
+  integral = 0;
+  output = 90;
+  encoder->onVelocity(velocityUpdated, this);
+}
+
+void SpeedController::velocityUpdated(void *controller, int velocity)
+{
+  ((SpeedController *)controller)->step(velocity);
+}
+
+void SpeedController::setSpeed(int speed)
+{
+  speed = constrain(speed, -SPEED_MAX, SPEED_MAX);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (!active) {
+      integral = 0;
+      setpoint = ramp ? 0 : speed;    //-- Ramps up from a stopped wheel
+    }
+    target = speed;
+    active = true;
+  }
+}
+
+void SpeedController::stop()
+{
+  active = false;
+}
+
+void SpeedController::setRamp(int ramp)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    this->ramp = ramp;
+  }
+}
+
+bool SpeedController::isActive()
+{
+  return active;
+}
+
+int SpeedController::getSpeed()
+{
+  int speed;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    speed = target;
+  }
+  return speed;
+}
+
+int SpeedController::getOutput()
+{
+  int angle;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    angle = output;
+  }
+  return angle;
+}
+
+//---------------------------------------------------------
+//-- output = KFF * setpoint + KP * error + KI * sum(error)
+//-- The error (velocity units, 1/16 deg/s) is only
+//-- integrated while the output is not saturated, or when it
+//-- pulls the output back from the limit
+//---------------------------------------------------------
+void SpeedController::step(int velocity)
+{
+  if (!active) return;
+
+  if (ramp == 0) setpoint = target;
+  else setpoint += constrain(target - setpoint, -ramp, ramp);
+
+  long error = ((long)setpoint << ENCODER_VELOCITY_SHIFT) - velocity;
+  long feedForward = (long)SPEED_KFF * setpoint;
+  long u = feedForward + ((SPEED_KP * error + integral) >> ENCODER_VELOCITY_SHIFT);
+
+  bool saturated = (u >= SPEED_OUTPUT_LIMIT && error > 0) || (u <= -SPEED_OUTPUT_LIMIT && error < 0);
+  if (!saturated) {
+    integral = constrain(integral + SPEED_KI * error, -SPEED_INTEGRAL_LIMIT, SPEED_INTEGRAL_LIMIT);
+  }
+
+  u = constrain(u, -SPEED_OUTPUT_LIMIT, SPEED_OUTPUT_LIMIT);
+  int degrees = (u + (u >= 0 ? 128 : -128)) / 256;
+
+  output = 90 + direction * degrees;
+  servo->SetPosition(output);
+}
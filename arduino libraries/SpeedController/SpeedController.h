@@ -0,0 +1,67 @@
+//--------------------------------------------------------------
+//-- SpeedController.h
+//-- Closed-loop speed of a continuous rotation servo wheel
+//--------------------------------------------------------------
+//-- A fixed-point PI controller with feed-forward, run from the
+//-- encoder interrupt on every velocity update (every
+//-- ENCODER_VELOCITY_MS, 20 Hz). The output is the servo angle
+//-- around its 90 degree stop point.
+//--
+//-- Speeds are wheel degrees per second, positive forward: the
+//-- direction in which the encoder counts laps. direction tells
+//-- which side of 90 drives that wheel forward (+1 or -1).
+//--
+//-- With a ramp set, the speed the loop aims at moves towards
+//-- the target by at most that much every period (a limit on
+//-- the acceleration, and on the current peaks it draws).
+//--------------------------------------------------------------
+#ifndef SpeedController_h
+#define SpeedController_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#include <Oscillator.h>
+#include <ServoEncoder.h>
+
+//-- Gains, output in 1/256 servo degree (Q8). The feed-forward
+//-- assumes ~15 deg/s of wheel speed per degree away from 90;
+//-- the integral takes care of the unit to unit differences
+#define SPEED_KFF        17      //-- Q8 output per deg/s of target
+#define SPEED_KP         8       //-- Q8 output per deg/s of error
+#define SPEED_KI         6       //-- Q8 output per deg/s of error, every step
+#define SPEED_MAX_OUTPUT 30      //-- Servo degrees away from 90
+#define SPEED_MAX        400     //-- deg/s accepted by setSpeed()
+
+class SpeedController
+{
+  public:
+    void init(ServoEncoder *encoder, Oscillator *servo, int8_t direction);
+
+    void setSpeed(int speed);    //-- deg/s; starts the control loop
+    void stop();                 //-- Stops the control loop (the servo is left as it is)
+    void setRamp(int ramp);      //-- deg/s per period, 0 = no limit
+    bool isActive();
+    int getSpeed();              //-- Target, deg/s
+    int getOutput();             //-- Last servo angle written
+
+    void step(int velocity);     //-- One control period, velocity from the encoder (interrupt)
+
+  private:
+    ServoEncoder *encoder;
+    Oscillator *servo;
+    int8_t direction;
+    volatile bool active;
+    volatile int target;
+    int setpoint;                //-- Target after the ramp
+    int ramp;
+    long integral;               //-- Q8 output
+    volatile int output;
+
+    static void velocityUpdated(void *controller, int velocity);
+};
+
+#endif //SpeedController_h
@@ -1,15 +1,23 @@
 #include "TCS3200.h"
+#include <FastPin.h>
 
 #define LED_RGB               A2
 #define S2_PIN_RGB            A1
 #define S3_PIN_RGB            A0
 #define OUT_PIN_RGB           2
 
+//-- Fixed pins: resolved at compile time (see FastPin.h)
+typedef FastPin<LED_RGB>      LedPin;
+typedef FastPin<S2_PIN_RGB>   S2Pin;
+typedef FastPin<S3_PIN_RGB>   S3Pin;
+typedef FastPin<OUT_PIN_RGB>  OutPin;
+
 #define TIME_CHECK            50
 
 //****** TCS3200 ******//
+//-- Nothing to do before init(): the pins are set up there, not
+//-- during static initialization
 TCS3200::TCS3200() {
-  TCS3200::init();
 }
 
 bool TCS3200::callback()
@@ -23,12 +31,12 @@ void TCS3200::init()
   _g_count = 0;
   _RGBstatus = TCS3200_DETACHED;
 
-  pinMode(LED_RGB, OUTPUT);
-  pinMode(S2_PIN_RGB, OUTPUT);
-  pinMode(S3_PIN_RGB, OUTPUT);
-  pinMode(OUT_PIN_RGB, INPUT);
+  LedPin::output();
+  S2Pin::output();
+  S3Pin::output();
+  OutPin::input();
 
-  digitalWrite(LED_RGB, HIGH);   // Turn off LEDs
+  LedPin::high();   // Turn off LEDs
 }
 
 void TCS3200::filterColor(uint8_t S2, uint8_t S3)
@@ -41,8 +49,8 @@ void TCS3200::filterColor(uint8_t S2, uint8_t S3)
     S3 = HIGH;
   }
 
-  digitalWrite(S2_PIN_RGB, S2);
-  digitalWrite(S3_PIN_RGB, S3);
+  S2Pin::write(S2);
+  S3Pin::write(S3);
 }
 
 void TCS3200::WB(uint8_t S2, uint8_t S3)
@@ -102,10 +110,8 @@ void TCS3200::count()
 void TCS3200::attach()
 {
   if (_RGBstatus == TCS3200_DETACHED) {
-    digitalWrite(LED_RGB, LOW);    // Turn on the LEDs
+    LedPin::low();    // Turn on the LEDs
 
-    _freqValues[3] = {};
-    _scaleFactor[3] = {};
     _g_flag = 0;
     _g_count = 0;
 
@@ -131,9 +137,10 @@ bool TCS3200::read(int *RGBValues)
   if (_RGBstatus == TCS3200_DETECT) {
     getFreq();
     if (_g_flag > 3) {
-      if (_scaleFactor[0] == -1 || _scaleFactor[1] == -1 || _scaleFactor[2] == -1) {
+      if (_scaleFactor[0] == 0 || _scaleFactor[1] == 0 || _scaleFactor[2] == 0) {
         for(int i = 0; i < 3; i++) {
-          _scaleFactor[i] = 255.0 / _freqValues[i];
+          //-- 255 / frequency: the first reading is white
+          _scaleFactor[i] = (_freqValues[i] > 0) ? (255U << 8) / _freqValues[i] : 0xFFFF;
 #ifdef DEBUG
           Serial.print("Scale factor: ");
           Serial.println(_scaleFactor[i]);
@@ -147,9 +154,8 @@ bool TCS3200::read(int *RGBValues)
 
   if (_RGBstatus == TCS3200_READY) {
     for(int j = 0; j < 3; j++) {
-      RGBValues[j] = _freqValues[j] * _scaleFactor[j];
-      if (RGBValues[j] > 255)
-        RGBValues[j] = 255;      // RGB correction
+      long value = ((long)_freqValues[j] * _scaleFactor[j]) >> 8;
+      RGBValues[j] = (value > 255) ? 255 : value;      // RGB correction
 #ifdef DEBUG
       Serial.print("RGB Values: ");
       Serial.println(RGBValues[j]);
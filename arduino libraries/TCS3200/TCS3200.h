@@ -10,7 +10,7 @@
 
 static int _g_count;
 static int _g_flag;
-static float _scaleFactor[3] = {-1, -1, -1};
+static uint16_t _scaleFactor[3];     //-- White balance, Q8. 0 = not measured yet
 static int _freqValues[3];
 static int _RGBstatus;
 static int _pinS2;
@@ -0,0 +1,127 @@
+//--------------------------------------------------------------
+//-- ToneDetector.cpp
+//-- Fixed-point Goertzel filters on blocks of the noise sensor
+//--------------------------------------------------------------
+#include "ToneDetector.h"
+
+void ToneDetector::init(uint8_t pin)
+{
+  _pin = pin;
+  _tones = 0;
+  _capturing = false;
+  _lastBlock = millis();
+  _processTime = 0;
+  _tone = -1;
+  _hold = 0;
+  _pending = false;
+}
+
+int8_t ToneDetector::addTone(unsigned int frequency)
+{
+  if (_tones >= TONE_MAX || frequency < TONE_MIN_HZ || frequency > TONE_MAX_HZ) return -1;
+
+  //-- 2 cos(w) in Q14 is cos(w) in Q15
+  uint16_t w = fix_div(frequency, ANALOG_CAPTURE_RATE, 16);
+  _coeff[_tones] = fix_cos(w);
+  _percent[_tones] = 0;
+  return _tones++;
+}
+
+bool ToneDetector::update()
+{
+  if (_capturing) {
+    if (!AnalogSampler::captureDone()) return false;
+    _capturing = false;
+
+    unsigned long start = micros();
+    process();
+    _processTime = micros() - start;
+    return true;
+  }
+
+  if (_tones > 0 && millis() - _lastBlock >= TONE_PERIOD_MS) {
+    _lastBlock = millis();
+    _capturing = AnalogSampler::capture(_pin, _buffer, TONE_BLOCK);
+  }
+  return false;
+}
+
+//---------------------------------------------------------
+//-- Goertzel: s = x + 2cos(w) s1 - s2 over the block, then
+//-- power = s1^2 + s2^2 - 2cos(w) s1 s2. Samples are taken
+//-- around the block mean and halved (+-127, in place), so s
+//-- stays in 16 bits and each step is one 16x16 multiply
+//---------------------------------------------------------
+void ToneDetector::process()
+{
+  uint16_t sum = 0;
+  for (uint8_t i = 0; i < TONE_BLOCK; i++) sum += _buffer[i];
+  uint8_t mean = (sum + TONE_BLOCK / 2) / TONE_BLOCK;
+
+  int8_t *x = (int8_t *)_buffer;
+  long energy = 0;
+  for (uint8_t i = 0; i < TONE_BLOCK; i++) {
+    x[i] = ((int16_t)_buffer[i] - mean) >> 1;
+    energy += x[i] * x[i];
+  }
+
+  int8_t best = -1;
+  uint8_t bestPercent = 0;
+  long full = energy * TONE_BLOCK / 200;     //-- Power of a pure tone with this energy, / 100
+
+  for (uint8_t t = 0; t < _tones; t++) {
+    int16_t coeff = _coeff[t];
+    int16_t s1 = 0, s2 = 0;
+
+    for (uint8_t i = 0; i < TONE_BLOCK; i++) {
+      int16_t s = x[i] + (int16_t)(((long)coeff * s1) >> 14) - s2;
+      s2 = s1;
+      s1 = s;
+    }
+
+    long power = (long)s1 * s1 + (long)s2 * s2 - (((long)coeff * s1) >> 14) * s2;
+    long percent = (full > 0) ? power / full : 0;
+    _percent[t] = constrain(percent, 0, 100);
+
+    if (_percent[t] > bestPercent) {
+      bestPercent = _percent[t];
+      best = t;
+    }
+  }
+
+  if (bestPercent < TONE_MIN_PERCENT || energy < (long)TONE_MIN_LEVEL * TONE_BLOCK) best = -1;
+
+  //-- Events: the same tone for TONE_HOLD blocks, once
+  if (best != _tone) {
+    _tone = best;
+    _hold = 0;
+  }
+  if (_tone >= 0 && _hold < TONE_HOLD && ++_hold == TONE_HOLD) {
+    _event.time = millis();
+    _event.tone = _tone;
+    _pending = true;
+  }
+}
+
+bool ToneDetector::read(ToneEvent &event)
+{
+  if (!_pending) return false;
+  event = _event;
+  _pending = false;
+  return true;
+}
+
+int8_t ToneDetector::getTone()
+{
+  return _tone;
+}
+
+uint8_t ToneDetector::getPercent(uint8_t tone)
+{
+  return _percent[tone];
+}
+
+unsigned int ToneDetector::getProcessTime()
+{
+  return _processTime;
+}
@@ -0,0 +1,78 @@
+//--------------------------------------------------------------
+//-- ToneDetector.h
+//-- Fixed-point Goertzel filters on blocks of the noise sensor
+//--------------------------------------------------------------
+//-- Every TONE_PERIOD_MS a block of TONE_BLOCK samples is
+//-- captured at ANALOG_CAPTURE_RATE (AnalogSampler::capture(),
+//-- ~10 ms; the background channels pause meanwhile) and run
+//-- through one Goertzel filter per tone, in 16 bit integers.
+//--
+//-- A tone is heard when it holds at least TONE_MIN_PERCENT of
+//-- the block energy (100% = a pure sine right on its frequency)
+//-- and the block is not silence. The same tone in TONE_HOLD
+//-- blocks in a row makes one event; it has to stop before it
+//-- makes another.
+//--------------------------------------------------------------
+#ifndef ToneDetector_h
+#define ToneDetector_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#include <AnalogSampler.h>
+#include <FixedPoint.h>
+
+#define TONE_BLOCK         96      //-- Samples per block: 100 Hz wide filters
+#define TONE_PERIOD_MS     40      //-- One block every period
+#define TONE_MAX           6
+#define TONE_MIN_PERCENT   40
+#define TONE_MIN_LEVEL     4       //-- Mean square of the block (8 bit samples / 2)
+#define TONE_HOLD          3       //-- Blocks in a row for an event
+
+//-- Band where the 16 bit filter state cannot wrap: on its own
+//-- frequency it grows to about TONE_BLOCK * 127 / (2 sin w)
+#define TONE_MIN_HZ        320
+#define TONE_MAX_HZ        (ANALOG_CAPTURE_RATE / 2 - TONE_MIN_HZ)
+
+struct ToneEvent {
+  unsigned long time;     //-- millis() of the block that completed the event
+  uint8_t tone;           //-- Index returned by addTone()
+};
+
+class ToneDetector
+{
+  public:
+    void init(uint8_t pin);
+    int8_t addTone(unsigned int frequency);   //-- Hz, TONE_MIN_HZ to TONE_MAX_HZ. -1 if outside or full
+
+    //-- Call from the loop: processes a captured block and starts
+    //-- the next one. true when a block was processed
+    bool update();
+    bool read(ToneEvent &event);     //-- New tone heard since the last read
+
+    int8_t getTone();                //-- Tone of the last block, -1 none
+    uint8_t getPercent(uint8_t tone);   //-- Share of the last block's energy
+    unsigned int getProcessTime();   //-- us spent on the filters of the last block
+
+    void process();                  //-- Runs the filters over the block in the buffer
+
+  private:
+    uint8_t _pin;
+    uint8_t _buffer[TONE_BLOCK];
+    int16_t _coeff[TONE_MAX];        //-- 2 cos(w), 14 fraction bits
+    uint8_t _percent[TONE_MAX];
+    uint8_t _tones;
+    bool _capturing;
+    unsigned long _lastBlock;
+    unsigned int _processTime;
+
+    int8_t _tone;
+    uint8_t _hold;
+    bool _pending;
+    ToneEvent _event;
+};
+
+#endif //ToneDetector_h
@@ -1,20 +1,62 @@
 #ifndef US_h
 #define US_h
 #include "Arduino.h"
+#include <FastPin.h>
 
-class US
+//-- Ultrasonic sensor on pin types (FastPin<n> or RuntimePin)
+template<class TriggerPin, class EchoPin>
+class UST
+{
+public:
+	UST() {}
+	UST(TriggerPin pinTrigger, EchoPin pinEcho) { init(pinTrigger, pinEcho); }
+
+	void init(TriggerPin pinTrigger=TriggerPin(), EchoPin pinEcho=EchoPin())
+	{
+	  _pinTrigger = pinTrigger;
+	  _pinEcho = pinEcho;
+	  _pinTrigger.output();
+	  _pinEcho.input();
+	}
+
+	//-- cm, 999 when there is no echo
+	int readCm()
+	{
+	  long microseconds = TP_init();
+	  int distance;
+	  distance = microseconds/58;
+	  if (distance == 0){
+	    distance = 999;
+	  }
+	  return distance;
+	}
+
+	float read() { return readCm(); }
+
+private:
+	TriggerPin _pinTrigger;
+	EchoPin _pinEcho;
+
+	long TP_init()
+	{
+	    _pinTrigger.low();
+	    delayMicroseconds(2);
+	    _pinTrigger.high();
+	    delayMicroseconds(10);
+	    _pinTrigger.low();
+	    long microseconds = pulseIn(_pinEcho.number,HIGH,40000); //40000
+	    return microseconds;
+	}
+
+};
+
+class US : public UST<RuntimePin, RuntimePin>
 {
 public:
 	US();
 	void init(int pinTrigger, int pinEcho);
 	US(int pinTrigger, int pinEcho);
-	float read();
-
-private:
-	int _pinTrigger;
-	int _pinEcho;
-	long TP_init();
 
 };
 
-#endif //US_h
\ No newline at end of file
+#endif //US_h
@@ -9,9 +9,14 @@
 
 #include "Zowi.h"
 #include <Oscillator.h>
-#include <US.h>
-#include <IR.h>
-#include <TCS3200.h>
+#include <ZowiSettings.h>
+#include <util/atomic.h>
+
+#if ZOWI_USE_TRACE
+  #define ZOWI_TRACE(id, payload)  Trace.record(id, payload)
+#else
+  #define ZOWI_TRACE(id, payload)  do { } while (0)
+#endif
 
 
 void Zowi::init(int RL, int RR, bool load_calibration, int NoiseSensor, int Buzzer, int USTrigger, int USEcho, int IRLeft, int IRRight, int LeftEncoder, int RightEncoder) {
@@ -22,29 +27,37 @@ void Zowi::init(int RL, int RR, bool load_calibration, int NoiseSensor, int Buzz
   attachServos();
   isZowiResting=false;
 
+  //-- Trims kept by ZowiSettings. Sketches with a ZowiSettings of
+  //-- their own pass false and set them from it
   if (load_calibration) {
-    for (int i = 0; i < 2; i++) {
-      int servo_trim = EEPROM.read(i);
-      if (servo_trim > 128) servo_trim -= 256;
-      servo[i].SetTrim(servo_trim);
-    }
+    ZowiSettings settings;
+    settings.load();
+    for (int i = 0; i < 2; i++) servo[i].SetTrim(settings.get().trims[i]);
   }
   
   for (int i = 0; i < 2; i++) servo_position[i] = 90;
 
-  // IR init
-  ir_left.init(IRLeft);
-  ir_right.init(IRRight);
-
-  // RGB Init
+#if ZOWI_USE_RGB
+  // RGB Init: only the pins, with its LEDs off
   rgb_detector.init();
+#endif
 
-  // Encoder
-  left_encoder.init(LeftEncoder, LEFT);
-  right_encoder.init(RightEncoder, RIGHT);
+  speedControl = false;
 
-  //US sensor init with the pins:
-  us.init(USTrigger, USEcho);
+  //The other sensors start on their first use (see start())
+  started = 0;
+#if ZOWI_USE_US
+  pinUS[0] = USTrigger;
+  pinUS[1] = USEcho;
+#endif
+#if ZOWI_USE_IR
+  pinIR[0] = IRLeft;
+  pinIR[1] = IRRight;
+#endif
+#if ZOWI_USE_ENCODERS
+  pinEncoder[0] = LeftEncoder;
+  pinEncoder[1] = RightEncoder;
+#endif
 
   //Buzzer & noise sensor pins:
   pinBuzzer = Buzzer;
@@ -54,6 +67,56 @@ void Zowi::init(int RL, int RR, bool load_calibration, int NoiseSensor, int Buzz
   pinMode(NoiseSensor,INPUT);
 }
 
+//---------------------------------------------------------
+//-- Zowi start: sets up the sensors that are not running
+//-- yet. Every function that needs one calls it first (use()).
+//-- Not for interrupt handlers: a setup may read the ADC
+//---------------------------------------------------------
+void Zowi::start(uint8_t sensors) {
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    sensors &= ~started;
+    started |= sensors;
+  }
+
+#if ZOWI_USE_IR
+  if (sensors & ZOWI_START_IR) {
+    ir_left.init(pinIR[0]);
+    ir_right.init(pinIR[1]);
+  }
+#endif
+
+#if ZOWI_USE_ENCODERS
+  if (sensors & ZOWI_START_ENCODERS) {
+    left_encoder.init(pinEncoder[0], LEFT);
+    right_encoder.init(pinEncoder[1], RIGHT);
+
+    //Speed control: the left servo drives forward above 90, the right one below
+    wheel[0].init(&left_encoder, &servo[0], 1);
+    wheel[1].init(&right_encoder, &servo[1], -1);
+#if ZOWI_USE_BATTERY
+    wheel[0].setRamp(governor.getLimits().ramp);
+    wheel[1].setRamp(governor.getLimits().ramp);
+#endif
+    odometry.init(&left_encoder, &right_encoder, ZOWI_WHEEL_DIAMETER, ZOWI_WHEEL_TRACK);
+  }
+#endif
+
+#if ZOWI_USE_BATTERY
+  //Battery: filtered in the background from now on
+  if (sensors & ZOWI_START_BATTERY) battery.init();
+#endif
+
+#if ZOWI_USE_US
+  if (sensors & ZOWI_START_US) us.init(pinUS[0], pinUS[1]);
+#endif
+}
+
+uint8_t Zowi::getStarted() {
+
+  return started;
+}
+
 ///////////////////////////////////////////////////////////////////
 //-- ATTACH & DETACH FUNCTIONS ----------------------------------//
 ///////////////////////////////////////////////////////////////////
@@ -63,8 +126,10 @@ void Zowi::attachServos(){
 }
 
 void Zowi::detachServos(){
+    stopWheels();
     servo[0].detach();
     servo[1].detach();
+    setLoad(0);
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -75,38 +140,246 @@ void Zowi::setTrims(int YL, int YR, int RL, int RR) {
   servo[1].SetTrim(YR);
 }
 
+//-- Into the ZowiSettings record (only the bytes that changed are
+//-- written). A sketch with a ZowiSettings of its own edits that
+//-- copy instead: its next save() would put the old trims back
 void Zowi::saveTrimsOnEEPROM() {
-  
-  for (int i = 0; i < 4; i++){ 
-      EEPROM.write(i, servo[i].getTrim());
-  } 
-      
+
+  ZowiSettings settings;
+  settings.load();
+  for (int i = 0; i < 2; i++) settings.get().trims[i] = servo[i].getTrim();
+  settings.save();
 }
 
 
 ///////////////////////////////////////////////////////////////////
 //-- BASIC MOTION FUNCTIONS -------------------------------------//
 ///////////////////////////////////////////////////////////////////
-void Zowi::_moveServos(int time, int  servo_target[]) {
+//---------------------------------------------------------
+//-- Zowi _moveServos: set the servos and keep them there for time ms
+//--  Parameters:
+//--    wait: if false, return at once and let the caller poll isMoving()
+//--  Returns ZOWI_CANCELLED if the wait was cut short (see setCancelSource)
+//---------------------------------------------------------
+int Zowi::_moveServos(int time, int  servo_target[], bool wait) {
 
+  stopWheels();
   attachServos();
   if(getRestState()==true){
         setRestState(false);
   }
 
-  if(time > 10) {
-    final_time = millis() + time;
-    for (int i = 0; i < 2; i++)
-      servo[i].SetPosition(servo_target[i]);
-    
-    final_time =  millis() + time;
-    while (millis() <= final_time)
-      continue;
-  } else {
-    for (int i = 0; i < 2; i++)
-      servo[i].SetPosition(servo_target[i]);
+  //Speeds (away from 90) within the battery limits
+  applyLimits();
+  for (int i = 0; i < 2; i++) servo_position[i] = 90 + scaleSpeed(servo_target[i] - 90);
+  for (int i = 0; i < 2; i++)
+    servo[i].SetPosition(servo_position[i]);
+  setLoad((servo_position[0] != 90) + (servo_position[1] != 90));
+  if (servo_position[0] != 90 || servo_position[1] != 90) use(ZOWI_START_ENCODERS);   //The odometry follows from the first turn
+
+  final_time = millis() + time;
+  ZOWI_TRACE(TRACE_MOTION_START, time);
+
+  if(wait && time > 10) {
+    if(pause(time) == ZOWI_CANCELLED){
+      final_time = millis();
+      ZOWI_TRACE(TRACE_MOTION_STOP, 1);
+      return ZOWI_CANCELLED;
+    }
+  }
+
+  return ZOWI_DONE;
+}
+
+//---------------------------------------------------------
+//-- Zowi _moveWheels: like _moveServos, with the wheels at
+//-- a closed-loop speed (deg/s) instead of a servo position
+//---------------------------------------------------------
+int Zowi::_moveWheels(int time, int left, int right, bool wait) {
+
+  setWheelSpeed(left, right);
+
+  final_time = millis() + time;
+  ZOWI_TRACE(TRACE_MOTION_START, time);
+
+  if(wait && time > 10) {
+    if(pause(time) == ZOWI_CANCELLED){
+      final_time = millis();
+      ZOWI_TRACE(TRACE_MOTION_STOP, 1);
+      return ZOWI_CANCELLED;
+    }
   }
-  for (int i = 0; i < 2; i++) servo_position[i] = servo_target[i];
+
+  return ZOWI_DONE;
+}
+
+void Zowi::setWheelSpeed(int left, int right) {
+
+  attachServos();
+  if(getRestState()==true){
+        setRestState(false);
+  }
+
+  applyLimits();
+  left = scaleSpeed(left);
+  right = scaleSpeed(right);
+
+#if ZOWI_USE_ENCODERS
+  use(ZOWI_START_ENCODERS);
+  wheel[0].setSpeed(left);
+  wheel[1].setSpeed(right);
+#else
+  //Open loop: the left servo drives forward above 90, the right one below
+  servo[0].SetPosition(90 + left / ZOWI_OPEN_LOOP_GAIN);
+  servo[1].SetPosition(90 - right / ZOWI_OPEN_LOOP_GAIN);
+#endif
+  setLoad((left != 0) + (right != 0));
+}
+
+void Zowi::setSpeedControl(bool enabled) {
+
+  speedControl = enabled && ZOWI_USE_ENCODERS;
+}
+
+void Zowi::stopWheels() {
+
+#if ZOWI_USE_ENCODERS
+  if (!(started & ZOWI_START_ENCODERS)) return;
+  wheel[0].stop();
+  wheel[1].stop();
+#endif
+}
+
+#if ZOWI_USE_ENCODERS
+//---------------------------------------------------------
+//-- Zowi driveDistance: drives straight until the odometry
+//-- has covered mm, slowing down at the end and steering to
+//-- keep the heading it started with. Gives up after twice
+//-- the expected time (a stuck wheel)
+//---------------------------------------------------------
+int Zowi::driveDistance(int mm) {
+
+  use(ZOWI_START_ENCODERS);
+  int direction = (mm < 0) ? -1 : 1;
+  long target = odometry.getDistance() + mm;
+  uint16_t heading = odometry.getHeading();
+  unsigned long timeout = 1000 + 2000 * abs(odometry.wheelDegrees(mm)) / scaleSpeed(ZOWI_WHEEL_SPEED);
+
+  final_time = millis() + timeout;
+  ZOWI_TRACE(TRACE_MOTION_START, timeout);
+
+  while (isMoving()) {
+    long remaining = (target - odometry.getDistance()) * direction;
+    if (remaining <= 0) break;
+
+    int speed = constrain(odometry.wheelDegrees(remaining) * 2, ZOWI_WHEEL_SPEED_MIN, ZOWI_WHEEL_SPEED);
+    //Two deg/s of wheel speed against each degree of heading drift
+    int drift = (int16_t)(odometry.getHeading() - heading) / 91;
+    setWheelSpeed(direction * speed + drift, direction * speed - drift);
+
+    if (pause(10) == ZOWI_CANCELLED) {
+      stop(0, false);
+      ZOWI_TRACE(TRACE_MOTION_STOP, 1);
+      return ZOWI_CANCELLED;
+    }
+  }
+
+  return stop(100);
+}
+
+//---------------------------------------------------------
+//-- Zowi rotateBy: turns on the spot until the odometry
+//-- heading has changed by degrees (any number of turns)
+//---------------------------------------------------------
+int Zowi::rotateBy(int degrees) {
+
+  use(ZOWI_START_ENCODERS);
+  int direction = (degrees < 0) ? -1 : 1;
+  long target = (long)degrees * 65536L / 360;
+  long turned = 0;
+  uint16_t last = odometry.getHeading();
+  long arc = (long)ZOWI_WHEEL_TRACK * abs(degrees) / ZOWI_WHEEL_DIAMETER;   //Wheel degrees
+  unsigned long timeout = 1000 + 2000 * arc / scaleSpeed(ZOWI_WHEEL_SPEED / 2);
+
+  final_time = millis() + timeout;
+  ZOWI_TRACE(TRACE_MOTION_START, timeout);
+
+  while (isMoving()) {
+    uint16_t heading = odometry.getHeading();
+    turned += (int16_t)(heading - last);
+    last = heading;
+
+    long remaining = (target - turned) * direction;
+    if (remaining <= 0) break;
+
+    int speed = constrain((remaining * 360 >> 16) * 4, ZOWI_WHEEL_SPEED_MIN, ZOWI_WHEEL_SPEED / 2);
+    setWheelSpeed(-direction * speed, direction * speed);
+
+    if (pause(10) == ZOWI_CANCELLED) {
+      stop(0, false);
+      ZOWI_TRACE(TRACE_MOTION_STOP, 1);
+      return ZOWI_CANCELLED;
+    }
+  }
+
+  return stop(100);
+}
+
+void Zowi::getPose(OdometryPose &pose) {
+
+  use(ZOWI_START_ENCODERS);
+  odometry.getPose(pose);
+}
+
+void Zowi::resetPose() {
+
+  use(ZOWI_START_ENCODERS);
+  odometry.reset();
+}
+
+#else
+//---------------------------------------------------------
+//-- Without encoders: the same moves, timed from the wheel
+//-- geometry at the nominal speed
+//---------------------------------------------------------
+int Zowi::driveDistance(int mm) {
+
+  int direction = (mm < 0) ? -1 : 1;
+  long degrees = (long)abs(mm) * 36000L / (314L * ZOWI_WHEEL_DIAMETER);   //Wheel degrees
+  int speed = ZOWI_WHEEL_SPEED;
+
+  if (_moveWheels(degrees * 1000 / scaleSpeed(speed), direction * speed, direction * speed) == ZOWI_CANCELLED) {
+    stop(0, false);
+    return ZOWI_CANCELLED;
+  }
+  return stop(100);
+}
+
+int Zowi::rotateBy(int degrees) {
+
+  int direction = (degrees < 0) ? -1 : 1;
+  long arc = (long)ZOWI_WHEEL_TRACK * abs(degrees) / ZOWI_WHEEL_DIAMETER;   //Wheel degrees
+  int speed = ZOWI_WHEEL_SPEED / 2;
+
+  if (_moveWheels(arc * 1000 / scaleSpeed(speed), -direction * speed, direction * speed) == ZOWI_CANCELLED) {
+    stop(0, false);
+    return ZOWI_CANCELLED;
+  }
+  return stop(100);
+}
+
+void Zowi::getPose(OdometryPose &pose) {
+
+  memset(&pose, 0, sizeof(pose));
+}
+
+void Zowi::resetPose() {
+}
+#endif
+
+bool Zowi::isMoving(){
+
+  return (long)(final_time - millis()) >= 0;
 }
 
 
@@ -118,10 +391,13 @@ void Zowi::home(){
   if(isZowiResting==false){ //Go to rest position only if necessary
 
     int homes[2]={90, 90}; //All the servos at rest position
-    _moveServos(500,homes);   //Move the servos in half a second
 
-    detachServos();
-    isZowiResting=true;
+    //Move the servos in half a second. If cancelled, keep them attached
+    //so they still reach the rest position
+    if(_moveServos(500,homes)==ZOWI_DONE){
+      detachServos();
+      isZowiResting=true;
+    }
   }
 }
 
@@ -144,70 +420,83 @@ void Zowi::setRestState(bool state){
 //-- Zowi movement: left
 //--  Parameters:
 //--    T: Period
+//--    wait: false to return without waiting for T
 //---------------------------------------------------------
-void Zowi::left(int T) {
+int Zowi::left(int T, bool wait) {
+  if (speedControl) return _moveWheels(T, ZOWI_WHEEL_SPEED*5/6, ZOWI_WHEEL_SPEED, wait);
   int left[]={100, 83};
-  _moveServos(T, left);
+  return _moveServos(T, left, wait);
 }
 
 //---------------------------------------------------------
 //-- Zowi movement: right
 //--  Parameters:
 //--    T: Period
+//--    wait: false to return without waiting for T
 //---------------------------------------------------------
-void Zowi::right(int T) {
+int Zowi::right(int T, bool wait) {
+  if (speedControl) return _moveWheels(T, ZOWI_WHEEL_SPEED, ZOWI_WHEEL_SPEED*5/6, wait);
   int right[]={102, 85};
-  _moveServos(T, right);
+  return _moveServos(T, right, wait);
 }
 
 //---------------------------------------------------------
 //-- Zowi movement: forward
 //--  Parameters:
 //--    T: Period
+//--    wait: false to return without waiting for T
 //---------------------------------------------------------
-void Zowi::forward(int T) {
+int Zowi::forward(int T, bool wait) {
+  if (speedControl) return _moveWheels(T, ZOWI_WHEEL_SPEED, ZOWI_WHEEL_SPEED, wait);
   int forward[]={102, 83};
-  _moveServos(T, forward);
+  return _moveServos(T, forward, wait);
 }
 
 //---------------------------------------------------------
 //-- Zowi movement: back
 //--  Parameters:
 //--    T: Period
+//--    wait: false to return without waiting for T
 //---------------------------------------------------------
-void Zowi::back(int T) {
+int Zowi::back(int T, bool wait) {
+  if (speedControl) return _moveWheels(T, -ZOWI_WHEEL_SPEED, -ZOWI_WHEEL_SPEED, wait);
   int back[]={83, 100};
-  _moveServos(T, back);
+  return _moveServos(T, back, wait);
 }
 
 //---------------------------------------------------------
 //-- Zowi movement: stop
 //--  Parameters:
 //--    T: Period
+//--    wait: false to return without waiting for T
 //---------------------------------------------------------
-void Zowi::stop(int T) {
+int Zowi::stop(int T, bool wait) {
   int stop[]={90, 90};
-  _moveServos(T, stop);
+  return _moveServos(T, stop, wait);
 }
 
 //---------------------------------------------------------
 //-- Zowi movement: left_order
 //--  Parameters:
 //--    T: Period
+//--    wait: false to return without waiting for T
 //---------------------------------------------------------
-void Zowi::left_order(int T) {
+int Zowi::left_order(int T, bool wait) {
+  if (speedControl) return _moveWheels(T, -ZOWI_WHEEL_SPEED/2, ZOWI_WHEEL_SPEED/2, wait);
   int left_order[]={85, 85};
-  _moveServos(T, left_order);
+  return _moveServos(T, left_order, wait);
 }
 
 //---------------------------------------------------------
 //-- Zowi movement: right_order
 //--  Parameters:
 //--    T: Period
+//--    wait: false to return without waiting for T
 //---------------------------------------------------------
-void Zowi::right_order(int T) {
+int Zowi::right_order(int T, bool wait) {
+  if (speedControl) return _moveWheels(T, ZOWI_WHEEL_SPEED/2, -ZOWI_WHEEL_SPEED/2, wait);
   int right_order[]={100, 100};
-  _moveServos(T, right_order);
+  return _moveServos(T, right_order, wait);
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -217,9 +506,19 @@ void Zowi::right_order(int T) {
 //---------------------------------------------------------
 //-- Zowi getDistance: return zowi's ultrasonic sensor measure
 //---------------------------------------------------------
+int Zowi::getDistanceCm(){
+
+#if ZOWI_USE_US
+  use(ZOWI_START_US);
+  return us.readCm();
+#else
+  return 999;
+#endif
+}
+
 float Zowi::getDistance(){
 
-  return us.read();
+  return getDistanceCm();
 }
 
 
@@ -232,10 +531,10 @@ int Zowi::getNoise(){
   int noiseReadings = 0;
   int numReadings = 2;  
 
-    noiseLevel = analogRead(pinNoiseSensor);
+    noiseLevel = readAnalog(pinNoiseSensor);
 
     for(int i=0; i<numReadings; i++){
-        noiseReadings += analogRead(pinNoiseSensor);
+        noiseReadings += readAnalog(pinNoiseSensor);
         delay(4); // delay in between reads for stability
     }
 
@@ -244,26 +543,47 @@ int Zowi::getNoise(){
     return noiseLevel;
 }
 
+//---------------------------------------------------------
+//-- Zowi readAnalog: while the battery or the encoders are
+//-- sampled in the background the ADC is shared through
+//-- AnalogSampler; otherwise it is free
+//---------------------------------------------------------
+int Zowi::readAnalog(uint8_t pin){
+
+#if ZOWI_USE_SAMPLER
+  return AnalogSampler::analogRead(pin);
+#else
+  return analogRead(pin);
+#endif
+}
+
 //---------------------------------------------------------
 //-- Zowi getIR: return zowi's IR sensor val
 //---------------------------------------------------------
 uint8_t Zowi::getIR(int side) {
+#if ZOWI_USE_IR
+    use(ZOWI_START_IR);
     if (side == LEFT) {
         return ir_left.read();
     } else {
         return ir_right.read();
     }
+#else
+    return HIGH;
+#endif
 }
 
 //---------------------------------------------------------
 //-- Zowi getRGB: return zowi's RGB sensor val
 //---------------------------------------------------------
 int Zowi::getRGB(int *RGBValues) {
+#if ZOWI_USE_RGB
     rgb_detector.attach();
     if (rgb_detector.read(RGBValues)) {
         rgb_detector.detach();
         return true;
     }
+#endif
 
     return false;
 }
@@ -272,80 +592,208 @@ int Zowi::getRGB(int *RGBValues) {
 //-- Zowi getEncLap: return zowi's Encoder Lap val
 //---------------------------------------------------------
 int Zowi::getEncLap(int side) {
+#if ZOWI_USE_ENCODERS
+    use(ZOWI_START_ENCODERS);
     if (side == LEFT) {
         return left_encoder.getLap();
     } else {
         return right_encoder.getLap();
     }
+#else
+    return 0;
+#endif
 }
 
 //---------------------------------------------------------
 //-- Zowi getEncRead: return zowi's Encoder val
 //---------------------------------------------------------
 int Zowi::getEncVal(int side) {
+#if ZOWI_USE_ENCODERS
+    use(ZOWI_START_ENCODERS);
     if (side == LEFT) {
         return left_encoder.read();
     } else {
         return right_encoder.read();
     }
+#else
+    return 0;
+#endif
+}
+
+//---------------------------------------------------------
+//-- Zowi getEncState: angle, position and velocity of a wheel
+//---------------------------------------------------------
+void Zowi::getEncState(int side, ServoEncoderState &state) {
+#if ZOWI_USE_ENCODERS
+    use(ZOWI_START_ENCODERS);
+    if (side == LEFT) {
+        left_encoder.snapshot(state);
+    } else {
+        right_encoder.snapshot(state);
+    }
+#else
+    memset(&state, 0, sizeof(state));
+#endif
 }
 
 //---------------------------------------------------------
 //-- Zowi getBatteryLevel: return battery voltage percent
+//-- (the filtered level: no conversion, no waiting)
 //---------------------------------------------------------
+#if ZOWI_USE_BATTERY
 double Zowi::getBatteryLevel(){
 
-  //The first read of the batery is often a wrong reading, so we will discard this value. 
-    double batteryLevel = battery.readBatPercent();
-    double batteryReadings = 0;
-    int numReadings = 10;
+    use(ZOWI_START_BATTERY);
+    return battery.readBatPercent();
+}
 
-    for(int i=0; i<numReadings; i++){
-        batteryReadings += battery.readBatPercent();
-        delay(1); // delay in between reads for stability
-    }
 
-    batteryLevel = batteryReadings / numReadings;
+double Zowi::getBatteryVoltage(){
+
+    use(ZOWI_START_BATTERY);
+    return battery.readBatVoltage();
+}
+
+unsigned int Zowi::getBatteryPercent(){
+
+    use(ZOWI_START_BATTERY);
+    return battery.getPercent();
+}
+
+uint8_t Zowi::getBatteryState(){
+
+    use(ZOWI_START_BATTERY);
+    return battery.getLevel();
+}
+
+bool Zowi::batteryChanged(uint8_t &state){
+
+    use(ZOWI_START_BATTERY);
+    return battery.levelChanged(state);
+}
+
+void Zowi::setBatteryThresholds(uint8_t low, uint8_t critical){
+
+    battery.setThresholds(low, critical);
+}
 
-    return batteryLevel;
+void Zowi::setLoad(uint8_t servos){
+
+    battery.setLoad(servos);
 }
+#else
+//-- Without the battery monitor: always full
+double Zowi::getBatteryLevel(){
 
+    return 100;
+}
 
 double Zowi::getBatteryVoltage(){
 
-  //The first read of the batery is often a wrong reading, so we will discard this value. 
-    double batteryLevel = battery.readBatVoltage();
-    double batteryReadings = 0;
-    int numReadings = 10;
+    return 4.2;
+}
 
-    for(int i=0; i<numReadings; i++){
-        batteryReadings += battery.readBatVoltage();
-        delay(1); // delay in between reads for stability
+unsigned int Zowi::getBatteryPercent(){
+
+    return 10000;
+}
+
+uint8_t Zowi::getBatteryState(){
+
+    return 0;
+}
+
+bool Zowi::batteryChanged(uint8_t &state){
+
+    state = 0;
+    return false;
+}
+
+void Zowi::setBatteryThresholds(uint8_t low, uint8_t critical){
+}
+
+void Zowi::setLoad(uint8_t servos){
+}
+#endif
+
+
+///////////////////////////////////////////////////////////////////
+//-- GOVERNOR ---------------------------------------------------//
+///////////////////////////////////////////////////////////////////
+#if ZOWI_USE_BATTERY
+void Zowi::setLimits(uint8_t state, const ZowiLimits &limits){
+
+    governor.setLimits(state, limits);
+}
+
+const ZowiLimits &Zowi::getLimits(){
+
+    applyLimits();
+    return governor.getLimits();
+}
+
+bool Zowi::isLimited(){
+
+    applyLimits();
+    return governor.isLimited();
+}
+
+//---------------------------------------------------------
+//-- Zowi applyLimits: follows the battery state. Speed and
+//-- sound are scaled where they are used; the LED duty and
+//-- the wheel ramps are set here when the state changes
+//---------------------------------------------------------
+void Zowi::applyLimits(){
+
+    if (!governor.update(getBatteryState())) return;
+
+    const ZowiLimits &limits = governor.getLimits();
+#if ZOWI_USE_MOUTH
+    ledmatrix.setDuty(limits.leds);
+#endif
+#if ZOWI_USE_ENCODERS
+    if (started & ZOWI_START_ENCODERS) {   //Otherwise start() sets them
+      wheel[0].setRamp(limits.ramp);
+      wheel[1].setRamp(limits.ramp);
     }
+#endif
+}
+
+#else
+//---------------------------------------------------------
+//-- Without the battery monitor: always the full limits
+//---------------------------------------------------------
+void Zowi::setLimits(uint8_t state, const ZowiLimits &limits){
+}
+
+const ZowiLimits &Zowi::getLimits(){
+
+    static const ZowiLimits full = {100, 0, 100, 100};
+    return full;
+}
 
-    batteryLevel = batteryReadings / numReadings;
+bool Zowi::isLimited(){
 
-    return batteryLevel;
+    return false;
 }
 
+void Zowi::applyLimits(){
+}
+#endif
+
 
 ///////////////////////////////////////////////////////////////////
 //-- MOUTHS & ANIMATIONS ----------------------------------------//
 ///////////////////////////////////////////////////////////////////
 
-unsigned long int Zowi::getMouthShape(int number){
-  unsigned long int types []={zero_code,one_code,two_code,three_code,four_code,five_code,six_code,seven_code,eight_code,
+//-- Mouth and animation tables live in flash: as local arrays they
+//-- took up to 124 bytes of stack on every call
+static const uint32_t mouthShapes[] PROGMEM = {zero_code,one_code,two_code,three_code,four_code,five_code,six_code,seven_code,eight_code,
   nine_code,smile_code,happyOpen_code,happyClosed_code,heart_code,bigSurprise_code,smallSurprise_code,tongueOut_code,
   vamp1_code,vamp2_code,lineMouth_code,confused_code,diagonal_code,sad_code,sadOpen_code,sadClosed_code,
   okMouth_code, xMouth_code,interrogation_code,thunder_code,culito_code,angry_code};
 
-  return types[number];
-}
-
-
-unsigned long int Zowi::getAnimShape(int anim, int index){
-
-  unsigned long int littleUuh_code[]={
+static const uint32_t littleUuh_code[] PROGMEM = {
      0b00000000000000001100001100000000,
      0b00000000000000000110000110000000,
      0b00000000000000000011000011000000,
@@ -354,25 +802,25 @@ unsigned long int Zowi::getAnimShape(int anim, int index){
      0b00000000000000011000011000000000,
      0b00000000000000110000110000000000,
      0b00000000000000011000011000000000  
-  };
+};
 
-  unsigned long int dreamMouth_code[]={
+static const uint32_t dreamMouth_code[] PROGMEM = {
      0b00000000000000000000110000110000,
      0b00000000000000010000101000010000,  
      0b00000000011000100100100100011000,
      0b00000000000000010000101000010000           
-  };
+};
 
-  unsigned long int adivinawi_code[]={
+static const uint32_t adivinawi_code[] PROGMEM = {
      0b00100001000000000000000000100001,
      0b00010010100001000000100001010010,
      0b00001100010010100001010010001100,
      0b00000000001100010010001100000000,
      0b00000000000000001100000000000000,
      0b00000000000000000000000000000000
-  };
+};
 
-  unsigned long int wave_code[]={
+static const uint32_t wave_code[] PROGMEM = {
      0b00001100010010100001000000000000,
      0b00000110001001010000100000000000,
      0b00000011000100001000010000100000,
@@ -383,46 +831,66 @@ unsigned long int Zowi::getAnimShape(int anim, int index){
      0b00100000010000001000000100000011,
      0b00110000001000000100000010000001,
      0b00011000100100000010000001000000    
-  };
+};
+
+//-- A number past the table (e.g. from a rule in the EEPROM) gives no mouth
+unsigned long int Zowi::getMouthShape(int number){
+
+  if (number < 0 || number >= MOUTH_SHAPES) return 0;
+  return pgm_read_dword(&mouthShapes[number]);
+}
+
+
+unsigned long int Zowi::getAnimShape(int anim, int index){
 
   switch  (anim){
 
     case littleUuh:
-        return littleUuh_code[index];
+        return pgm_read_dword(&littleUuh_code[index]);
         break;
     case dreamMouth:
-        return dreamMouth_code[index];
+        return pgm_read_dword(&dreamMouth_code[index]);
         break;
     case adivinawi:
-        return adivinawi_code[index];
+        return pgm_read_dword(&adivinawi_code[index]);
         break;
     case wave:
-        return wave_code[index];
+        return pgm_read_dword(&wave_code[index]);
         break;    
   }   
+
+  return 0;
 }
 
 
 void Zowi::putAnimationMouth(unsigned long int aniMouth, int index){
 
+#if ZOWI_USE_MOUTH
+      applyLimits();
       ledmatrix.writeFull(getAnimShape(aniMouth,index));
+#endif
 }
 
 
 void Zowi::putMouth(unsigned long int mouth, bool predefined){
 
+#if ZOWI_USE_MOUTH
+  applyLimits();
   if (predefined){
     ledmatrix.writeFull(getMouthShape(mouth));
   }
   else{
     ledmatrix.writeFull(mouth);
   }
+#endif
 }
 
 
 void Zowi::clearMouth(){
 
+#if ZOWI_USE_MOUTH
   ledmatrix.clearMatrix();
+#endif
 }
 
 
@@ -430,44 +898,58 @@ void Zowi::clearMouth(){
 //-- SOUNDS -----------------------------------------------------//
 ///////////////////////////////////////////////////////////////////
 
-void Zowi::_tone (float noteFrequency, long noteDuration, int silentDuration){
+int Zowi::_tone (unsigned int noteFrequency, long noteDuration, int silentDuration){
 
     // tone(10,261,500);
     // delay(500);
 
       if(silentDuration==0){silentDuration=1;}
+      if(isCancelled()){return ZOWI_CANCELLED;}
+
+      //Within the battery limits only part of the note sounds
+      applyLimits();
+      long soundDuration = scaleSound(noteDuration);
+      if(soundDuration>0){tone(Zowi::pinBuzzer, noteFrequency, soundDuration);}
 
-      tone(Zowi::pinBuzzer, noteFrequency, noteDuration);
-      delay(noteDuration);       //milliseconds to microseconds
-      //noTone(PIN_Buzzer);
-      delay(silentDuration);     
+      if(pause(noteDuration)==ZOWI_CANCELLED){
+        noTone(Zowi::pinBuzzer);
+        return ZOWI_CANCELLED;
+      }
+      return pause(silentDuration);
 }
 
 
-void Zowi::bendTones (float initFrequency, float finalFrequency, float prop, long noteDuration, int silentDuration){
+int Zowi::bendTonesQ12 (unsigned int initFrequency, unsigned int finalFrequency, uint16_t prop, long noteDuration, int silentDuration){
 
   //Examples:
   //  bendTones (880, 2093, 1.02, 18, 1);
-  //  bendTones (note_A5, note_C7, 1.02, 18, 0);
+  //  bendTonesQ12 (note_A5, note_C7, FIX(1.02, 12), 18, 0);
 
   if(silentDuration==0){silentDuration=1;}
 
+  //Every step moves at least 1 Hz, so a small ratio cannot stall
   if(initFrequency < finalFrequency)
   {
-      for (int i=initFrequency; i<finalFrequency; i=i*prop) {
-          _tone(i, noteDuration, silentDuration);
+      for (unsigned int i=initFrequency; i<finalFrequency; ) {
+          if(_tone(i, noteDuration, silentDuration)==ZOWI_CANCELLED){return ZOWI_CANCELLED;}
+          unsigned int next = ((uint32_t)i * prop) >> 12;
+          i = (next > i) ? next : i + 1;
       }
 
   } else{
 
-      for (int i=initFrequency; i>finalFrequency; i=i/prop) {
-          _tone(i, noteDuration, silentDuration);
+      for (unsigned int i=initFrequency; i>finalFrequency; ) {
+          if(_tone(i, noteDuration, silentDuration)==ZOWI_CANCELLED){return ZOWI_CANCELLED;}
+          unsigned int next = ((uint32_t)i << 12) / prop;
+          i = (next < i) ? next : i - 1;
       }
   }
+
+  return ZOWI_DONE;
 }
 
 
-void Zowi::sing(int songName){
+int Zowi::sing(int songName){
   switch(songName){
 
     case S_connection:
@@ -484,7 +966,7 @@ void Zowi::sing(int songName){
 
     case S_buttonPushed:
       bendTones (note_E6, note_G6, 1.03, 20, 2);
-      delay(30);
+      pause(30);
       bendTones (note_E6, note_D7, 1.04, 10, 2);
     break;
 
@@ -509,18 +991,18 @@ void Zowi::sing(int songName){
 
     case S_OhOoh:
       bendTones(880, 2000, 1.04, 8, 3); //A5 = 880
-      delay(200);
+      pause(200);
 
-      for (int i=880; i<2000; i=i*1.04) {
+      for (int i=880; i<2000; i=((long)i*FIX(1.04,12))>>12) {
            _tone(note_B5,5,10);
       }
     break;
 
     case S_OhOoh2:
       bendTones(1880, 3000, 1.03, 8, 3);
-      delay(200);
+      pause(200);
 
-      for (int i=1880; i<3000; i=i*1.03) {
+      for (int i=1880; i<3000; i=((long)i*FIX(1.03,12))>>12) {
           _tone(note_C6,10,10);
       }
     break;
@@ -532,7 +1014,7 @@ void Zowi::sing(int songName){
 
     case S_sleeping:
       bendTones(100, 500, 1.04, 10, 10);
-      delay(500);
+      pause(500);
       bendTones(400, 100, 1.04, 10, 1);
     break;
 
@@ -543,13 +1025,13 @@ void Zowi::sing(int songName){
 
     case S_superHappy:
       bendTones(2000, 6000, 1.05, 8, 3);
-      delay(50);
+      pause(50);
       bendTones(5999, 2000, 1.05, 13, 2);
     break;
 
     case S_happy_short:
       bendTones(1500, 2000, 1.05, 15, 8);
-      delay(100);
+      pause(100);
       bendTones(1900, 2500, 1.05, 10, 8);
     break;
 
@@ -577,6 +1059,8 @@ void Zowi::sing(int songName){
     break;
 
   }
+
+  return isCancelled() ? ZOWI_CANCELLED : ZOWI_DONE;
 }
 
 
@@ -585,7 +1069,7 @@ void Zowi::sing(int songName){
 //-- GESTURES ---------------------------------------------------//
 ///////////////////////////////////////////////////////////////////
 
-void Zowi::playGesture(int gesture){
+int Zowi::playGesture(int gesture){
 
   int sadPos[4]=      {110, 70, 20, 160};
   int bedPos[4]=      {100, 80, 60, 120};
@@ -640,10 +1124,10 @@ void Zowi::playGesture(int gesture){
         putMouth(sadOpen);
         bendTones(700, 669, 1.02, 20, 200);
         putMouth(sad);
-        delay(500);
+        pause(500);
 
         home();
-        delay(300);
+        pause(300);
         putMouth(happyOpen);
     break;
 
@@ -651,18 +1135,19 @@ void Zowi::playGesture(int gesture){
     case ZowiSleeping:
 
         for(int i=0; i<4;i++){
+          if(isCancelled()){break;}
           putAnimationMouth(dreamMouth,0);
           bendTones (100, 200, 1.04, 10, 10);
           putAnimationMouth(dreamMouth,1);
           bendTones (200, 300, 1.04, 10, 10);  
           putAnimationMouth(dreamMouth,2);
           bendTones (300, 500, 1.04, 10, 10);   
-          delay(500);
+          pause(500);
           putAnimationMouth(dreamMouth,1);
           bendTones (400, 250, 1.04, 10, 1); 
           putAnimationMouth(dreamMouth,0);
           bendTones (250, 100, 1.04, 10, 1); 
-          delay(500);
+          pause(500);
         } 
 
         putMouth(lineMouth);
@@ -674,24 +1159,24 @@ void Zowi::playGesture(int gesture){
 
 
     case ZowiFart:
-        delay(300);     
+        pause(300);     
         putMouth(lineMouth);
         sing(S_fart1);  
         putMouth(tongueOut);
-        delay(250);
-        delay(300);
+        pause(250);
+        pause(300);
         putMouth(lineMouth);
         sing(S_fart2); 
         putMouth(tongueOut);
-        delay(250);
-        delay(300);
+        pause(250);
+        pause(300);
         putMouth(lineMouth);
         sing(S_fart3);
         putMouth(tongueOut);    
-        delay(300);
+        pause(300);
 
         home(); 
-        delay(500); 
+        pause(500); 
         putMouth(happyOpen);
     break;
 
@@ -699,7 +1184,7 @@ void Zowi::playGesture(int gesture){
     case ZowiConfused:
         putMouth(confused);
         sing(S_confused);
-        delay(500);
+        pause(500);
 
         home();  
         putMouth(happyOpen);
@@ -723,9 +1208,9 @@ void Zowi::playGesture(int gesture){
         bendTones(note_A5, note_D6, 1.02, 7, 4);
         bendTones(note_D6, note_G6, 1.02, 10, 1);
         bendTones(note_G6, note_A5, 1.02, 10, 1);
-        delay(15);
+        pause(15);
         bendTones(note_A5, note_E5, 1.02, 20, 4);
-        delay(400);
+        pause(400);
         bendTones(note_A5, note_D6, 1.02, 20, 4);
         bendTones(note_A5, note_E5, 1.02, 20, 4);
 
@@ -738,7 +1223,7 @@ void Zowi::playGesture(int gesture){
         putMouth(angry);
         bendTones(note_A5, note_D6, 1.02, 20, 4);
         bendTones(note_A5, note_E5, 1.02, 20, 4);
-        delay(300);
+        pause(300);
         putMouth(lineMouth);
 
         for(int i=0; i<4; i++){
@@ -746,7 +1231,7 @@ void Zowi::playGesture(int gesture){
         }
 
         putMouth(angry);
-        delay(500);
+        pause(500);
 
         home();  
         putMouth(happyOpen);
@@ -760,6 +1245,7 @@ void Zowi::playGesture(int gesture){
         
         // Reproduce the animation four times
         for(int i = 0; i<4; i++){ 
+          if(isCancelled()){break;}
 
           int noteM = 400; 
 
@@ -779,7 +1265,7 @@ void Zowi::playGesture(int gesture){
             }
         } 
  
-        delay(300);
+        pause(300);
         putMouth(happyOpen);
     break;
 
@@ -788,6 +1274,7 @@ void Zowi::playGesture(int gesture){
         
         // Reproduce the animation four times
         for(int i = 0; i<2; i++){ 
+            if(isCancelled()){break;}
 
             int noteW = 500; 
 
@@ -814,7 +1301,7 @@ void Zowi::playGesture(int gesture){
         }    
 
         clearMouth();
-        delay(100);
+        pause(100);
         putMouth(happyOpen);
     break;
 
@@ -860,7 +1347,7 @@ void Zowi::playGesture(int gesture){
         detachServos();
         _tone(150,2200,1);
         
-        delay(600);
+        pause(600);
         clearMouth();
         putMouth(happyOpen);
         home();
@@ -868,4 +1355,51 @@ void Zowi::playGesture(int gesture){
     break;
 
   }
+
+  return isCancelled() ? ZOWI_CANCELLED : ZOWI_DONE;
 }    
+
+
+///////////////////////////////////////////////////////////////////
+//-- CANCELLATION -----------------------------------------------//
+///////////////////////////////////////////////////////////////////
+
+//---------------------------------------------------------
+//-- Cancel source for the blocking functions (_moveServos, _tone,
+//-- bendTones, sing, playGesture, pause). While the flag is true
+//-- (or the callback returns true) they stop waiting and return
+//-- ZOWI_CANCELLED. The flag is usually set from an interrupt
+//-- (e.g. a button press) and cleared by the sketch.
+//---------------------------------------------------------
+void Zowi::setCancelSource(volatile bool *flag){
+
+  cancelFlag = flag;
+  cancelCallback = NULL;
+}
+
+void Zowi::setCancelSource(bool (*callback)()){
+
+  cancelCallback = callback;
+  cancelFlag = NULL;
+}
+
+bool Zowi::isCancelled(){
+
+  if(cancelFlag){return *cancelFlag;}
+  if(cancelCallback){return cancelCallback();}
+  return false;
+}
+
+//---------------------------------------------------------
+//-- Zowi pause: a delay() that can be cancelled
+//---------------------------------------------------------
+int Zowi::pause(unsigned long time){
+
+  unsigned long start = millis();
+
+  while(millis() - start < time){
+    if(isCancelled()){return ZOWI_CANCELLED;}
+  }
+
+  return isCancelled() ? ZOWI_CANCELLED : ZOWI_DONE;
+}
@@ -5,12 +5,69 @@
 #include <Oscillator.h>
 #include <EEPROM.h>
 
-#include <US.h>
-#include <LedMatrix.h>
-#include <BatReader.h>
-#include <IR.h>
-#include <TCS3200.h>
-#include <ServoEncoder.h>
+#include "Zowi_config.h"
+
+#if ZOWI_USE_US
+  #include <US.h>
+#endif
+#if ZOWI_USE_MOUTH
+  #include <LedMatrix.h>
+#endif
+#if ZOWI_USE_BATTERY
+  #include <BatReader.h>
+#else
+  //-- The battery levels of the API, as BatReader.h defines them,
+  //-- without its library (and the ADC interrupt it brings)
+  class BatReader {
+    public:
+      enum { BAT_OK, BAT_LOW, BAT_CRITICAL };
+  };
+#endif
+#if ZOWI_USE_IR
+  #include <IR.h>
+#endif
+#if ZOWI_USE_RGB
+  #include <TCS3200.h>
+#endif
+#if ZOWI_USE_ENCODERS
+  #include <ServoEncoder.h>
+  #include <Odometry.h>
+  #include <SpeedController.h>
+#else
+  //-- Types of the API, as ServoEncoder.h and Odometry.h define
+  //-- them, without their libraries
+  struct ServoEncoderState {
+    int lap;
+    int angle;
+    long position;
+    int velocity;
+    uint16_t value;
+  };
+  struct OdometryPose {
+    long x;
+    long y;
+    int heading;
+    long distance;
+  };
+#endif
+#if ZOWI_USE_SAMPLER
+  #include <AnalogSampler.h>
+#endif
+#if ZOWI_USE_BATTERY
+  #include <ZowiGovernor.h>
+#else
+  //-- As ZowiGovernor.h defines it: the limits are always full
+  struct ZowiLimits {
+    uint8_t speed;
+    uint8_t ramp;
+    uint8_t leds;
+    uint8_t sound;
+  };
+#endif
+#if ZOWI_USE_TRACE
+  #include <ZowiTrace.h>
+#endif
+#include <FixedPoint.h>
 
 #include "Zowi_mouths.h"
 #include "Zowi_sounds.h"
@@ -26,6 +83,10 @@
 #define MEDIUM      15
 #define BIG         30
 
+//-- Status returned by the blocking functions
+#define ZOWI_DONE       0
+#define ZOWI_CANCELLED  1
+
 #define PIN_Buzzer  10
 #define PIN_Trigger 8
 #define PIN_Echo    9
@@ -37,23 +98,46 @@
 #define SERVO_ENC_LEFT_PIN    A4
 #define SERVO_ENC_RIGHT_PIN   A5
 
+#define ZOWI_WHEEL_SPEED      180   //-- Wheel deg/s of the moves with speed control
+#define ZOWI_WHEEL_SPEED_MIN  45    //-- Slowest wheel speed while closing on a target
+#define ZOWI_OPEN_LOOP_GAIN   15    //-- Wheel deg/s per servo degree away from 90 (no encoders)
+
+//-- Sensors that start on their first use (see Zowi::start)
+#define ZOWI_START_US         0x01
+#define ZOWI_START_IR         0x02
+#define ZOWI_START_ENCODERS   0x04
+#define ZOWI_START_BATTERY    0x08
+#define ZOWI_START_ALL        0x0F
+
+//-- Wheel geometry for the odometry (mm), measure them on the robot
+#define ZOWI_WHEEL_DIAMETER   65
+#define ZOWI_WHEEL_TRACK      95
+
 class Zowi
 {
   public:
 
-    //-- Zowi initialization
+    //-- Zowi initialization (load_calibration: trims from ZowiSettings)
     void init(int RL, int RR, bool load_calibration=true, int NoiseSensor=PIN_NoiseSensor, int Buzzer=PIN_Buzzer, int USTrigger=PIN_Trigger, int USEcho=PIN_Echo, int IRLeft=IR_LEFT_PIN, int IRRight=IR_RIGHT_PIN, int LeftEncoder=SERVO_ENC_LEFT_PIN, int RightEncoder=SERVO_ENC_RIGHT_PIN);
 
+    //-- The sensors start on their first use, so init() returns at
+    //-- once. start() sets them up now (e.g. to time the boot).
+    //-- Functions that use a sensor (putMouth() too, through the
+    //-- battery limits) must not be called from an interrupt handler
+    void start(uint8_t sensors=ZOWI_START_ALL);
+    uint8_t getStarted();
+
     //-- Attach & detach functions
     void attachServos();
     void detachServos();
 
     //-- Oscillator Trims
     void setTrims(int YL, int YR, int RL, int RR);
-    void saveTrimsOnEEPROM();
+    void saveTrimsOnEEPROM();           //-- Into the ZowiSettings record
 
     //-- Predetermined Motion Functions
-    void _moveServos(int time, int  servo_target[]);
+    int _moveServos(int time, int  servo_target[], bool wait=true);
+    bool isMoving();
     void oscillateServos(int A[4], int O[4], int T, double phase_diff[4], float cycle);
 
     //-- HOME = Zowi at rest position
@@ -62,26 +146,49 @@ class Zowi
     void setRestState(bool state);
     
     //-- Predetermined Motion Functions
-    void left(int T = 1000);
-    void right(int T = 1000);
-    void back(int T = 1000);
-    void forward(int T = 1000);
-    void stop(int T = 1000);
+    int left(int T = 1000, bool wait = true);
+    int right(int T = 1000, bool wait = true);
+    int back(int T = 1000, bool wait = true);
+    int forward(int T = 1000, bool wait = true);
+    int stop(int T = 1000, bool wait = true);
+
+    int left_order(int T = 1000, bool wait = true);
+    int right_order(int T = 1000, bool wait = true);
 
-    void left_order(int T = 1000);
-    void right_order(int T = 1000);
+    //-- Closed-loop wheel speed (deg/s, positive forward). With
+    //-- setSpeedControl(true) the moves above use it too
+    void setWheelSpeed(int left, int right);
+    void setSpeedControl(bool enabled);
+    int _moveWheels(int time, int left, int right, bool wait=true);
+
+    //-- Odometry: moves measured by the wheel encoders
+    int driveDistance(int mm);      //-- Straight, negative backwards
+    int rotateBy(int degrees);      //-- On the spot, positive to the left
+    void getPose(OdometryPose &pose);
+    void resetPose();
 
     //-- Sensors functions
-    float getDistance(); //US sensor
+    int getDistanceCm(); //US sensor
+    float getDistance(); //The same, as a float
     int getNoise();      //Noise Sensor
     uint8_t getIR(int side);
     int getRGB(int *RGBValues);
     int getEncLap(int side);
     int getEncVal(int side);
+    void getEncState(int side, ServoEncoderState &state);
 
     //-- Battery
     double getBatteryLevel();
     double getBatteryVoltage();
+    unsigned int getBatteryPercent();     //-- 1/100 %
+    uint8_t getBatteryState();            //-- BatReader::BAT_OK, BAT_LOW, BAT_CRITICAL
+    bool batteryChanged(uint8_t &state);  //-- true once per state change
+    void setBatteryThresholds(uint8_t low, uint8_t critical);   //-- %
+
+    //-- Governor: limits by battery state (see ZowiGovernor)
+    void setLimits(uint8_t state, const ZowiLimits &limits);
+    const ZowiLimits &getLimits();        //-- The ones in force
+    bool isLimited();
     
     //-- Mouth & Animations
     void putMouth(unsigned long int mouth, bool predefined = true);
@@ -89,25 +196,64 @@ class Zowi
     void clearMouth();
 
     //-- Sounds
-    void _tone (float noteFrequency, long noteDuration, int silentDuration);
-    void bendTones (float initFrequency, float finalFrequency, float prop, long noteDuration, int silentDuration);
-    void sing(int songName);
+    int _tone (unsigned int noteFrequency, long noteDuration, int silentDuration);
+    //-- prop: frequency ratio of each step, Q12 (FIX(1.02, 12))
+    int bendTonesQ12 (unsigned int initFrequency, unsigned int finalFrequency, uint16_t prop, long noteDuration, int silentDuration);
+    //-- The same with a float ratio: a constant one is converted at compile time
+    int bendTones (unsigned int initFrequency, unsigned int finalFrequency, float prop, long noteDuration, int silentDuration)
+      { return bendTonesQ12(initFrequency, finalFrequency, FIX(prop, 12), noteDuration, silentDuration); }
+    int sing(int songName);
 
     //-- Gestures
-    void playGesture(int gesture);
+    int playGesture(int gesture);
+
+    //-- Cancellation of the blocking functions
+    void setCancelSource(volatile bool *flag);
+    void setCancelSource(bool (*callback)());
+    bool isCancelled();
+    int pause(unsigned long time);
 
  
   private:
     
-    LedMatrix ledmatrix;
+#if ZOWI_USE_MOUTH
+    LedMatrixT<FastPin<11>, FastPin<13>, FastPin<12> > ledmatrix;   //-- SER, CLK, RCK of the 74HC595
+#endif
+#if ZOWI_USE_BATTERY
     BatReader battery;
+#endif
     Oscillator servo[2];
+#if ZOWI_USE_US
     US us;
+#endif
+#if ZOWI_USE_IR
     IR ir_left;
     IR ir_right;
+#endif
+#if ZOWI_USE_RGB
     TCS3200 rgb_detector;
+#endif
+#if ZOWI_USE_ENCODERS
     ServoEncoder left_encoder;
     ServoEncoder right_encoder;
+    SpeedController wheel[2];
+    Odometry odometry;
+#endif
+    bool speedControl;
+#if ZOWI_USE_BATTERY
+    ZowiGovernor governor;
+#endif
+
+    uint8_t started;          //-- ZOWI_START_ bits of the sensors set up
+#if ZOWI_USE_US
+    uint8_t pinUS[2];         //-- Trigger, echo
+#endif
+#if ZOWI_USE_IR
+    uint8_t pinIR[2];         //-- Left, right
+#endif
+#if ZOWI_USE_ENCODERS
+    uint8_t pinEncoder[2];    //-- Left, right
+#endif
 
     int servo_pins[2];
     int servo_trim[2];
@@ -118,10 +264,24 @@ class Zowi
     
     unsigned long final_time;
     unsigned long partial_time;
-    float increment[4];
 
     bool isZowiResting;
 
+    volatile bool *cancelFlag;
+    bool (*cancelCallback)();
+
+    void use(uint8_t sensors) { if (sensors & ~started) start(sensors); }
+    void applyLimits();
+#if ZOWI_USE_BATTERY
+    int scaleSpeed(int speed) { return governor.scaleSpeed(speed); }
+    long scaleSound(long duration) { return governor.scaleSound(duration); }
+#else
+    int scaleSpeed(int speed) { return speed; }
+    long scaleSound(long duration) { return duration; }
+#endif
+    int readAnalog(uint8_t pin);
+    void setLoad(uint8_t servos);
+    void stopWheels();
     unsigned long int getMouthShape(int number);
     unsigned long int getAnimShape(int anim, int index);
     void _execute(int A[4], int O[4], int T, double phase_diff[4], float steps);
@@ -0,0 +1,60 @@
+//--------------------------------------------------------------
+//-- Zowi_config.h
+//-- Subsystems built into the Zowi library
+//--------------------------------------------------------------
+//-- Set a flag to 0 to leave that subsystem out: its driver is
+//-- not included, its object takes no RAM and runs no code at
+//-- startup. The Zowi functions that use it stay, and answer as
+//-- if nothing was there:
+//--     US        getDistance() 999 (no echo)
+//--     IR        getIR() HIGH (no line)
+//--     RGB       getRGB() false (never ready)
+//--     ENCODERS  getEnc*() and the pose 0. The wheels run open
+//--               loop: setWheelSpeed() maps deg/s to the servo,
+//--               driveDistance() and rotateBy() are timed moves
+//--     BATTERY   full battery, no alarms, no governor: the
+//--               limits are always full
+//--     MOUTH     putMouth() and friends do nothing
+//--     TRACE     the motions are not recorded in the trace
+//--
+//-- Without ENCODERS the library does not use ServoEncoder and
+//-- Odometry; without BATTERY, ZowiGovernor. AnalogSampler (and
+//-- its ADC interrupt) is only built in for the battery and the
+//-- encoders, and ZowiTrace only with TRACE. FixedPoint always
+//-- stays: the oscillators run on it.
+//--
+//-- The library is compiled on its own, so a #define in the
+//-- sketch does not reach Zowi.cpp: edit this file, or pass the
+//-- flags to the whole build with arduino-cli, in
+//--   --build-property "compiler.cpp.extra_flags=-DZOWI_USE_RGB=0"
+//-- bench/size_report.sh compares the sizes of the configurations.
+//--------------------------------------------------------------
+#ifndef Zowi_config_h
+#define Zowi_config_h
+
+#ifndef ZOWI_USE_US
+  #define ZOWI_USE_US        1     //-- Ultrasonic distance sensor
+#endif
+#ifndef ZOWI_USE_IR
+  #define ZOWI_USE_IR        1     //-- Line sensors
+#endif
+#ifndef ZOWI_USE_RGB
+  #define ZOWI_USE_RGB       1     //-- TCS3200 colour sensor
+#endif
+#ifndef ZOWI_USE_ENCODERS
+  #define ZOWI_USE_ENCODERS  1     //-- Wheel encoders, speed control and odometry
+#endif
+#ifndef ZOWI_USE_BATTERY
+  #define ZOWI_USE_BATTERY   1     //-- Background battery monitor
+#endif
+#ifndef ZOWI_USE_MOUTH
+  #define ZOWI_USE_MOUTH     1     //-- LED matrix
+#endif
+#ifndef ZOWI_USE_TRACE
+  #define ZOWI_USE_TRACE     1     //-- Motions in the event trace (ZowiTrace)
+#endif
+
+//-- Not a setting: the ADC runs in the background
+#define ZOWI_USE_SAMPLER     (ZOWI_USE_BATTERY || ZOWI_USE_ENCODERS)
+
+#endif //Zowi_config_h
@@ -79,6 +79,8 @@
 #define thunder		       	28
 #define culito       		29
 #define angry 				30  
+
+#define MOUTH_SHAPES        31      //Number of predefined mouths
                
                
 
@@ -0,0 +1,234 @@
+//--------------------------------------------------------------
+//-- ZowiButtons.cpp
+//-- Interrupt-driven, debounced button events for Zowi
+//--------------------------------------------------------------
+#include "ZowiButtons.h"
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+static uint8_t _pinMask[MAXBUTTONS];
+static uint8_t _pcmsk;
+
+static volatile uint8_t _raw;                 //-- Last level seen by the pin change interrupt
+static volatile uint8_t _state;               //-- Debounced level
+static volatile uint8_t _pressed;
+static volatile uint8_t _longReported;
+static volatile unsigned long _edgeTime[MAXBUTTONS];
+static volatile unsigned long _pressTime[MAXBUTTONS];
+static volatile bool _settling;
+
+static ZowiButtonEvent _queue[BUTTONS_QUEUE_SIZE];
+static volatile uint8_t _head;
+static volatile uint8_t _tail;
+static volatile uint8_t _dropped;
+static volatile unsigned long _lastEvent;
+
+static void (*_onPress)(uint8_t buttons);
+
+static uint8_t readRaw()
+{
+  uint8_t pins = PIND;
+  uint8_t raw = 0;
+  for (uint8_t i = 0; i < MAXBUTTONS; i++)
+    if (pins & _pinMask[i]) raw |= 1 << i;
+  return raw;
+}
+
+static void push(uint8_t type, uint8_t buttons, unsigned long time)
+{
+  if ((uint8_t)(_head - _tail) >= BUTTONS_QUEUE_SIZE) {
+    if (_dropped < 255) _dropped++;
+    return;
+  }
+  ZowiButtonEvent &e = _queue[_head & (BUTTONS_QUEUE_SIZE - 1)];
+  e.time = time;
+  e.type = type;
+  e.buttons = buttons;
+  _head++;
+  _lastEvent = time;
+}
+
+ISR(PCINT2_vect)
+{
+  ZowiButtons::pinChange();
+}
+
+ISR(TIMER0_COMPB_vect)
+{
+  ZowiButtons::tick();
+}
+
+//---------------------------------------------------------
+//-- Pin change: remember the new raw level and when each
+//-- button last moved. Debouncing happens in tick()
+//---------------------------------------------------------
+void ZowiButtons::pinChange()
+{
+  uint8_t raw = readRaw();
+  uint8_t changed = raw ^ _raw;
+  if (!changed) return;
+
+  unsigned long now = millis();
+  for (uint8_t i = 0; i < MAXBUTTONS; i++)
+    if (changed & (1 << i)) _edgeTime[i] = now;
+  _raw = raw;
+  _settling = true;
+}
+
+//---------------------------------------------------------
+//-- 1 ms tick: confirm levels that have been stable for the
+//-- debounce time, and report long presses
+//---------------------------------------------------------
+void ZowiButtons::tick()
+{
+  unsigned long now = millis();
+
+  if (_settling) {
+    uint8_t raw = _raw;
+    bool settling = false;
+
+    for (uint8_t i = 0; i < MAXBUTTONS; i++) {
+      uint8_t bit = 1 << i;
+      if ((raw ^ _state) & bit) {
+        if (now - _edgeTime[i] < BUTTONS_DEBOUNCE_MS) {
+          settling = true;
+          continue;
+        }
+        _state ^= bit;
+        if (raw & bit) {
+          _pressTime[i] = _edgeTime[i];
+          _longReported &= ~bit;
+          _pressed |= bit;
+          push(BUTTON_PRESS, bit, _edgeTime[i]);
+
+          //-- Chord: every other button held was pressed a moment ago
+          uint8_t others = _state & ~bit;
+          if (others) {
+            bool chord = true;
+            for (uint8_t j = 0; j < MAXBUTTONS; j++)
+              if ((others & (1 << j)) && _edgeTime[i] - _pressTime[j] > BUTTONS_CHORD_MS) chord = false;
+            if (chord) push(BUTTON_CHORD, _state, _edgeTime[i]);
+          }
+
+          if (_onPress) _onPress(bit);
+        } else {
+          push(BUTTON_RELEASE, bit, _edgeTime[i]);
+        }
+      }
+    }
+    _settling = settling;
+  }
+
+  uint8_t held = _state & ~_longReported;
+  for (uint8_t i = 0; held && i < MAXBUTTONS; i++) {
+    uint8_t bit = 1 << i;
+    if ((held & bit) && now - _pressTime[i] >= BUTTONS_LONGPRESS_MS) {
+      _longReported |= bit;
+      push(BUTTON_LONGPRESS, bit, now);
+    }
+  }
+}
+
+//---------------------------------------------------------
+//-- Enable the pin change interrupts of both buttons and the
+//-- debounce tick on timer 0 compare B (timer 0 keeps running
+//-- millis(), compare B is free while pins 5/6 don't use PWM)
+//---------------------------------------------------------
+void ZowiButtons::init(uint8_t pinA, uint8_t pinB)
+{
+  uint8_t pins[MAXBUTTONS] = { pinA, pinB };
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _pcmsk = 0;
+    for (uint8_t i = 0; i < MAXBUTTONS; i++) {
+      pinMode(pins[i], INPUT);
+      _pinMask[i] = pins[i] < 8 ? 1 << pins[i] : 0;
+      _pcmsk |= _pinMask[i];
+    }
+
+    _raw = readRaw();
+    _state = _raw;
+    _pressed = 0;
+    _longReported = _state;   //-- Buttons held at boot are not long presses
+    _settling = false;
+    _head = _tail = 0;
+    _dropped = 0;
+
+    PCMSK2 |= _pcmsk;
+    PCIFR = _BV(PCIF2);
+    PCICR |= _BV(PCIE2);
+
+    OCR0B = 0x80;
+    TIMSK0 |= _BV(OCIE0B);
+  }
+}
+
+void ZowiButtons::end()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    PCMSK2 &= ~_pcmsk;
+    if (PCMSK2 == 0) PCICR &= ~_BV(PCIE2);
+    TIMSK0 &= ~_BV(OCIE0B);
+  }
+}
+
+void ZowiButtons::onPress(void (*function)(uint8_t buttons))
+{
+  _onPress = function;
+}
+
+bool ZowiButtons::available()
+{
+  return _head != _tail;
+}
+
+bool ZowiButtons::read(ZowiButtonEvent &event)
+{
+  bool found = false;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (_head != _tail) {
+      event = _queue[_tail & (BUTTONS_QUEUE_SIZE - 1)];
+      _tail++;
+      found = true;
+    }
+  }
+  return found;
+}
+
+uint8_t ZowiButtons::getState()
+{
+  return _state;
+}
+
+uint8_t ZowiButtons::getPressed()
+{
+  return _pressed;
+}
+
+void ZowiButtons::clearPressed()
+{
+  _pressed = 0;
+}
+
+//---------------------------------------------------------
+//-- Consistent copy of the whole button state, taken with
+//-- interrupts disabled
+//---------------------------------------------------------
+void ZowiButtons::snapshot(ZowiButtonsSnapshot &snap)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    snap.lastEvent = _lastEvent;
+    snap.state = _state;
+    snap.pressed = _pressed;
+    snap.pending = _head - _tail;
+    snap.dropped = _dropped;
+  }
+}
+
+void ZowiButtons::flush()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    _tail = _head;
+    _pressed = 0;
+  }
+}
@@ -0,0 +1,72 @@
+//--------------------------------------------------------------
+//-- ZowiButtons.h
+//-- Interrupt-driven, debounced button events for Zowi
+//--------------------------------------------------------------
+//-- Edges are caught by pin change interrupts (PCINT2, so the
+//-- buttons must be on digital pins 0..7) and confirmed by a
+//-- 1 ms tick on timer 0 compare B once the level has been
+//-- stable for BUTTONS_DEBOUNCE_MS. Confirmed changes are queued
+//-- with the time of their edge, so no press is lost while
+//-- the sketch is busy in a long gesture.
+//--------------------------------------------------------------
+#ifndef ZowiButtons_h
+#define ZowiButtons_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define MAXBUTTONS              2
+#define BUTTONS_QUEUE_SIZE      8     //-- Must be a power of 2
+#define BUTTONS_DEBOUNCE_MS     20
+#define BUTTONS_LONGPRESS_MS    800
+#define BUTTONS_CHORD_MS        300   //-- Max time between the presses of a chord
+
+//-- Button masks
+#define BUTTON_A    0x01
+#define BUTTON_B    0x02
+
+//-- Event types
+#define BUTTON_PRESS      1
+#define BUTTON_RELEASE    2
+#define BUTTON_LONGPRESS  3
+#define BUTTON_CHORD      4   //-- buttons holds every button of the chord
+
+struct ZowiButtonEvent {
+  unsigned long time;     //-- millis() of the edge that started the change
+  uint8_t type;
+  uint8_t buttons;
+};
+
+struct ZowiButtonsSnapshot {
+  unsigned long lastEvent; //-- millis() of the newest queued event
+  uint8_t state;           //-- Debounced level of every button
+  uint8_t pressed;         //-- Buttons pressed since the last clearPressed()
+  uint8_t pending;         //-- Events waiting in the queue
+  uint8_t dropped;         //-- Events lost because the queue was full
+};
+
+class ZowiButtons
+{
+  public:
+    void init(uint8_t pinA, uint8_t pinB);
+    void end();
+
+    //-- Optional hook called from the tick interrupt on every confirmed press
+    void onPress(void (*function)(uint8_t buttons));
+
+    bool available();
+    bool read(ZowiButtonEvent &event);   //-- Pops the oldest event
+    uint8_t getState();
+    uint8_t getPressed();                //-- Sticky: survives until clearPressed()
+    void clearPressed();
+    void snapshot(ZowiButtonsSnapshot &snap);
+    void flush();
+
+    static void pinChange();             //-- Called from PCINT2_vect
+    static void tick();                  //-- Called from TIMER0_COMPB_vect
+};
+
+#endif //ZowiButtons_h
@@ -0,0 +1,193 @@
+//--------------------------------------------------------------
+//-- ZowiClips.cpp
+//-- Mouth animations and melodies uploaded once, played locally
+//--------------------------------------------------------------
+#include "ZowiClips.h"
+#include <EEPROM.h>
+
+ZowiClips::ZowiClips()
+{
+  clear();
+}
+
+bool ZowiClips::begin(char name, uint8_t kind)
+{
+  open = false;
+  if (kind >= CLIP_KINDS) return false;
+
+  remove(name);
+  if (used >= CLIPS_MAX) return false;
+
+  Clip &clip = clips[used];
+  clip.name = name;
+  clip.kind = kind;
+  clip.start = end();
+  clip.steps = 0;
+  used++;
+  open = true;
+  return true;
+}
+
+//-- Little endian: value (4 bytes for a frame, 2 for a note), then ms
+bool ZowiClips::append(unsigned long value, unsigned int ms)
+{
+  if (!open) return false;
+
+  Clip &clip = clips[used - 1];
+  uint8_t bytes = stepBytes(clip.kind);
+  uint8_t at = end();
+  if (at + bytes > CLIPS_POOL || clip.steps == 0xFF) return false;
+
+  for (uint8_t i = 0; i < bytes - 2; i++) pool[at++] = value >> (8 * i);
+  pool[at++] = ms & 0xFF;
+  pool[at] = ms >> 8;
+  clip.steps++;
+  return true;
+}
+
+//---------------------------------------------------------
+//-- The clips after it move down, so the free bytes stay
+//-- at the end of the pool
+//---------------------------------------------------------
+bool ZowiClips::remove(char name)
+{
+  int8_t c = find(name);
+  if (c == NO_CLIP) return false;
+
+  uint8_t start = clips[c].start;
+  uint8_t size = clips[c].steps * stepBytes(clips[c].kind);
+  memmove(pool + start, pool + start + size, end() - start - size);
+
+  for (uint8_t i = c; i + 1 < used; i++) {
+    clips[i] = clips[i + 1];
+    clips[i].start -= size;
+  }
+  used--;
+  if (c == used) open = false;        //-- The clip being uploaded is gone
+  return true;
+}
+
+void ZowiClips::clear()
+{
+  memset(clips, 0, sizeof(clips));
+  used = 0;
+  open = false;
+}
+
+int8_t ZowiClips::find(char name)
+{
+  for (uint8_t i = 0; i < used; i++) {
+    if (clips[i].name == name) return i;
+  }
+  return NO_CLIP;
+}
+
+uint8_t ZowiClips::getKind(int8_t clip)
+{
+  return clips[clip].kind;
+}
+
+uint8_t ZowiClips::getSteps(int8_t clip)
+{
+  return clips[clip].steps;
+}
+
+void ZowiClips::getStep(int8_t clip, uint8_t index, ZowiClipStep &step)
+{
+  uint8_t bytes = stepBytes(clips[clip].kind);
+  const uint8_t *at = pool + clips[clip].start + index * bytes;
+
+  step.value = 0;
+  for (uint8_t i = 0; i < bytes - 2; i++) step.value |= (unsigned long)at[i] << (8 * i);
+  step.ms = at[bytes - 2] | (at[bytes - 1] << 8);
+}
+
+uint8_t ZowiClips::count()
+{
+  return used;
+}
+
+unsigned int ZowiClips::getFree()
+{
+  return CLIPS_POOL - end();
+}
+
+//---------------------------------------------------------
+//-- Only the pool bytes in use are stored. The cache is
+//-- invalid until the magic is back, so a save cut short by
+//-- a reset leaves no half table behind
+//---------------------------------------------------------
+bool ZowiClips::save()
+{
+  if (stored()) return false;
+
+  int addr = CLIPS_EEPROM_ADDR + 2;
+  const uint8_t *bytes = (const uint8_t *)clips;
+
+  EEPROM.update(CLIPS_EEPROM_ADDR, 0);
+  for (uint8_t i = 0; i < sizeof(clips); i++) EEPROM.update(addr++, bytes[i]);
+  for (uint8_t i = 0; i < end(); i++) EEPROM.update(addr++, pool[i]);
+  EEPROM.update(CLIPS_EEPROM_ADDR + 1, used);
+  EEPROM.update(CLIPS_EEPROM_ADDR, CLIPS_MAGIC);
+  return true;
+}
+
+bool ZowiClips::load()
+{
+  clear();
+  if (EEPROM.read(CLIPS_EEPROM_ADDR) != CLIPS_MAGIC) return false;
+
+  int addr = CLIPS_EEPROM_ADDR + 2;
+  uint8_t *bytes = (uint8_t *)clips;
+  used = EEPROM.read(CLIPS_EEPROM_ADDR + 1);
+  for (uint8_t i = 0; i < sizeof(clips); i++) bytes[i] = EEPROM.read(addr++);
+
+  if (!valid()) {
+    clear();
+    return false;
+  }
+  for (uint8_t i = 0; i < end(); i++) pool[i] = EEPROM.read(addr++);
+  return true;
+}
+
+//-- The EEPROM already holds this cache
+bool ZowiClips::stored()
+{
+  if (EEPROM.read(CLIPS_EEPROM_ADDR) != CLIPS_MAGIC || EEPROM.read(CLIPS_EEPROM_ADDR + 1) != used) return false;
+
+  int addr = CLIPS_EEPROM_ADDR + 2;
+  const uint8_t *bytes = (const uint8_t *)clips;
+  for (uint8_t i = 0; i < sizeof(clips); i++) {
+    if (EEPROM.read(addr++) != bytes[i]) return false;
+  }
+  for (uint8_t i = 0; i < end(); i++) {
+    if (EEPROM.read(addr++) != pool[i]) return false;
+  }
+  return true;
+}
+
+uint8_t ZowiClips::end()
+{
+  if (used == 0) return 0;
+
+  const Clip &last = clips[used - 1];
+  return last.start + last.steps * stepBytes(last.kind);
+}
+
+//-- The clips must follow each other from the start of the pool
+bool ZowiClips::valid()
+{
+  if (used > CLIPS_MAX) return false;
+
+  unsigned int at = 0;
+  for (uint8_t i = 0; i < used; i++) {
+    if (clips[i].kind >= CLIP_KINDS || clips[i].start != at) return false;
+    at += clips[i].steps * stepBytes(clips[i].kind);
+  }
+  return at <= CLIPS_POOL;
+}
+
+uint8_t ZowiClips::stepBytes(uint8_t kind)
+{
+  return (kind == CLIP_MOUTH) ? 6 : 4;
+}
@@ -0,0 +1,89 @@
+//--------------------------------------------------------------
+//-- ZowiClips.h
+//-- Mouth animations and melodies uploaded once, played locally
+//--------------------------------------------------------------
+//-- A clip is named by one character and holds either mouth
+//-- frames (LED matrix, duration) or notes (frequency, with 0
+//-- for a rest, duration). The host uploads it step by step
+//-- with begin() and append(); the sketch then plays it from
+//-- the cache, with the timing of the board and no serial
+//-- traffic per frame or note.
+//--
+//-- The clips share a pool of CLIPS_POOL bytes, in upload
+//-- order: a frame takes 6 bytes, a note 4. Uploading a clip
+//-- again under the same name replaces it.
+//--
+//-- save() keeps the cache in the EEPROM and load() brings it
+//-- back at boot. EEPROM layout at CLIPS_EEPROM_ADDR:
+//--   magic count clips[CLIPS_MAX] pool[CLIPS_POOL]
+//-- The magic is cleared while the data is written, and the
+//-- table is checked again when loaded.
+//--------------------------------------------------------------
+#ifndef ZowiClips_h
+#define ZowiClips_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define CLIPS_MAX          4
+#define CLIPS_POOL         128
+#define CLIPS_EEPROM_ADDR  0x140   //-- After ZowiRules (0x100), before ZowiTrace (0x300)
+#define CLIPS_MAGIC        'Q'
+
+//-- Kinds of clip
+#define CLIP_MOUTH         0       //-- value: LED matrix, as the 'L' command
+#define CLIP_MELODY        1       //-- value: Hz, 0 = rest
+#define CLIP_KINDS         2
+
+#define NO_CLIP            -1
+
+struct ZowiClipStep {
+  unsigned long value;
+  unsigned int ms;
+};
+
+class ZowiClips
+{
+  public:
+    ZowiClips();
+
+    //-- Upload: begin() a clip, then append() its steps in order
+    bool begin(char name, uint8_t kind);          //-- false if no slot is free
+    bool append(unsigned long value, unsigned int ms);   //-- false if the pool is full or no clip was begun
+    bool remove(char name);                       //-- false if there is no such clip
+    void clear();
+
+    int8_t find(char name);                       //-- NO_CLIP if there is no such clip
+    uint8_t getKind(int8_t clip);
+    uint8_t getSteps(int8_t clip);
+    void getStep(int8_t clip, uint8_t index, ZowiClipStep &step);
+
+    uint8_t count();
+    unsigned int getFree();                       //-- Bytes left in the pool
+
+    bool save();                                  //-- false if nothing changed
+    bool load();                                  //-- false if the EEPROM holds no cache
+
+  private:
+    struct Clip {
+      char name;
+      uint8_t kind;
+      uint8_t start;              //-- Offset in the pool
+      uint8_t steps;
+    };
+
+    Clip clips[CLIPS_MAX];
+    uint8_t pool[CLIPS_POOL];
+    uint8_t used;                   //-- Clips in the table, in pool order
+    bool open;                      //-- The last clip takes append()
+
+    uint8_t end();                  //-- First free byte of the pool
+    bool stored();
+    bool valid();
+    static uint8_t stepBytes(uint8_t kind);
+};
+
+#endif //ZowiClips_h
@@ -0,0 +1,66 @@
+//--------------------------------------------------------------
+//-- ZowiGovernor.cpp
+//-- Limits on motion, sound and LEDs by battery level
+//--------------------------------------------------------------
+#include "ZowiGovernor.h"
+
+//-- speed, ramp, leds, sound
+static const ZowiLimits defaultLimits[GOVERNOR_LEVELS] PROGMEM = {
+  {100,  0, 100, 100},     //-- OK
+  { 70, 40,  50,  60},     //-- LOW
+  { 40, 20,  25,   0},     //-- CRITICAL: silent
+};
+
+ZowiGovernor::ZowiGovernor()
+{
+  memcpy_P(limits, defaultLimits, sizeof(limits));
+  level = 0;
+  changed = true;       //-- The first update() applies level 0
+}
+
+void ZowiGovernor::setLimits(uint8_t level, const ZowiLimits &limits)
+{
+  if (level >= GOVERNOR_LEVELS) return;
+  this->limits[level] = limits;
+  if (limits.speed < GOVERNOR_MIN_SPEED) this->limits[level].speed = GOVERNOR_MIN_SPEED;
+  if (level == this->level) changed = true;
+}
+
+bool ZowiGovernor::update(uint8_t level)
+{
+  if (level >= GOVERNOR_LEVELS) level = GOVERNOR_LEVELS - 1;
+  if (level != this->level) {
+    this->level = level;
+    changed = true;
+  }
+
+  bool result = changed;
+  changed = false;
+  return result;
+}
+
+uint8_t ZowiGovernor::getLevel()
+{
+  return level;
+}
+
+const ZowiLimits &ZowiGovernor::getLimits()
+{
+  return limits[level];
+}
+
+bool ZowiGovernor::isLimited()
+{
+  const ZowiLimits &l = limits[level];
+  return l.speed < 100 || l.ramp != 0 || l.leds < 100 || l.sound < 100;
+}
+
+int ZowiGovernor::scaleSpeed(int speed)
+{
+  return (long)speed * limits[level].speed / 100;
+}
+
+long ZowiGovernor::scaleSound(long duration)
+{
+  return duration * limits[level].sound / 100;
+}
@@ -0,0 +1,58 @@
+//--------------------------------------------------------------
+//-- ZowiGovernor.h
+//-- Limits on motion, sound and LEDs by battery level
+//--------------------------------------------------------------
+//-- One set of limits per battery level (BatReader::BAT_OK,
+//-- BAT_LOW, BAT_CRITICAL). Zowi hands the battery level to
+//-- update() before it moves, sings or changes the mouth, and
+//-- applies the limits of that level:
+//--     speed   servo speed, percent of what was asked
+//--     ramp    wheel acceleration, deg/s per control period
+//--             (0 = no limit)
+//--     leds    LED matrix duty, percent of the lit LEDs
+//--     sound   buzzer duty, percent of every note (the rest of
+//--             the note is silence, so songs keep their timing)
+//-- A weak battery then sees lower current peaks: fewer resets
+//-- under load and more time before it is flat.
+//--------------------------------------------------------------
+#ifndef ZowiGovernor_h
+#define ZowiGovernor_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define GOVERNOR_LEVELS     3
+#define GOVERNOR_MIN_SPEED  10     //-- %, slower stalls the wheels
+
+struct ZowiLimits {
+  uint8_t speed;      //-- %
+  uint8_t ramp;       //-- deg/s per period, 0 = no limit
+  uint8_t leds;       //-- %
+  uint8_t sound;      //-- %
+};
+
+class ZowiGovernor
+{
+  public:
+    ZowiGovernor();
+
+    void setLimits(uint8_t level, const ZowiLimits &limits);
+    bool update(uint8_t level);          //-- true if the limits changed
+
+    uint8_t getLevel();
+    const ZowiLimits &getLimits();       //-- Of the current level
+    bool isLimited();                    //-- Any limit below full
+
+    int scaleSpeed(int speed);           //-- Speed (or offset from 90) after the limit
+    long scaleSound(long duration);      //-- ms of sound in a note of duration ms
+
+  private:
+    ZowiLimits limits[GOVERNOR_LEVELS];
+    uint8_t level;
+    bool changed;
+};
+
+#endif //ZowiGovernor_h
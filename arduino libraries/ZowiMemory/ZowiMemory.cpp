@@ -0,0 +1,92 @@
+//--------------------------------------------------------------
+//-- ZowiMemory.cpp
+//-- RAM usage instrumentation for the ATmega328 (2 KB)
+//--------------------------------------------------------------
+#include "ZowiMemory.h"
+
+#if defined(__AVR__)
+
+//-- Symbols from the avr-libc linker script and malloc
+extern uint8_t __data_start;
+extern uint8_t __bss_end;
+extern uint8_t __heap_start;
+extern uint8_t __stack;
+extern char *__brkval;
+
+//---------------------------------------------------------
+//-- Runs in .init3: the stack pointer is set but nothing
+//-- lives on the stack yet. Written in assembly so it uses
+//-- no stack itself.
+//---------------------------------------------------------
+void ZowiMemory_paint(void) __attribute__((naked, used, section(".init3")));
+
+void ZowiMemory_paint(void)
+{
+  __asm volatile (
+    "    ldi r30, lo8(__heap_start) \n"
+    "    ldi r31, hi8(__heap_start) \n"
+    "    ldi r24, %0                \n"
+    "    ldi r25, hi8(__stack)      \n"
+    "    rjmp 2f                    \n"
+    "1:  st Z+, r24                 \n"
+    "2:  cpi r30, lo8(__stack)      \n"
+    "    cpc r31, r25               \n"
+    "    brlo 1b                    \n"
+    "    breq 1b                    \n"
+    :: "i" (MEMORY_CANARY));
+}
+
+static uint8_t *heapTop()
+{
+  return __brkval ? (uint8_t *)__brkval : &__heap_start;
+}
+
+//-- First byte above the heap that the stack (or the heap) has overwritten
+static uint8_t *firstUsed()
+{
+  uint8_t *p = heapTop();
+  while (p <= &__stack && *p == MEMORY_CANARY) p++;
+  return p;
+}
+
+unsigned int ZowiMemory::getFreeRam()
+{
+  return (unsigned int)SP - (unsigned int)heapTop();
+}
+
+unsigned int ZowiMemory::getMinFreeRam()
+{
+  return firstUsed() - heapTop();
+}
+
+unsigned int ZowiMemory::getStackHighWater()
+{
+  return &__stack - firstUsed() + 1;
+}
+
+unsigned int ZowiMemory::getStaticRam()
+{
+  return &__bss_end - &__data_start;
+}
+
+unsigned int ZowiMemory::getHeapUsed()
+{
+  return heapTop() - &__heap_start;
+}
+
+#else
+
+unsigned int ZowiMemory::getFreeRam()        { return 0; }
+unsigned int ZowiMemory::getMinFreeRam()     { return 0; }
+unsigned int ZowiMemory::getStackHighWater() { return 0; }
+unsigned int ZowiMemory::getStaticRam()      { return 0; }
+unsigned int ZowiMemory::getHeapUsed()       { return 0; }
+
+#endif
+
+void ZowiMemory::printItem(Print &out, const __FlashStringHelper *name, unsigned int size)
+{
+  out.print(name);
+  out.print(' ');
+  out.println(size);
+}
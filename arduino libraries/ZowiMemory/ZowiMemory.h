@@ -0,0 +1,37 @@
+//--------------------------------------------------------------
+//-- ZowiMemory.h
+//-- RAM usage instrumentation for the ATmega328 (2 KB)
+//--------------------------------------------------------------
+//-- At boot, before the constructors run, the free RAM between
+//-- the end of .bss and the top of the stack is painted with a
+//-- canary byte. The deepest the stack has ever gone (or the
+//-- highest the heap has grown) is then found by looking for
+//-- the first byte that is not the canary any more.
+//--
+//-- On other architectures (host builds) every query returns 0.
+//--------------------------------------------------------------
+#ifndef ZowiMemory_h
+#define ZowiMemory_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define MEMORY_CANARY  0xC5
+
+class ZowiMemory
+{
+  public:
+    static unsigned int getFreeRam();         //-- Between the heap and the stack, right now
+    static unsigned int getMinFreeRam();      //-- Smallest free RAM since boot (untouched canary)
+    static unsigned int getStackHighWater();  //-- Most stack ever used (bytes)
+    static unsigned int getStaticRam();       //-- .data + .bss
+    static unsigned int getHeapUsed();
+
+    //-- One "name bytes" line, for per-object RAM reports
+    static void printItem(Print &out, const __FlashStringHelper *name, unsigned int size);
+};
+
+#endif //ZowiMemory_h
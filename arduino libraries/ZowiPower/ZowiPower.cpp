@@ -0,0 +1,182 @@
+//--------------------------------------------------------------
+//-- ZowiPower.cpp
+//-- Low power idle for the Zowi main loop
+//--------------------------------------------------------------
+#include "ZowiPower.h"
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <FixedPoint.h>
+
+//-- Millisecond count of the Arduino core (wiring.c). Timer 0 is
+//-- stopped in power-down, so the time asleep is added by hand.
+//-- micros() does not include it.
+extern volatile unsigned long timer0_millis;
+
+static volatile bool _wdtFired;
+
+ISR(WDT_vect)
+{
+  _wdtFired = true;
+}
+
+//-- Watchdog in interrupt-only mode (no reset), period = WDTO_xx
+static void wdtStart(uint8_t period)
+{
+  uint8_t bits = (period & 0x07) | ((period & 0x08) ? _BV(WDP3) : 0);
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    MCUSR &= ~_BV(WDRF);
+    WDTCSR = _BV(WDCE) | _BV(WDE);    //-- Timed sequence: 4 cycles to write
+    WDTCSR = _BV(WDIE) | bits;
+    wdt_reset();
+  }
+}
+
+static void wdtStop()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    wdt_reset();
+    MCUSR &= ~_BV(WDRF);
+    WDTCSR = _BV(WDCE) | _BV(WDE);
+    WDTCSR = 0;
+  }
+}
+
+//---------------------------------------------------------
+//-- Idle: the CPU stops until the next interrupt. Timer 0
+//-- wakes it every ms, so this is safe to call on every
+//-- loop() with nothing to do
+//---------------------------------------------------------
+void ZowiPower::idle()
+{
+  unsigned long start = micros();
+
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  cli();
+  sleep_enable();
+  sei();            //-- The instruction after sei always runs: no wake-up is lost
+  sleep_cpu();
+  sleep_disable();
+
+  idleUs += micros() - start;
+  if (idleUs >= 1000) {
+    idleMs += idleUs / 1000;
+    idleUs %= 1000;
+  }
+}
+
+//---------------------------------------------------------
+//-- Power-down in watchdog periods of up to 1 s. Servos,
+//-- tones and the serial port stop while asleep, and the ADC
+//-- is switched off. A wake-up that is not the watchdog is
+//-- credited half of the period it interrupted.
+//---------------------------------------------------------
+unsigned long ZowiPower::powerDown(unsigned long time, bool wakeOnSerial)
+{
+  unsigned long slept = 0;
+  bool woken = false;
+  uint8_t adcsra = ADCSRA;
+  uint8_t pcmsk2 = PCMSK2;
+
+  //-- A pin change on RXD needs a PCINT2 handler, so only use it
+  //-- when someone else (e.g. ZowiButtons) already has one enabled
+  if (wakeOnSerial && (PCICR & _BV(PCIE2))) PCMSK2 |= _BV(PCINT16);
+  ADCSRA &= ~_BV(ADEN);
+
+  while (time - slept >= POWER_DOWN_MIN_MS) {
+    uint8_t period = WDTO_1S;
+    while (period > WDTO_15MS && (16UL << period) > time - slept) period--;
+
+    _wdtFired = false;
+    wdtStart(period);
+
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    cli();
+    sleep_enable();
+#if defined(BODS)
+    sleep_bod_disable();
+#endif
+    sei();
+    sleep_cpu();
+    sleep_disable();
+
+    wdtStop();
+
+    unsigned long chunk = 16UL << period;
+    if (_wdtFired) {
+      slept += chunk;
+    } else {
+      slept += chunk / 2;
+      woken = true;
+      break;
+    }
+  }
+
+  ADCSRA = adcsra;
+  PCMSK2 = pcmsk2;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    timer0_millis += slept;
+  }
+  downMs += slept;
+
+  //-- Woken by a pin change: a button, or a host whose bytes were lost
+  if (woken) serialTime = millis();
+
+  return slept;
+}
+
+//---------------------------------------------------------
+//-- Sleep until time ms from now or an earlier event. Uses
+//-- power-down for long waits once the serial line has been
+//-- quiet for a while and the TX buffer is empty, and idle
+//-- otherwise
+//---------------------------------------------------------
+unsigned long ZowiPower::sleep(unsigned long time, bool wakeOnSerial)
+{
+  if (time >= POWER_DOWN_MIN_MS && millis() - serialTime >= POWER_SERIAL_QUIET_MS &&
+      Serial.availableForWrite() >= SERIAL_TX_BUFFER_SIZE - 1) {
+    Serial.flush();     //-- Last byte still in the shift register
+    return powerDown(time, wakeOnSerial);
+  }
+  idle();
+  return 0;
+}
+
+void ZowiPower::serialActivity()
+{
+  serialTime = millis();
+}
+
+unsigned long ZowiPower::getTime(uint8_t state)
+{
+  switch (state) {
+    case POWER_IDLE: return idleMs;
+    case POWER_DOWN: return downMs;
+    default:         return millis() - statsStart - idleMs - downMs;
+  }
+}
+
+unsigned long ZowiPower::getAverageCurrent()
+{
+  unsigned long total = millis() - statsStart;
+  if (total == 0) return POWER_ACTIVE_UA;
+
+  //-- The active current, less what the time asleep saved (the
+  //-- shares of the time in Q16, so nothing overflows)
+  uint32_t idle = fix_div(idleMs, total, 16);
+  uint32_t down = fix_div(downMs, total, 16);
+  uint32_t saved = idle * (POWER_ACTIVE_UA - POWER_IDLE_UA)
+                 + down * (POWER_ACTIVE_UA - POWER_DOWN_UA);
+  return POWER_ACTIVE_UA - ((saved + 0x8000) >> 16);
+}
+
+void ZowiPower::resetStats()
+{
+  idleUs = 0;
+  idleMs = 0;
+  downMs = 0;
+  statsStart = millis();
+}
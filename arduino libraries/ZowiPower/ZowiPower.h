@@ -0,0 +1,93 @@
+//--------------------------------------------------------------
+//-- ZowiPower.h
+//-- Low power idle for the Zowi main loop
+//--------------------------------------------------------------
+//-- Two ways to wait for the next thing to do:
+//--   * idle():      SLEEP_MODE_IDLE. Timers, UART and ADC keep
+//--                  running and any interrupt wakes the CPU
+//--                  (at the latest on the next 1 ms timer 0 tick)
+//--   * powerDown(): SLEEP_MODE_PWR_DOWN, woken by the watchdog
+//--                  or a pin change (buttons, and the RX pin if
+//--                  wakeOnSerial is set). millis() is advanced
+//--                  by the time spent asleep.
+//-- Bytes that arrive in power-down are lost (the oscillator takes
+//-- longer to start than a command takes to arrive), so sleep()
+//-- only powers down once the serial line has been quiet for
+//-- POWER_SERIAL_QUIET_MS; the sketch reports the traffic with
+//-- serialActivity(). A wake-up from power-down by a pin change
+//-- counts as traffic, so a host that got no answer can resend.
+//-- The time spent in each state is kept to give an estimate of
+//-- the average current of the board.
+//--------------------------------------------------------------
+#ifndef ZowiPower_h
+#define ZowiPower_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+//-- Current estimates (uA) for an ATmega328P at 16 MHz and 5 V,
+//-- from the datasheet typical values. Define them before
+//-- including the library to account for the rest of the board.
+#ifndef POWER_ACTIVE_UA
+  #define POWER_ACTIVE_UA     9500
+#endif
+#ifndef POWER_IDLE_UA
+  #define POWER_IDLE_UA       2800
+#endif
+#ifndef POWER_DOWN_UA
+  #define POWER_DOWN_UA       7      //-- Watchdog running, BOD off
+#endif
+
+//-- Time spent in power-down without a watchdog wake-up is not
+//-- measurable; below this the sketch should use idle() instead
+#define POWER_DOWN_MIN_MS   16
+
+//-- Quiet serial line needed before sleep() powers down
+#ifndef POWER_SERIAL_QUIET_MS
+  #define POWER_SERIAL_QUIET_MS  300000UL
+#endif
+
+//-- Power states, for getTime()
+#define POWER_ACTIVE  0
+#define POWER_IDLE    1
+#define POWER_DOWN    2
+
+class ZowiPower
+{
+  public:
+    //-- Sleep until the next interrupt (1 ms at most)
+    void idle();
+
+    //-- Sleep up to time ms in power-down; returns the ms slept.
+    //-- Wakes earlier on a pin change interrupt. If wakeOnSerial is
+    //-- set the RX pin wakes it too, but the first bytes received
+    //-- while the oscillator starts are lost, so the host must
+    //-- send a wake-up byte (e.g. '\r') before its command
+    unsigned long powerDown(unsigned long time, bool wakeOnSerial=true);
+
+    //-- Sleep up to time ms choosing the deepest mode that fits:
+    //-- idle() while the serial line was active in the last
+    //-- POWER_SERIAL_QUIET_MS. Returns the ms spent in power-down
+    //-- (0 if it only idled)
+    unsigned long sleep(unsigned long time, bool wakeOnSerial=true);
+
+    //-- The host sent something: keep the CPU able to receive
+    void serialActivity();
+
+    //-- Statistics
+    unsigned long getTime(uint8_t state);   //-- ms spent in the state since resetStats()
+    unsigned long getAverageCurrent();      //-- Estimated average current (uA)
+    void resetStats();
+
+  private:
+    unsigned long idleUs;       //-- Whole ms are moved to idleMs
+    unsigned long idleMs;
+    unsigned long downMs;
+    unsigned long statsStart;
+    unsigned long serialTime;   //-- millis() of the last serial traffic (0 = boot)
+};
+
+#endif //ZowiPower_h
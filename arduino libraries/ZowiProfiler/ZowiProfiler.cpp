@@ -0,0 +1,69 @@
+//--------------------------------------------------------------
+//-- ZowiProfiler.cpp
+//-- Section timing for the Zowi main loop
+//--------------------------------------------------------------
+#include "ZowiProfiler.h"
+
+void ZowiProfiler::add(uint8_t section, const __FlashStringHelper *name, unsigned long time)
+{
+  if (section >= PROFILER_SECTIONS) return;
+
+  Section &s = sections[section];
+  if (s.name == NULL || s.count == 0) {
+    s.name = name;
+    s.min = time;
+  }
+
+  s.count++;
+  s.total += time;
+  if (time < s.min) s.min = time;
+  if (time > s.max) s.max = time;
+
+  uint8_t bucket = 0;
+  for (unsigned long limit = 64; bucket < PROFILER_BUCKETS - 1 && time >= limit; limit <<= 2) bucket++;
+  if (s.histogram[bucket] < 0xFFFF) s.histogram[bucket]++;
+}
+
+//---------------------------------------------------------
+//-- One line per section, times in us:
+//--   name count min avg max | histogram
+//-- This is a diagnostic dump: it blocks while the TX
+//-- buffer drains
+//---------------------------------------------------------
+void ZowiProfiler::report(Print &out)
+{
+  out.println(F("section count min avg max | <64 <256 <1k <4k <16k <64k <256k more"));
+
+  for (uint8_t i = 0; i < PROFILER_SECTIONS; i++) {
+    Section &s = sections[i];
+    if (s.name == NULL || s.count == 0) continue;
+
+    out.print(s.name);
+    out.print(' ');
+    out.print(s.count);
+    out.print(' ');
+    out.print(s.min);
+    out.print(' ');
+    out.print(s.total / s.count);
+    out.print(' ');
+    out.print(s.max);
+    out.print(F(" |"));
+    for (uint8_t b = 0; b < PROFILER_BUCKETS; b++) {
+      out.print(' ');
+      out.print(s.histogram[b]);
+    }
+    out.println();
+  }
+}
+
+void ZowiProfiler::reset()
+{
+  for (uint8_t i = 0; i < PROFILER_SECTIONS; i++) {
+    Section &s = sections[i];
+    s.count = 0;
+    s.total = 0;
+    s.min = 0;
+    s.max = 0;
+    for (uint8_t b = 0; b < PROFILER_BUCKETS; b++) s.histogram[b] = 0;
+  }
+}
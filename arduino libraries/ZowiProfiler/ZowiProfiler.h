@@ -0,0 +1,86 @@
+//--------------------------------------------------------------
+//-- ZowiProfiler.h
+//-- Section timing for the Zowi main loop
+//--------------------------------------------------------------
+//-- Each section keeps its count, min/avg/max time and a
+//-- histogram in a fixed size table. Timing uses micros(), so
+//-- the resolution is 4 us.
+//--
+//-- Use the PROFILE_ macros, not the class: unless the sketch
+//-- defines ZOWI_PROFILING before including this header they
+//-- compile to nothing, with no RAM or flash cost.
+//--
+//--   #define ZOWI_PROFILING
+//--   #include <ZowiProfiler.h>
+//--   PROFILE_DECLARE();
+//--
+//--   void loop() {
+//--     PROFILE_SCOPE(0, "loop");    //-- Times until the end of the block
+//--     ...
+//--   }
+//--
+//--   PROFILE_REPORT(Serial);        //-- Prints the table
+//--------------------------------------------------------------
+#ifndef ZowiProfiler_h
+#define ZowiProfiler_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define PROFILER_SECTIONS  8
+#define PROFILER_BUCKETS   8    //-- <64us, <256us, <1ms, ... x4 each, the last one open
+
+class ZowiProfiler
+{
+  public:
+    void add(uint8_t section, const __FlashStringHelper *name, unsigned long time);
+    void report(Print &out);
+    void reset();
+
+  private:
+    struct Section {
+      const __FlashStringHelper *name;   //-- NULL = unused
+      unsigned long count;
+      unsigned long total;
+      unsigned long min;
+      unsigned long max;
+      uint16_t histogram[PROFILER_BUCKETS];
+    };
+
+    Section sections[PROFILER_SECTIONS];
+};
+
+//-- Times its own lifetime into a section of the profiler
+class ZowiProfileScope
+{
+  public:
+    ZowiProfileScope(ZowiProfiler &profiler, uint8_t section, const __FlashStringHelper *name)
+      : profiler(profiler), section(section), name(name), start(micros()) {}
+    ~ZowiProfileScope() { profiler.add(section, name, micros() - start); }
+
+  private:
+    ZowiProfiler &profiler;
+    uint8_t section;
+    const __FlashStringHelper *name;
+    unsigned long start;
+};
+
+#define PROFILE_CAT2(a, b) a##b
+#define PROFILE_CAT(a, b)  PROFILE_CAT2(a, b)
+
+#ifdef ZOWI_PROFILING
+  #define PROFILE_DECLARE()             ZowiProfiler zowiProfiler
+  #define PROFILE_SCOPE(section, name)  ZowiProfileScope PROFILE_CAT(_profileScope, __LINE__)(zowiProfiler, section, F(name))
+  #define PROFILE_REPORT(out)           zowiProfiler.report(out)
+  #define PROFILE_RESET()               zowiProfiler.reset()
+#else
+  #define PROFILE_DECLARE()             typedef int _zowiProfilerUnused
+  #define PROFILE_SCOPE(section, name)  do { } while (0)
+  #define PROFILE_REPORT(out)           do { } while (0)
+  #define PROFILE_RESET()               do { } while (0)
+#endif
+
+#endif //ZowiProfiler_h
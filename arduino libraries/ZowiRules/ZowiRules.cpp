@@ -0,0 +1,158 @@
+//--------------------------------------------------------------
+//-- ZowiRules.cpp
+//-- Reactive behaviours run on the board: sensor rule -> action
+//--------------------------------------------------------------
+#include "ZowiRules.h"
+#include <EEPROM.h>
+
+void ZowiRules::init(int (*read)(uint8_t sensor), void (*act)(uint8_t action, uint8_t arg))
+{
+  this->read = read;
+  this->act = act;
+  clear();
+}
+
+bool ZowiRules::set(uint8_t slot, const ZowiRule &rule)
+{
+  if (slot >= RULES_MAX) return false;
+  if (rule.action == RULE_NONE) {
+    remove(slot);
+    return true;
+  }
+  if (!valid(rule)) return false;
+
+  rules[slot] = rule;
+  fired &= ~(1 << slot);
+  return true;
+}
+
+bool ZowiRules::get(uint8_t slot, ZowiRule &rule)
+{
+  if (slot >= RULES_MAX || rules[slot].action == RULE_NONE) return false;
+
+  rule = rules[slot];
+  return true;
+}
+
+void ZowiRules::remove(uint8_t slot)
+{
+  if (slot >= RULES_MAX) return;
+
+  rules[slot].action = RULE_NONE;
+  fired &= ~(1 << slot);
+}
+
+void ZowiRules::clear()
+{
+  memset(rules, 0, sizeof(rules));
+  fired = 0;
+}
+
+uint8_t ZowiRules::count()
+{
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < RULES_MAX; i++) {
+    if (rules[i].action != RULE_NONE) n++;
+  }
+  return n;
+}
+
+//---------------------------------------------------------
+//-- Each sensor is read at most once per pass (the
+//-- ultrasonic one takes milliseconds), then the rules fire
+//-- in slot order
+//---------------------------------------------------------
+void ZowiRules::evaluate()
+{
+  int value[RULE_SENSORS];
+  uint8_t known = 0;
+
+  for (uint8_t i = 0; i < RULES_MAX; i++) {
+    const ZowiRule &rule = rules[i];
+    if (rule.action == RULE_NONE) continue;
+
+    uint8_t bit = 1 << rule.sensor;
+    if (!(known & bit)) {
+      value[rule.sensor] = read(rule.sensor);
+      known |= bit;
+    }
+    int v = value[rule.sensor];
+
+    if (fired & (1 << i)) {
+      if (rearms(rule, v)) fired &= ~(1 << i);
+    } else if (holds(rule, v)) {
+      fired |= 1 << i;
+      act(rule.action, rule.arg);
+    }
+  }
+}
+
+//---------------------------------------------------------
+//-- The rules go first and the header last: a save cut
+//-- short by a reset leaves no valid table behind
+//---------------------------------------------------------
+bool ZowiRules::save()
+{
+  const uint8_t *bytes = (const uint8_t *)rules;
+  bool changed = false;
+
+  for (uint8_t i = 0; i < sizeof(rules); i++) {
+    int addr = RULES_EEPROM_ADDR + 2 + i;
+    if (EEPROM.read(addr) != bytes[i]) {
+      EEPROM.write(addr, bytes[i]);
+      changed = true;
+    }
+  }
+  if (EEPROM.read(RULES_EEPROM_ADDR + 1) != sizeof(rules)) {
+    EEPROM.write(RULES_EEPROM_ADDR + 1, sizeof(rules));
+    changed = true;
+  }
+  if (EEPROM.read(RULES_EEPROM_ADDR) != RULES_MAGIC) {
+    EEPROM.write(RULES_EEPROM_ADDR, RULES_MAGIC);
+    changed = true;
+  }
+  return changed;
+}
+
+bool ZowiRules::load()
+{
+  clear();
+  if (EEPROM.read(RULES_EEPROM_ADDR) != RULES_MAGIC) return false;
+  if (EEPROM.read(RULES_EEPROM_ADDR + 1) != sizeof(rules)) return false;
+
+  uint8_t *bytes = (uint8_t *)rules;
+  for (uint8_t i = 0; i < sizeof(rules); i++) bytes[i] = EEPROM.read(RULES_EEPROM_ADDR + 2 + i);
+
+  //-- Whatever does not pass as a rule is a free slot
+  for (uint8_t i = 0; i < RULES_MAX; i++) {
+    if (!valid(rules[i])) rules[i].action = RULE_NONE;
+  }
+  return true;
+}
+
+bool ZowiRules::valid(const ZowiRule &rule)
+{
+  return rule.sensor < RULE_SENSORS && rule.compare <= RULE_EQUAL &&
+         rule.action != RULE_NONE && rule.action < RULE_ACTIONS;
+}
+
+bool ZowiRules::holds(const ZowiRule &rule, int value)
+{
+  switch (rule.compare) {
+    case RULE_BELOW: return value < rule.threshold;
+    case RULE_ABOVE: return value > rule.threshold;
+    default:         return value == rule.threshold;
+  }
+}
+
+bool ZowiRules::rearms(const ZowiRule &rule, int value)
+{
+  long low = (long)rule.threshold - rule.hysteresis;
+  long high = (long)rule.threshold + rule.hysteresis;
+
+  switch (rule.compare) {
+    case RULE_BELOW: return value >= high;
+    case RULE_ABOVE: return value <= low;
+    default:         return value < low || value > high;
+  }
+}
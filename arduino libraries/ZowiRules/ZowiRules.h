@@ -0,0 +1,102 @@
+//--------------------------------------------------------------
+//-- ZowiRules.h
+//-- Reactive behaviours run on the board: sensor rule -> action
+//--------------------------------------------------------------
+//-- A rule is (sensor, comparator, threshold, hysteresis) ->
+//-- (action, argument), e.g. "distance < 15 cm -> gesture 6".
+//-- evaluate() reads every sensor the rules use once and checks
+//-- each rule, so one pass costs O(rules); the sketch calls it
+//-- at a fixed rate (RULES_PERIOD_MS) and the reactions need no
+//-- serial round trip to the phone.
+//--
+//-- A rule fires once when its condition becomes true, then
+//-- waits until the value is back past the threshold by the
+//-- hysteresis before it can fire again:
+//--     RULE_BELOW   fires at value < threshold,
+//--                  rearms at value >= threshold + hysteresis
+//--     RULE_ABOVE   fires at value > threshold,
+//--                  rearms at value <= threshold - hysteresis
+//--     RULE_EQUAL   fires at value == threshold,
+//--                  rearms when more than hysteresis away
+//--
+//-- The library does not know Zowi: the sketch hands it one
+//-- function that reads a sensor and one that runs an action.
+//--
+//-- save() keeps the table in the EEPROM and load() brings it
+//-- back at boot. EEPROM layout at RULES_EEPROM_ADDR:
+//--   magic size rules[RULES_MAX]
+//-- The rules go first and the magic last, and every rule is
+//-- checked again when loaded.
+//--------------------------------------------------------------
+#ifndef ZowiRules_h
+#define ZowiRules_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define RULES_MAX          8
+#define RULES_PERIOD_MS    100
+#define RULES_EEPROM_ADDR  0x100   //-- After ZowiSettings (0x20), before ZowiTrace (0x300)
+#define RULES_MAGIC        'R'
+
+//-- Sensors
+#define RULE_DISTANCE      0       //-- cm, 999 = no echo
+#define RULE_NOISE         1       //-- Noise sensor, 0..1023
+#define RULE_IR            2       //-- Bit 0 left, bit 1 right; 1 = HIGH (no line)
+#define RULE_BATTERY       3       //-- %
+#define RULE_SENSORS       4
+
+//-- Comparators
+#define RULE_BELOW         0
+#define RULE_ABOVE         1
+#define RULE_EQUAL         2
+
+//-- Actions; RULE_NONE marks a free slot
+#define RULE_NONE          0
+#define RULE_GESTURE       1       //-- Argument as in the 'H' command
+#define RULE_SING          2       //-- 'K' command
+#define RULE_MOUTH         3       //-- Predefined mouth number
+#define RULE_MOVE          4       //-- 'M' command movement
+#define RULE_CLIP          5       //-- Name of a clip (ZowiClips)
+#define RULE_ACTIONS       6
+
+struct ZowiRule {
+  uint8_t sensor;
+  uint8_t compare;
+  int16_t threshold;
+  uint8_t hysteresis;
+  uint8_t action;
+  uint8_t arg;
+};
+
+class ZowiRules
+{
+  public:
+    void init(int (*read)(uint8_t sensor), void (*act)(uint8_t action, uint8_t arg));
+
+    bool set(uint8_t slot, const ZowiRule &rule);   //-- false if not valid; action RULE_NONE frees the slot
+    bool get(uint8_t slot, ZowiRule &rule);         //-- false if the slot is free
+    void remove(uint8_t slot);
+    void clear();
+    uint8_t count();
+
+    void evaluate();                                //-- Once every RULES_PERIOD_MS
+
+    bool save();                                    //-- false if nothing changed
+    bool load();                                    //-- false if the EEPROM holds no table
+
+  private:
+    ZowiRule rules[RULES_MAX];
+    uint8_t fired;                  //-- Bit per slot: fired, waiting to rearm
+    int (*read)(uint8_t sensor);
+    void (*act)(uint8_t action, uint8_t arg);
+
+    static bool valid(const ZowiRule &rule);
+    static bool holds(const ZowiRule &rule, int value);
+    static bool rearms(const ZowiRule &rule, int value);
+};
+
+#endif //ZowiRules_h
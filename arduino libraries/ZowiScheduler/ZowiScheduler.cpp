@@ -0,0 +1,187 @@
+//--------------------------------------------------------------
+//-- ZowiScheduler.cpp
+//-- Cooperative task scheduler for the Zowi main loop
+//--------------------------------------------------------------
+#include "ZowiScheduler.h"
+
+ZowiScheduler::ZowiScheduler()
+{
+  for (int8_t i = 0; i < MAXSCHEDULERTASKS; i++) {
+    tasks[i].function = NULL;
+    tasks[i].active = false;
+  }
+  lastRun = 0;
+  maxLatency = 0;
+}
+
+bool ZowiScheduler::valid(int8_t task)
+{
+  return task >= 0 && task < MAXSCHEDULERTASKS && tasks[task].function != NULL;
+}
+
+int8_t ZowiScheduler::add(void (*function)(), unsigned long period, unsigned long delay, uint8_t priority, unsigned long deadline)
+{
+  for (int8_t i = 0; i < MAXSCHEDULERTASKS; i++) {
+    if (tasks[i].function == NULL) {
+      tasks[i].function = function;
+      tasks[i].period = period;
+      tasks[i].deadline = deadline;
+      tasks[i].priority = priority;
+      tasks[i].maxRunTime = 0;
+      tasks[i].maxLateness = 0;
+      tasks[i].misses = 0;
+      start(i, delay);
+      return i;
+    }
+  }
+  return NO_TASK;
+}
+
+//---------------------------------------------------------
+//-- Periodic task: runs every period ms, first run after one period
+//---------------------------------------------------------
+int8_t ZowiScheduler::addPeriodic(void (*function)(), unsigned long period, uint8_t priority, unsigned long deadline)
+{
+  return add(function, period, period, priority, deadline);
+}
+
+//---------------------------------------------------------
+//-- One-shot task: runs once, delay ms from now. It stays
+//-- registered and can be re-armed with start()
+//---------------------------------------------------------
+int8_t ZowiScheduler::addOneShot(void (*function)(), unsigned long delay, uint8_t priority, unsigned long deadline)
+{
+  return add(function, 0, delay, priority, deadline);
+}
+
+void ZowiScheduler::remove(int8_t task)
+{
+  if (valid(task)) {
+    tasks[task].function = NULL;
+    tasks[task].active = false;
+  }
+}
+
+void ZowiScheduler::start(int8_t task, unsigned long delay)
+{
+  if (valid(task)) {
+    tasks[task].release = millis() + delay;
+    tasks[task].active = true;
+  }
+}
+
+void ZowiScheduler::stop(int8_t task)
+{
+  if (valid(task)) tasks[task].active = false;
+}
+
+bool ZowiScheduler::isActive(int8_t task)
+{
+  return valid(task) && tasks[task].active;
+}
+
+//---------------------------------------------------------
+//-- Run every due task once, highest priority first. Among
+//-- tasks with the same priority the earliest release wins.
+//-- Call it from loop() as often as possible.
+//---------------------------------------------------------
+void ZowiScheduler::run()
+{
+  unsigned long startUs = micros();
+  if (lastRun != 0 && startUs - lastRun > maxLatency) maxLatency = startUs - lastRun;
+  lastRun = startUs;
+
+  uint16_t done = 0;
+
+  for (;;) {
+    unsigned long now = millis();
+    int8_t next = NO_TASK;
+
+    for (int8_t i = 0; i < MAXSCHEDULERTASKS; i++) {
+      Task &t = tasks[i];
+      if (!t.active || (done & (1 << i)) || (long)(now - t.release) < 0) continue;
+      if (next == NO_TASK || t.priority < tasks[next].priority ||
+          (t.priority == tasks[next].priority && (long)(t.release - tasks[next].release) < 0)) {
+        next = i;
+      }
+    }
+
+    if (next == NO_TASK) break;
+
+    Task &t = tasks[next];
+    unsigned long lateness = now - t.release;
+    if (lateness > t.maxLateness) t.maxLateness = lateness;
+    if (t.deadline != 0 && lateness > t.deadline) t.misses++;
+
+    //-- Compute the next release before running, so the task can stop or re-arm itself
+    if (t.period == 0) {
+      t.active = false;
+    } else {
+      t.release += t.period;
+      if ((long)(now - t.release) >= 0) t.release = now + t.period;   //-- Overrun: skip missed periods
+    }
+    done |= 1 << next;
+
+    unsigned long taskStart = micros();
+    t.function();
+    unsigned long runTime = micros() - taskStart;
+    if (runTime > t.maxRunTime) t.maxRunTime = runTime;
+  }
+}
+
+//---------------------------------------------------------
+//-- Time until the earliest active task is due, capped to
+//-- limit. Used to sleep between tasks
+//---------------------------------------------------------
+unsigned long ZowiScheduler::timeToNext(unsigned long limit)
+{
+  unsigned long now = millis();
+  unsigned long next = limit;
+
+  for (int8_t i = 0; i < MAXSCHEDULERTASKS; i++) {
+    Task &t = tasks[i];
+    if (!t.active) continue;
+    if ((long)(t.release - now) <= 0) return 0;
+    if (t.release - now < next) next = t.release - now;
+  }
+  return next;
+}
+
+//---------------------------------------------------------
+//-- Call after sleeping: the time asleep is not loop latency
+//---------------------------------------------------------
+void ZowiScheduler::wake()
+{
+  lastRun = 0;
+}
+
+unsigned long ZowiScheduler::getMaxLatency()
+{
+  return maxLatency;
+}
+
+unsigned long ZowiScheduler::getMaxRunTime(int8_t task)
+{
+  return valid(task) ? tasks[task].maxRunTime : 0;
+}
+
+unsigned long ZowiScheduler::getMaxLateness(int8_t task)
+{
+  return valid(task) ? tasks[task].maxLateness : 0;
+}
+
+unsigned int ZowiScheduler::getDeadlineMisses(int8_t task)
+{
+  return valid(task) ? tasks[task].misses : 0;
+}
+
+void ZowiScheduler::resetStats()
+{
+  for (int8_t i = 0; i < MAXSCHEDULERTASKS; i++) {
+    tasks[i].maxRunTime = 0;
+    tasks[i].maxLateness = 0;
+    tasks[i].misses = 0;
+  }
+  maxLatency = 0;
+  lastRun = 0;
+}
@@ -0,0 +1,82 @@
+//--------------------------------------------------------------
+//-- ZowiScheduler.h
+//-- Cooperative task scheduler for the Zowi main loop
+//--------------------------------------------------------------
+//-- Tasks are plain functions that must return quickly. Each
+//-- one is periodic or one-shot, has a priority and an optional
+//-- deadline, and the scheduler keeps the timing statistics
+//-- needed to bound the worst-case loop latency.
+//--------------------------------------------------------------
+#ifndef ZowiScheduler_h
+#define ZowiScheduler_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define MAXSCHEDULERTASKS 8
+
+//-- Task priorities, one per Zowi subsystem (lower runs first)
+#define TASK_MOTION   0
+#define TASK_SERIAL   1
+#define TASK_SENSOR   2
+#define TASK_SOUND    3
+#define TASK_MOUTH    4
+#define TASK_IDLE     5
+
+#define NO_TASK      -1
+
+class ZowiScheduler
+{
+  public:
+    ZowiScheduler();
+
+    //-- Task registration: return the task id, or NO_TASK if the table is full
+    int8_t addPeriodic(void (*function)(), unsigned long period, uint8_t priority, unsigned long deadline=0);
+    int8_t addOneShot(void (*function)(), unsigned long delay, uint8_t priority, unsigned long deadline=0);
+    void remove(int8_t task);
+
+    //-- Task control
+    void start(int8_t task, unsigned long delay=0);   //-- (Re)arm the task: first run in delay ms
+    void stop(int8_t task);
+    bool isActive(int8_t task);
+
+    //-- Main entry point: runs every due task once, highest priority first
+    void run();
+
+    //-- Idle support: ms until the next active task is due (0 = now),
+    //-- and wake() to tell the scheduler the loop has been asleep
+    unsigned long timeToNext(unsigned long limit=0xFFFFFFFF);
+    void wake();
+
+    //-- Timing statistics
+    unsigned long getMaxLatency();               //-- Worst time between two run() calls (us)
+    unsigned long getMaxRunTime(int8_t task);    //-- Longest execution of the task (us)
+    unsigned long getMaxLateness(int8_t task);   //-- Worst delay from release to start (ms)
+    unsigned int getDeadlineMisses(int8_t task);
+    void resetStats();
+
+  private:
+    struct Task {
+      void (*function)();
+      unsigned long period;      //-- 0 = one-shot
+      unsigned long deadline;    //-- 0 = no deadline
+      unsigned long release;     //-- millis() at which the task is due
+      unsigned long maxRunTime;
+      unsigned long maxLateness;
+      unsigned int misses;
+      uint8_t priority;
+      bool active;
+    };
+
+    Task tasks[MAXSCHEDULERTASKS];
+    unsigned long lastRun;
+    unsigned long maxLatency;
+
+    int8_t add(void (*function)(), unsigned long period, unsigned long delay, uint8_t priority, unsigned long deadline);
+    bool valid(int8_t task);
+};
+
+#endif //ZowiScheduler_h
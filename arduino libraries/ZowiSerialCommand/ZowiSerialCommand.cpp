@@ -22,6 +22,8 @@ ZowiSerialCommand::ZowiSerialCommand()
 	strncpy(delim," ",MAXDELIMETER);  // strtok_r needs a null-terminated string
 	term='\r';   // return character, default terminator for commands
 	numCommand=0;    // Number of callback handlers installed
+	replyLen=0;
+	droppedReplies=0;
 	clearBuffer(); 
 }
 
@@ -57,9 +59,6 @@ void ZowiSerialCommand::readSerial()
 	// If we're using the Hardware port, check it.   Otherwise check the user-created ZowiSoftwareSerial Port
 	while ((Serial.available() > 0)&&(onlyOneCommand==true))
 	{
-		int i; 
-		boolean matched; 
-		
 			inChar=Serial.read();   // Read single available character, there may be more waiting
 		
 		if (inChar==term) {     // Check for the terminator (default '\r') meaning end of command
@@ -67,26 +66,7 @@ void ZowiSerialCommand::readSerial()
 			onlyOneCommand=false; //
 			
 			bufPos=0;           // Reset to start of buffer
-			token = strtok_r(buffer,delim,&last);   // Search for command at start of buffer
-			if (token == NULL) return; 
-			matched=false; 
-			for (i=0; i<numCommand; i++) {
-				
-				// Compare the found command against the list of known commands for a match
-				if (strncmp(token,CommandList[i].command,SERIALCOMMANDBUFFER) == 0) 
-				{
-					
-					// Execute the stored handler function for the command
-					(*CommandList[i].function)(); 
-					clearBuffer(); 
-					matched=true; 
-					break; 
-				}
-			}
-			if (matched==false) {
-				(*defaultHandler)(); 
-				clearBuffer(); 
-			}
+			if (!dispatch()) return; 
 
 		}
 		if (isprint(inChar))   // Only printable characters into the buffer
@@ -98,6 +78,48 @@ void ZowiSerialCommand::readSerial()
 	}
 }
 
+// Runs a complete command line (without the terminator) as if it had been
+// received: used to script commands and by the benchmarks, which cannot feed
+// the UART. Lines longer than the buffer are truncated.
+void ZowiSerialCommand::runCommand(const char *line)
+{
+	strncpy(buffer,line,SERIALCOMMANDBUFFER-1);
+	buffer[SERIALCOMMANDBUFFER-1]='\0';
+	bufPos=0;
+	inChar=term;
+	dispatch();
+}
+
+// Looks up the command at the start of the buffer and calls its handler (or the
+// default handler). Returns false if the buffer held no command at all
+bool ZowiSerialCommand::dispatch()
+{
+	int i; 
+	boolean matched; 
+
+	token = strtok_r(buffer,delim,&last);   // Search for command at start of buffer
+	if (token == NULL) return false; 
+	matched=false; 
+	for (i=0; i<numCommand; i++) {
+		
+		// Compare the found command against the list of known commands for a match
+		if (strncmp(token,CommandList[i].command,SERIALCOMMANDBUFFER) == 0) 
+		{
+			
+			// Execute the stored handler function for the command
+			(*CommandList[i].function)(); 
+			clearBuffer(); 
+			matched=true; 
+			break; 
+		}
+	}
+	if (matched==false) {
+		(*defaultHandler)(); 
+		clearBuffer(); 
+	}
+	return true;
+}
+
 // Adds a "command" and a handler function to the list of available commands.  
 // This is used for matching a found token in the buffer, and gives the pointer
 // to the handler function to deal with it. 
@@ -105,7 +127,7 @@ void ZowiSerialCommand::addCommand(const char *command, void (*function)())
 {
 	if (numCommand < MAXSERIALCOMMANDS) {
 				
-		strncpy(CommandList[numCommand].command,command,SERIALCOMMANDBUFFER); 
+		CommandList[numCommand].command = command; 
 		CommandList[numCommand].function = function; 
 		numCommand++; 
 	} 
@@ -116,4 +138,113 @@ void ZowiSerialCommand::addCommand(const char *command, void (*function)())
 void ZowiSerialCommand::addDefaultHandler(void (*function)())
 {
 	defaultHandler = function;
-}
\ No newline at end of file
+}
+
+
+// Starts a new reply in the reply buffer: "&&" followed by the reply type letter.
+// Values are added with appendReply() and the reply is queued with sendReply().
+void ZowiSerialCommand::beginReply(char type)
+{
+	replyLen=0;
+	appendReplyChar('&');
+	appendReplyChar('&');
+	appendReplyChar(type);
+}
+
+void ZowiSerialCommand::appendReplyChar(char c)
+{
+	if (replyLen < SERIALREPLYBUFFER) {
+		reply[replyLen++]=c;
+	} else {
+		replyLen=SERIALREPLYBUFFER+1;   // Overflowed: the reply will be dropped
+	}
+}
+
+// Appends a space and a string value to the reply being built
+void ZowiSerialCommand::appendReply(const char *value)
+{
+	appendReplyChar(' ');
+	while (*value) appendReplyChar(*value++);
+}
+
+void ZowiSerialCommand::appendReply(const __FlashStringHelper *value)
+{
+	const char *p=reinterpret_cast<const char *>(value);
+	char c;
+
+	appendReplyChar(' ');
+	while ((c=pgm_read_byte(p++)) != '\0') appendReplyChar(c);
+}
+
+// Appends a space and an integer value. With decimals > 0 the value is printed
+// as a fixed-point number: appendReply(7936, 2) appends " 79.36"
+void ZowiSerialCommand::appendReply(long value, uint8_t decimals)
+{
+	char digits[12];
+	uint8_t n=0;
+	unsigned long u;
+
+	appendReplyChar(' ');
+	if (value < 0) {
+		appendReplyChar('-');
+		u=-(unsigned long)value;
+	} else {
+		u=value;
+	}
+
+	do {
+		digits[n++]='0' + (u % 10);
+		u/=10;
+	} while ((u != 0 || n <= decimals) && n < sizeof(digits));
+
+	while (n > 0) {
+		if (n == decimals) appendReplyChar('.');
+		appendReplyChar(digits[--n]);
+	}
+}
+
+// Closes the reply with "%%\r\n" and hands it to the serial TX buffer in one write.
+// If the TX buffer does not have room for the whole reply, the reply is dropped
+// and counted instead of waiting for the buffer to drain.
+bool ZowiSerialCommand::sendReply()
+{
+	appendReplyChar('%');
+	appendReplyChar('%');
+	appendReplyChar('\r');
+	appendReplyChar('\n');
+
+	if (replyLen > SERIALREPLYBUFFER || Serial.availableForWrite() < replyLen) {
+		droppedReplies++;
+		replyLen=0;
+		return false;
+	}
+
+	Serial.write((const uint8_t *)reply, replyLen);
+	replyLen=0;
+	return true;
+}
+
+bool ZowiSerialCommand::sendReply(char type)
+{
+	beginReply(type);
+	return sendReply();
+}
+
+bool ZowiSerialCommand::sendReply(char type, const char *value)
+{
+	beginReply(type);
+	appendReply(value);
+	return sendReply();
+}
+
+bool ZowiSerialCommand::sendReply(char type, long value, uint8_t decimals)
+{
+	beginReply(type);
+	appendReply(value, decimals);
+	return sendReply();
+}
+
+unsigned int ZowiSerialCommand::getDroppedReplies()
+{
+	return droppedReplies;
+}
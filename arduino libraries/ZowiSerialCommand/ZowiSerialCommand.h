@@ -22,8 +22,9 @@
 
 
 #define SERIALCOMMANDBUFFER 35  //16 after changed by me
-#define MAXSERIALCOMMANDS	14
+#define MAXSERIALCOMMANDS	24
 #define MAXDELIMETER 2
+#define SERIALREPLYBUFFER 32    // Longest reply: "&&" + letter + values + "%%\r\n"
 
 class ZowiSerialCommand
 {
@@ -33,8 +34,20 @@ class ZowiSerialCommand
 		void clearBuffer();   // Sets the command buffer to all '\0' (nulls)
 		char *next();         // returns pointer to next token found in command buffer (for getting arguments to commands)
 		void readSerial();    // Main entry point.  
-		void addCommand(const char *, void(*)());   // Add commands to processing dictionary
+		void runCommand(const char *line);   // Runs a whole command line as if received (scripts, benchmarks)
+		void addCommand(const char *, void(*)());   // Add commands to processing dictionary (the name is not copied: pass a literal)
 		void addDefaultHandler(void (*function)());    // A handler to call when no valid command received. 
+
+		// Reply builder: "&&<type> <value> <value>%%\r\n" formatted in RAM and queued with a single write
+		void beginReply(char type);                    // Starts a new reply ("&&" + type)
+		void appendReply(const char *value);           // Appends " value"
+		void appendReply(const __FlashStringHelper *value);
+		void appendReply(long value, uint8_t decimals=0);   // Appends " value", e.g. (7936, 2) -> " 79.36"
+		bool sendReply();                              // Closes the reply and queues it. Never blocks: false if dropped
+		bool sendReply(char type);                     // Shorthand for replies without values (acks)
+		bool sendReply(char type, const char *value);
+		bool sendReply(char type, long value, uint8_t decimals=0);
+		unsigned int getDroppedReplies();              // Replies dropped because the TX buffer was full
 	
 	private:
 		char inChar;          // A character read from the serial stream 
@@ -45,13 +58,18 @@ class ZowiSerialCommand
 		char *token;                        // Returned token from the command buffer as returned by strtok_r
 		char *last;                         // State variable used by strtok_r during processing
 		typedef struct _callback {
-			char command[SERIALCOMMANDBUFFER];
+			const char *command;            // Points to the caller's string, not a copy
 			void (*function)();
 		} ZowiSerialCommandCallback;            // Data structure to hold Command/Handler function key-value pairs
 		int numCommand;
 		ZowiSerialCommandCallback CommandList[MAXSERIALCOMMANDS];   // Actual definition for command/handler array
 		void (*defaultHandler)();           // Pointer to the default handler function 
 		int usingZowiSoftwareSerial;            // Used as boolean to see if we're using ZowiSoftwareSerial object or not
+		char reply[SERIALREPLYBUFFER];      // Reply being built
+		uint8_t replyLen;                   // Bytes used in reply (SERIALREPLYBUFFER+1 = overflowed)
+		unsigned int droppedReplies;        // Replies that did not fit in the reply or TX buffer
+		void appendReplyChar(char c);
+		bool dispatch();                    // Runs the command in the buffer
 
 };
 
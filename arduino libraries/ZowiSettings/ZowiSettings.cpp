@@ -0,0 +1,150 @@
+//--------------------------------------------------------------
+//-- ZowiSettings.cpp
+//-- Versioned, CRC protected configuration kept in the EEPROM
+//--------------------------------------------------------------
+#include "ZowiSettings.h"
+#include <EEPROM.h>
+
+//-- Calibration of the ZOWI_BASE_v2 colour sensor: green, blue,
+//-- red, black, black (dark), yellow
+static const uint8_t defaultColors[SETTINGS_COLORS][3] PROGMEM = {
+  { 73,  95,  94},
+  { 78, 112, 110},
+  {173,  73,  73},
+  { 15,  15,  15},
+  { 43,  34,  35},
+  {237, 180, 177},
+};
+
+uint8_t ZowiSettings::load()
+{
+  defaults();
+
+  //-- A board fresh from the factory tool
+  if (EEPROM.read(SETTINGS_LEGACY_NAME) == SETTINGS_FACTORY_NAME) {
+    data.name[0] = SETTINGS_FACTORY_NAME;
+    data.name[1] = '\0';
+    save();
+    EEPROM.update(SETTINGS_LEGACY_NAME, SETTINGS_FIRST_NAME);
+    return status = SETTINGS_FACTORY;
+  }
+
+  //-- First boot with this library
+  if (EEPROM.read(SETTINGS_EEPROM_ADDR) != SETTINGS_MAGIC) {
+    importLegacy();
+    save();
+    return status = SETTINGS_IMPORTED;
+  }
+
+  uint8_t version = EEPROM.read(SETTINGS_EEPROM_ADDR + 1);
+  uint8_t size = EEPROM.read(SETTINGS_EEPROM_ADDR + 2);
+  uint16_t stored = EEPROM.read(SETTINGS_EEPROM_ADDR + 3) | (EEPROM.read(SETTINGS_EEPROM_ADDR + 4) << 8);
+
+  uint16_t check = 0xFFFF;
+  for (uint8_t i = 0; i < size; i++) check = crc(check, EEPROM.read(SETTINGS_EEPROM_ADDR + SETTINGS_HEADER_BYTES + i));
+  if (size == 0 || check != stored) return status = SETTINGS_CORRUPT;
+
+  //-- A shorter record from an older version keeps the defaults
+  //-- of the fields it does not have
+  uint8_t *bytes = (uint8_t *)&data;
+  for (uint8_t i = 0; i < size && i < sizeof(data); i++) bytes[i] = EEPROM.read(SETTINGS_EEPROM_ADDR + SETTINGS_HEADER_BYTES + i);
+  data.name[SETTINGS_NAME_LENGTH] = '\0';
+
+  if (version != SETTINGS_VERSION || size != sizeof(data)) save();
+  return status = SETTINGS_OK;
+}
+
+ZowiSettingsData &ZowiSettings::get()
+{
+  return data;
+}
+
+//---------------------------------------------------------
+//-- The data goes first and the header last: a save cut
+//-- short by a reset leaves a CRC that does not match
+//---------------------------------------------------------
+bool ZowiSettings::save()
+{
+  unsigned int before = writes;
+  const uint8_t *bytes = (const uint8_t *)&data;
+  uint16_t check = 0xFFFF;
+
+  for (uint8_t i = 0; i < sizeof(data); i++) {
+    update(SETTINGS_EEPROM_ADDR + SETTINGS_HEADER_BYTES + i, bytes[i]);
+    check = crc(check, bytes[i]);
+  }
+  update(SETTINGS_EEPROM_ADDR + 1, SETTINGS_VERSION);
+  update(SETTINGS_EEPROM_ADDR + 2, sizeof(data));
+  update(SETTINGS_EEPROM_ADDR + 3, check & 0xFF);
+  update(SETTINGS_EEPROM_ADDR + 4, check >> 8);
+  update(SETTINGS_EEPROM_ADDR, SETTINGS_MAGIC);
+
+  return writes != before;
+}
+
+void ZowiSettings::reset()
+{
+  char name[SETTINGS_NAME_LENGTH + 1];
+
+  memcpy(name, data.name, sizeof(name));
+  defaults();
+  memcpy(data.name, name, sizeof(name));
+}
+
+uint8_t ZowiSettings::getStatus()
+{
+  return status;
+}
+
+unsigned int ZowiSettings::getWrites()
+{
+  return writes;
+}
+
+void ZowiSettings::defaults()
+{
+  memset(&data, 0, sizeof(data));
+  memcpy_P(data.colors, defaultColors, sizeof(data.colors));
+  data.obstacleDistance = 15;
+  data.sleepTime = 80;
+  data.batteryLow = 45;
+  data.batteryCritical = 15;
+}
+
+//---------------------------------------------------------
+//-- Trims at 0..1 and a name of up to 10 printable
+//-- characters at 5. A trim of -1 is stored as 0xFF, as an
+//-- erased cell: only a block erased as a whole is unset
+//---------------------------------------------------------
+void ZowiSettings::importLegacy()
+{
+  uint8_t i = 0;
+  while (i < SETTINGS_LEGACY_BYTES && EEPROM.read(i) == 0xFF) i++;
+  if (i == SETTINGS_LEGACY_BYTES) return;
+
+  for (i = 0; i < 2; i++) data.trims[i] = (int8_t)EEPROM.read(SETTINGS_LEGACY_TRIMS + i);
+
+  for (uint8_t i = 0; i < SETTINGS_NAME_LENGTH; i++) {
+    char c = EEPROM.read(SETTINGS_LEGACY_NAME + i);
+    if (!isprint(c)) break;
+    data.name[i] = c;
+  }
+}
+
+void ZowiSettings::update(int addr, uint8_t value)
+{
+  if (EEPROM.read(addr) != value) {
+    EEPROM.write(addr, value);
+    writes++;
+  }
+}
+
+//-- CRC-16/CCITT (polynomial 0x1021), one byte at a time
+uint16_t ZowiSettings::crc(uint16_t crc, uint8_t value)
+{
+  crc ^= (uint16_t)value << 8;
+  for (uint8_t bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
@@ -0,0 +1,88 @@
+//--------------------------------------------------------------
+//-- ZowiSettings.h
+//-- Versioned, CRC protected configuration kept in the EEPROM
+//--------------------------------------------------------------
+//-- load() reads the settings once at boot into a RAM copy; the
+//-- sketch reads and edits that copy with get() and writes it
+//-- back with save(), which only rewrites the bytes that changed.
+//--
+//-- EEPROM layout at SETTINGS_EEPROM_ADDR:
+//--   magic version size crc(2, little endian) data[size]
+//-- The CRC covers data. A bad CRC is reported as
+//-- SETTINGS_CORRUPT and the defaults are used instead.
+//-- New fields must be added at the end of ZowiSettingsData:
+//-- a shorter record from an older version is loaded and the
+//-- new fields get their defaults.
+//--
+//-- The old firmwares stored the trims at 0..1 and the name at
+//-- 5..15; they are imported the first time. The factory tool
+//-- still marks a new board with '$' at address 5: load() then
+//-- starts from the defaults with the name "$".
+//--------------------------------------------------------------
+#ifndef ZowiSettings_h
+#define ZowiSettings_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define SETTINGS_EEPROM_ADDR   0x20    //-- After the old layout (0..15), before ZowiTrace (0x300)
+#define SETTINGS_MAGIC         'Z'
+#define SETTINGS_VERSION       1
+#define SETTINGS_HEADER_BYTES  5
+
+#define SETTINGS_NAME_LENGTH   10      //-- Without the '\0'
+#define SETTINGS_COLORS        6       //-- Calibrated colours (R, G, B)
+
+//-- Old layout
+#define SETTINGS_LEGACY_BYTES  16
+#define SETTINGS_LEGACY_TRIMS  0
+#define SETTINGS_LEGACY_NAME   5
+#define SETTINGS_FACTORY_NAME  '$'
+#define SETTINGS_FIRST_NAME    '#'
+
+//-- load() results
+#define SETTINGS_OK            0
+#define SETTINGS_IMPORTED      1       //-- First boot with this library: old layout imported
+#define SETTINGS_FACTORY       2       //-- Marked by the factory tool: defaults
+#define SETTINGS_CORRUPT       3       //-- Bad CRC or header: defaults
+
+//-- User settings flags
+#define SETTINGS_FLAG_MUTE     0x01
+
+struct ZowiSettingsData {
+  int8_t  trims[2];                        //-- Left, right servo
+  char    name[SETTINGS_NAME_LENGTH + 1];
+  uint8_t colors[SETTINGS_COLORS][3];      //-- TCS3200 readings of each colour
+  uint8_t obstacleDistance;                //-- cm
+  uint8_t sleepTime;                       //-- s before falling asleep in MODE 0
+  uint8_t flags;
+  uint8_t batteryLow;                      //-- % (BatReader levels)
+  uint8_t batteryCritical;                 //-- %
+};
+
+class ZowiSettings
+{
+  public:
+    uint8_t load();                     //-- Once at boot; returns SETTINGS_OK, _IMPORTED...
+    ZowiSettingsData &get();            //-- The RAM copy, edit it and save()
+    bool save();                        //-- false if nothing changed
+    void reset();                       //-- Defaults in RAM (keeps the name); save() to store them
+
+    uint8_t getStatus();                //-- Result of load()
+    unsigned int getWrites();           //-- EEPROM cells written since boot
+
+  private:
+    ZowiSettingsData data;
+    uint8_t status;
+    unsigned int writes;
+
+    void defaults();
+    void importLegacy();
+    void update(int addr, uint8_t value);
+    static uint16_t crc(uint16_t crc, uint8_t value);
+};
+
+#endif //ZowiSettings_h
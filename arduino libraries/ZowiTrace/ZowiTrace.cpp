@@ -0,0 +1,118 @@
+//--------------------------------------------------------------
+//-- ZowiTrace.cpp
+//-- Event trace ring buffer for post-mortem analysis
+//--------------------------------------------------------------
+#include "ZowiTrace.h"
+#include <EEPROM.h>
+#include <util/atomic.h>
+
+#define TRACE_MAGIC  'T'
+
+ZowiTrace Trace;
+
+void ZowiTrace::record(uint8_t id, uint16_t payload)
+{
+  unsigned long now = micros();
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    ZowiTraceRecord &r = records[head];
+    r.time = now;
+    r.id = id;
+    r.payload = payload;
+    head = (head + 1) & (TRACE_SIZE - 1);
+    if (used < TRACE_SIZE) used++;
+  }
+}
+
+uint8_t ZowiTrace::count()
+{
+  return used;
+}
+
+bool ZowiTrace::get(uint8_t index, ZowiTraceRecord &record)
+{
+  bool found = false;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (index < used) {
+      record = records[(head - used + index) & (TRACE_SIZE - 1)];
+      found = true;
+    }
+  }
+  return found;
+}
+
+void ZowiTrace::clear()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    head = 0;
+    used = 0;
+  }
+}
+
+static void pack(const ZowiTraceRecord &r, uint8_t *bytes)
+{
+  bytes[0] = r.time;
+  bytes[1] = r.time >> 8;
+  bytes[2] = r.time >> 16;
+  bytes[3] = r.time >> 24;
+  bytes[4] = r.id;
+  bytes[5] = r.payload;
+  bytes[6] = r.payload >> 8;
+}
+
+void ZowiTrace::dump(Print &out)
+{
+  uint8_t n = used;
+  uint8_t bytes[TRACE_RECORD_BYTES];
+  ZowiTraceRecord r;
+
+  out.print(F("&&X"));
+  out.write(n);
+  out.write((uint8_t)TRACE_RECORD_BYTES);
+  for (uint8_t i = 0; i < n; i++) {
+    if (!get(i, r)) r.time = r.id = r.payload = 0;   //-- Cleared meanwhile: keep the length
+    pack(r, bytes);
+    out.write(bytes, TRACE_RECORD_BYTES);
+  }
+  out.print(F("%%\r\n"));
+}
+
+//---------------------------------------------------------
+//-- EEPROM layout at TRACE_EEPROM_ADDR:
+//--   magic count recordBytes record[count]
+//-- Only changed bytes are written
+//---------------------------------------------------------
+void ZowiTrace::snapshot()
+{
+  uint8_t n = used;
+  uint8_t bytes[TRACE_RECORD_BYTES];
+  ZowiTraceRecord r;
+  int addr = TRACE_EEPROM_ADDR + 3;
+
+  EEPROM.update(TRACE_EEPROM_ADDR, 0);    //-- Invalid until complete
+  for (uint8_t i = 0; i < n; i++) {
+    if (!get(i, r)) break;
+    pack(r, bytes);
+    for (uint8_t b = 0; b < TRACE_RECORD_BYTES; b++) EEPROM.update(addr++, bytes[b]);
+  }
+  EEPROM.update(TRACE_EEPROM_ADDR + 1, n);
+  EEPROM.update(TRACE_EEPROM_ADDR + 2, TRACE_RECORD_BYTES);
+  EEPROM.update(TRACE_EEPROM_ADDR, TRACE_MAGIC);
+}
+
+//-- With no snapshot the frame still goes out, with count 0
+bool ZowiTrace::dumpSnapshot(Print &out)
+{
+  uint8_t n = EEPROM.read(TRACE_EEPROM_ADDR + 1);
+  bool found = EEPROM.read(TRACE_EEPROM_ADDR) == TRACE_MAGIC &&
+               n <= TRACE_SIZE && EEPROM.read(TRACE_EEPROM_ADDR + 2) == TRACE_RECORD_BYTES;
+  if (!found) n = 0;
+
+  out.print(F("&&X"));
+  out.write(n);
+  out.write((uint8_t)TRACE_RECORD_BYTES);
+  for (int i = 0; i < n * TRACE_RECORD_BYTES; i++) out.write(EEPROM.read(TRACE_EEPROM_ADDR + 3 + i));
+  out.print(F("%%\r\n"));
+  return found;
+}
@@ -0,0 +1,71 @@
+//--------------------------------------------------------------
+//-- ZowiTrace.h
+//-- Event trace ring buffer for post-mortem analysis
+//--------------------------------------------------------------
+//-- Every record is a micros() timestamp, an event id and a
+//-- 16 bit payload. The last TRACE_SIZE records are kept in RAM;
+//-- record() only takes a few us with interrupts off, so it can
+//-- be called from interrupt handlers.
+//--
+//-- snapshot() copies the ring to the end of the EEPROM so it
+//-- survives a reset (call it when a fault is detected).
+//--
+//-- Binary dump format (dump() and dumpSnapshot()):
+//--   "&&X" count recordBytes record[count] "%%\r\n"
+//--   record = time (4 bytes) id (1 byte) payload (2 bytes),
+//--            little endian, oldest first
+//-- With no snapshot on the EEPROM, dumpSnapshot() sends count 0.
+//--------------------------------------------------------------
+#ifndef ZowiTrace_h
+#define ZowiTrace_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include "WProgram.h"
+#endif
+
+#define TRACE_SIZE          32      //-- Must be a power of 2
+#define TRACE_RECORD_BYTES  7
+#define TRACE_EEPROM_ADDR   0x300   //-- Last 256 bytes of the EEPROM (3 + TRACE_SIZE*7 used)
+
+//-- Event ids (0x80 and up are free for the sketches)
+#define TRACE_BOOT          0x01    //-- payload: MCUSR (reset cause)
+#define TRACE_COMMAND       0x02    //-- payload: command letter, first argument
+#define TRACE_MODE          0x03    //-- payload: new mode
+#define TRACE_BUTTON        0x04    //-- payload: event type << 8 | buttons
+#define TRACE_SENSOR        0x05    //-- payload: sensor value that crossed a threshold
+#define TRACE_MOTION_START  0x06    //-- payload: duration (ms)
+#define TRACE_MOTION_STOP   0x07    //-- payload: 1 = cancelled
+#define TRACE_SOUND         0x08    //-- payload: song or gesture id
+#define TRACE_FAULT         0x09    //-- payload: fault code
+#define TRACE_READY         0x0A    //-- payload: ms from the start to the end of setup()
+#define TRACE_USER          0x80
+
+struct ZowiTraceRecord {
+  uint32_t time;      //-- micros()
+  uint8_t  id;
+  uint16_t payload;
+};
+
+class ZowiTrace
+{
+  public:
+    void record(uint8_t id, uint16_t payload=0);
+    uint8_t count();
+    bool get(uint8_t index, ZowiTraceRecord &record);   //-- 0 = oldest
+    void clear();
+
+    void dump(Print &out);             //-- Blocks until the dump is queued
+    void snapshot();                   //-- RAM ring -> EEPROM (slow: up to 3.3 ms per changed byte)
+    bool dumpSnapshot(Print &out);     //-- false if the EEPROM holds no snapshot (empty frame sent)
+
+  private:
+    ZowiTraceRecord records[TRACE_SIZE];
+    volatile uint8_t head;             //-- Next record to write
+    volatile uint8_t used;
+};
+
+extern ZowiTrace Trace;
+
+#endif //ZowiTrace_h
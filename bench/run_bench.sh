@@ -0,0 +1,135 @@
+#!/bin/bash
+#----------------------------------------------------------------
+#-- run_bench.sh
+#-- Build the benchmark sketch, run it in simavr and compare the
+#-- cycles, stack and flash figures with bench/baseline.txt
+#----------------------------------------------------------------
+#-- Usage: bench/run_bench.sh [--update] [--tolerance percent]
+#--
+#--   --update     write the results as the new baseline (the
+#--                first run, with no baseline yet, writes it too)
+#--   --tolerance  allowed growth of any figure (default 3 %)
+#--
+#-- Needs arduino-cli (with the arduino:avr core), simavr and
+#-- avr-size/avr-nm in the PATH. Exits with 1 when a figure grew
+#-- more than the tolerance, so it can gate a release.
+#--
+#-- Baseline lines (whitespace separated):
+#--   bench <name> <min cycles> <avg cycles> <stack bytes>
+#--   flash <symbol> <bytes>
+#--   image <name> <flash bytes> <ram bytes>
+#-- "-" marks a figure that is not measured.
+#----------------------------------------------------------------
+set -e
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+BENCH="$ROOT/bench"
+BASELINE="$BENCH/baseline.txt"
+FQBN="${ZOWI_FQBN:-arduino:avr:nano:cpu=atmega328}"
+OUT="${ZOWI_BENCH_OUT:-/tmp/zowi_bench}"
+UPDATE=0
+TOLERANCE=3
+
+while [ $# -gt 0 ]; do
+  case "$1" in
+    --update) UPDATE=1 ;;
+    --tolerance) shift; TOLERANCE="$1" ;;
+    *) echo "usage: $0 [--update] [--tolerance percent]" >&2; exit 2 ;;
+  esac
+  shift
+done
+
+for tool in arduino-cli simavr avr-size avr-nm; do
+  command -v "$tool" >/dev/null || { echo "run_bench: $tool not found" >&2; exit 2; }
+done
+
+#-- Functions whose code size is tracked. With LTO some of them may
+#-- be inlined into their callers; they are then reported as "-"
+SYMBOLS=(
+  "Oscillator::refresh()"
+  "LedMatrix::sendMemory()"
+  "ZowiSerialCommand::readSerial()"
+  "ZowiSerialCommand::dispatch()"
+  "returnColor(int*)"
+  "Zowi::bendTonesQ12(unsigned int, unsigned int, unsigned int, long, int)"
+  "Zowi::_tone(unsigned int, long, int)"
+  "Zowi::getMouthShape(int)"
+  "fix_sin(unsigned int)"
+  "fix_recip(unsigned int)"
+)
+
+compile() {   # sketch_dir build_dir
+  arduino-cli compile --fqbn "$FQBN" --libraries "$ROOT/arduino libraries" \
+    --build-path "$2" "$1" >"$2.log" 2>&1 || { cat "$2.log" >&2; exit 2; }
+}
+
+RESULTS="$OUT/results.txt"
+mkdir -p "$OUT"
+: >"$RESULTS"
+
+#-- 1. Hot paths, in simavr
+compile "$BENCH/zowi_bench" "$OUT/bench"
+ELF="$OUT/bench/zowi_bench.ino.elf"
+timeout 300 simavr -m atmega328p -f 16000000 "$ELF" 2>&1 | tr -d '\r' >"$OUT/simavr.log" || true
+grep -q "END" "$OUT/simavr.log" || { echo "run_bench: the benchmark did not finish" >&2; cat "$OUT/simavr.log" >&2; exit 2; }
+sed -n 's/.*BENCH \([^ ]*\) [0-9]* \([0-9-]*\) \([0-9-]*\) \([0-9-]*\).*/bench \1 \2 \3 \4/p' "$OUT/simavr.log" >>"$RESULTS"
+
+#-- 2. Code size of the hot paths
+NM="$(avr-nm --print-size -C "$ELF")"
+for symbol in "${SYMBOLS[@]}"; do
+  hex=$(echo "$NM" | awk -v s="$symbol" '{ name=$0; sub(/^[0-9a-f]+ [0-9a-f]+ [tTwW] /, "", name); if (name == s) { print $2; exit } }')
+  echo "flash ${symbol// /} $([ -n "$hex" ] && echo $((16#$hex)) || echo -)" >>"$RESULTS"
+done
+
+#-- 3. Firmware images: the released hex files and the sketches they come from
+for hex in "$ROOT/code .hex"/*.hex; do
+  size=$(avr-size --target=ihex "$hex" | awk 'NR==2 { print $2 }')
+  echo "image hex/$(basename "$hex") $size -" >>"$RESULTS"
+done
+find "$ROOT/code .ino" -name '*.ino' | sort | while read -r ino; do
+  name="$(basename "$ino" .ino)"
+  compile "$(dirname "$ino")" "$OUT/$name"
+  avr-size "$OUT/$name/$name.ino.elf" | awk -v n="$name" 'NR==2 { print "image ino/" n " " $1+$2 " " $2+$3 }' >>"$RESULTS"
+done
+
+#-- The baseline depends on the toolchain, so it is recorded on the
+#-- machine that runs the comparison: the first run starts it
+if [ ! -f "$BASELINE" ]; then
+  echo "run_bench: no baseline yet, recording this run as the baseline"
+  UPDATE=1
+fi
+
+if [ $UPDATE -eq 1 ]; then
+  {
+    echo "# Zowi benchmark baseline, written by bench/run_bench.sh --update"
+    echo "# $(arduino-cli version | head -1), $(simavr --help 2>&1 | head -1)"
+    cat "$RESULTS"
+  } >"$BASELINE"
+  echo "run_bench: baseline updated ($(grep -vc '^#' "$BASELINE") figures)"
+  exit 0
+fi
+
+#-- Compare every figure with the baseline: a figure regresses when
+#-- it grew more than the tolerance
+awk -v tol="$TOLERANCE" '
+  /^#/ { next }
+  FNR == NR { base[$1 " " $2] = $0; next }
+  {
+    key = $1 " " $2
+    if (!(key in base)) { printf "new      %s\n", $0; next }
+    split(base[key], old)
+    for (i = 3; i <= NF; i++) {
+      if ($i == "-" || old[i] == "-") continue
+      if ($i > old[i] * (1 + tol / 100)) {
+        printf "WORSE    %s %s: field %d %s -> %s\n", $1, $2, i - 2, old[i], $i
+        bad++
+      } else if ($i < old[i] * (1 - tol / 100)) {
+        printf "better   %s %s: field %d %s -> %s\n", $1, $2, i - 2, old[i], $i
+      }
+    }
+  }
+  END {
+    if (bad) { printf "run_bench: %d figures regressed more than %s%%\n", bad, tol; exit 1 }
+    print "run_bench: no regressions"
+  }
+' "$BASELINE" "$RESULTS"
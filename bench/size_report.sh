@@ -0,0 +1,66 @@
+#!/bin/bash
+#----------------------------------------------------------------
+#-- size_report.sh
+#-- Build every sketch with several Zowi_config.h configurations
+#-- and print their flash and RAM use
+#----------------------------------------------------------------
+#-- Usage: bench/size_report.sh [config...]
+#--
+#-- A config is a name from the table below; by default all of
+#-- them. The flags are passed to the whole build, as the library
+#-- does not see the #defines of the sketch.
+#--
+#-- Needs arduino-cli (with the arduino:avr core) and avr-size in
+#-- the PATH.
+#----------------------------------------------------------------
+set -e
+
+ROOT="$(cd "$(dirname "$0")/.." && pwd)"
+FQBN="${ZOWI_FQBN:-arduino:avr:nano:cpu=atmega328}"
+OUT="${ZOWI_BENCH_OUT:-/tmp/zowi_bench}/size"
+
+#-- name: flags. open-loop also leaves out ServoEncoder and
+#-- Odometry, no-battery ZowiGovernor, no-trace ZowiTrace;
+#-- without both the encoders and the battery AnalogSampler
+#-- goes too (unless the sketch uses it, as ZOWI_BASE_v2 does)
+CONFIGS=(
+  "full:"
+  "no-rgb:-DZOWI_USE_RGB=0"
+  "games:-DZOWI_USE_RGB=0 -DZOWI_USE_ENCODERS=0 -DZOWI_USE_IR=0"
+  "open-loop:-DZOWI_USE_ENCODERS=0"
+  "no-battery:-DZOWI_USE_BATTERY=0"
+  "no-trace:-DZOWI_USE_TRACE=0"
+  "minimal:-DZOWI_USE_US=0 -DZOWI_USE_IR=0 -DZOWI_USE_RGB=0 -DZOWI_USE_ENCODERS=0 -DZOWI_USE_BATTERY=0 -DZOWI_USE_MOUTH=0 -DZOWI_USE_TRACE=0"
+)
+
+for tool in arduino-cli avr-size; do
+  command -v "$tool" >/dev/null || { echo "size_report: $tool not found" >&2; exit 2; }
+done
+
+SELECTED=("$@")
+selected() {
+  [ ${#SELECTED[@]} -eq 0 ] && return 0
+  for s in "${SELECTED[@]}"; do [ "$s" = "$1" ] && return 0; done
+  return 1
+}
+
+mkdir -p "$OUT"
+printf "%-12s %-20s %8s %8s\n" config sketch flash ram
+
+for entry in "${CONFIGS[@]}"; do
+  config="${entry%%:*}"
+  flags="${entry#*:}"
+  selected "$config" || continue
+
+  find "$ROOT/code .ino" -name '*.ino' | sort | while read -r ino; do
+    name="$(basename "$ino" .ino)"
+    build="$OUT/$config/$name"
+    mkdir -p "$build"
+    arduino-cli compile --fqbn "$FQBN" --libraries "$ROOT/arduino libraries" \
+      --build-property "compiler.cpp.extra_flags=$flags" \
+      --build-path "$build" "$(dirname "$ino")" >"$build.log" 2>&1 \
+      || { echo "size_report: $config/$name does not build, see $build.log" >&2; continue; }
+    avr-size "$build/$name.ino.elf" \
+      | awk -v c="$config" -v n="$name" 'NR==2 { printf "%-12s %-20s %8d %8d\n", c, n, $1+$2, $2+$3 }'
+  done
+done
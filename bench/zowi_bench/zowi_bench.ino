@@ -0,0 +1,249 @@
+//----------------------------------------------------------------
+//-- Zowi library benchmarks
+//-- Runs the hot paths of the libraries on an ATmega328P (simavr
+//-- or a real board) and prints one machine-readable line per
+//-- benchmark:
+//--
+//--     BENCH <name> <runs> <min cycles> <avg cycles> <max stack>
+//--
+//-- followed by "END". bench/run_bench.sh builds this sketch,
+//-- runs it in simavr and compares the results with
+//-- bench/baseline.txt.
+//--
+//-- Cycles come from timer 1 at clk/1 (the servos are detached
+//-- first, so the Servo library does not use it). Interrupts stay
+//-- enabled because refresh() and bendTones() need millis():
+//-- "min" is the cost of the code itself, "avg" includes the
+//-- timer 0 interrupts that hit it. The stack figure is the
+//-- deepest byte touched below the caller's stack pointer,
+//-- interrupt frames included.
+//-----------------------------------------------------------------
+#include <avr/sleep.h>
+
+#include <Servo.h>
+#include <Oscillator.h>
+#include <EEPROM.h>
+#include <BatReader.h>
+#include <US.h>
+#include <LedMatrix.h>
+#include <IR.h>
+#include <TCS3200.h>
+#include <ServoEncoder.h>
+#include <ZowiTrace.h>
+#include <ZowiSerialCommand.h>
+#include <ZowiSettings.h>
+#include <ToneDetector.h>
+#include <Zowi.h>
+
+Zowi zowi;
+Oscillator osc;
+ZowiSerialCommand SCmd;
+LedMatrix ledmatrix;
+LedMatrixT<FastPin<11>, FastPin<13>, FastPin<12> > fastmatrix;    //-- The one inside Zowi
+ZowiSettings settings;
+ToneDetector tones;
+
+#define PIN_RL 3
+#define PIN_RR 2
+
+#define STACK_PROBE  320      //-- Bytes painted below the stack pointer
+#define STACK_PAINT  0xC5
+
+//-- Timer 1 as a 32 bit cycle counter
+volatile uint16_t overflows;
+
+ISR(TIMER1_OVF_vect) {
+  overflows++;
+}
+
+static void cyclesStart() {
+  TCCR1B = 0;
+  TCCR1A = 0;
+  TIMSK1 = _BV(TOIE1);   //-- Also disables the Servo compare interrupt
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+  overflows = 0;
+  TCCR1B = _BV(CS10);
+}
+
+static inline uint32_t cycles() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t count = TCNT1;
+  uint16_t high = overflows;
+  if ((TIFR1 & _BV(TOV1)) && count < 0x8000) high++;   //-- Overflow not serviced yet
+  SREG = sreg;
+  return ((uint32_t)high << 16) | count;
+}
+
+//-- Paints the stack below the caller's frame. Always inlined, so it
+//-- paints from the caller's own stack pointer
+static inline __attribute__((always_inline)) uint8_t *stackPaint() {
+  uint8_t *top = (uint8_t *)(uintptr_t)SP;
+  for (uint8_t *p = top - STACK_PROBE; p <= top; p++) *p = STACK_PAINT;
+  return top;
+}
+
+static uint16_t stackUsed(uint8_t *top) {
+  uint8_t *p = top - STACK_PROBE;
+  while (p <= top && *p == STACK_PAINT) p++;
+  return top - p + 1;
+}
+
+//-- Cost of an empty measurement, subtracted from every result
+uint32_t overhead = 0;
+uint32_t lastBest;        //-- Min cycles of the last benchmark
+
+static void report(const __FlashStringHelper *name, uint16_t runs, uint32_t best, uint32_t total, uint16_t stack) {
+  Serial.print(F("BENCH "));
+  Serial.print(name);
+  Serial.print(' ');
+  Serial.print(runs);
+  Serial.print(' ');
+  Serial.print(best);
+  Serial.print(' ');
+  Serial.print(total / runs);
+  Serial.print(' ');
+  Serial.println(stack);
+  Serial.flush();         //-- Keep the UART interrupt out of the next benchmark
+}
+
+//-- Runs prep (not timed) and code (timed) runs times and reports it
+#define BENCH(name, runs, prep, code)                             \
+  do {                                                            \
+    uint32_t best = 0xFFFFFFFF, total = 0;                        \
+    uint16_t stack = 0;                                           \
+    for (uint16_t run = 0; run < (runs); run++) {                 \
+      prep;                                                       \
+      uint8_t *top = stackPaint();                                \
+      uint32_t start = cycles();                                  \
+      code;                                                       \
+      uint32_t spent = cycles() - start - overhead;               \
+      uint16_t used = stackUsed(top);                             \
+      if (spent < best) best = spent;                             \
+      total += spent;                                             \
+      if (used > stack) stack = used;                             \
+    }                                                             \
+    report(F(name), runs, best, total, stack);                    \
+    lastBest = best;                                              \
+  } while (0)
+
+
+//-- Copy of returnColor() from ZOWI_BASE_v2.ino: keep them in sync
+typedef enum {
+  RED = 0,
+  GREEN,
+  BLUE,
+  WHITE,
+  BLACK,
+  YELLOW,
+} Color;
+
+#define NUMBER_OF_COLORS SETTINGS_COLORS
+
+//Colour of each calibrated reading in the settings
+const uint8_t colorIds[NUMBER_OF_COLORS] = {GREEN, BLUE, RED, BLACK, BLACK, YELLOW};
+
+int returnColor(int *RGBval) {
+  bool found;
+
+  for (int i = 0; i < NUMBER_OF_COLORS; i++) {
+    const uint8_t *rgb = settings.get().colors[i];
+
+    found = true;
+    for (int j = 0; j < 3; j++) {
+      if (rgb[j] - 15 > RGBval[j] || rgb[j] + 15 < RGBval[j]) {
+        found = false;
+        break;
+      }
+    }
+
+    if (found == true)
+      return colorIds[i];
+  }
+
+  return WHITE;
+}
+
+
+//-- Command table like the one of ZOWI_BASE_v2
+void receiveNothing() {}
+
+volatile int sink;
+
+
+void setup() {
+  Serial.begin(115200);
+
+  zowi.init(PIN_RL, PIN_RR, false);
+  zowi.detachServos();
+  osc.attach(PIN_RL);
+  osc.detach();           //-- Keeps its parameters, the servo writes go nowhere
+  settings.reset();       //-- Default colour calibration, without touching the EEPROM
+  tones.init(PIN_NoiseSensor);
+  tones.addTone(note_C6);
+  tones.addTone(note_E6);
+  tones.addTone(note_G6);
+  tones.addTone(note_C7);
+  tones.addTone(note_A5);
+
+  const char *names[] = {"S", "L", "T", "M", "H", "K", "C", "G", "R", "E", "D", "N", "I", "B", "P", "W", "X", "Y"};
+  for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) SCmd.addCommand(names[i], receiveNothing);
+  SCmd.addDefaultHandler(receiveNothing);
+
+  cyclesStart();
+  sei();
+
+  //-- Calibration: the cost of measuring nothing
+  BENCH("empty", 16, , );
+  overhead = lastBest;
+
+  osc.SetT(1000);
+  osc.SetA(30);
+  osc.Play();
+  //-- refresh() only computes a sample once its 30 ms sampling period has passed
+  BENCH("Oscillator::refresh", 32, delay(31), osc.refresh());
+
+  BENCH("LedMatrix::sendMemory", 32, , ledmatrix.writeFull(0x3F0C30CUL));
+  BENCH("LedMatrixT::sendMemory", 32, , fastmatrix.writeFull(0x3F0C30CUL));
+  uint32_t writeFull = lastBest;
+
+  BENCH("Zowi::putMouth", 32, , zowi.putMouth(happyOpen));
+  Serial.print(F("BENCH Zowi::getMouthShape 32 "));
+  Serial.print(lastBest - writeFull);
+  Serial.println(F(" - -"));      //-- Derived: putMouth minus writeFull
+
+  BENCH("ZowiSerialCommand::dispatch_first", 32, , SCmd.runCommand("S 0"));
+  BENCH("ZowiSerialCommand::dispatch_last", 32, , SCmd.runCommand("Y 1"));
+  BENCH("ZowiSerialCommand::dispatch_unknown", 32, , SCmd.runCommand("Q"));
+
+  int match[3] = {237, 180, 177};   //-- Yellow: the last colour
+  int noMatch[3] = {128, 128, 128};
+  BENCH("returnColor_last", 32, , sink = returnColor(match));
+  BENCH("returnColor_none", 32, , sink = returnColor(noMatch));
+
+  //-- The five filters of ZOWI_BASE_v2 over a silent block (the
+  //-- filter loops cost the same whatever the samples)
+  BENCH("ToneDetector::process", 8, , tones.process());
+
+  //-- The shared fixed-point helpers, on a different argument every run
+  uint16_t argument = 12345;
+  BENCH("fix_sin", 32, argument += 977, sink = fix_sin(argument));
+  BENCH("fix_recip", 32, argument += 977, sink = fix_recip(argument | 1));
+
+  //-- 20 steps of 1 ms + 1 ms: dominated by the note timing, a
+  //-- change in the stepping shows as a change over ~640000 cycles
+  BENCH("Zowi::bendTones", 4, , zowi.bendTones(1000, 1486, 1.02, 1, 1));
+
+  Serial.println(F("END"));
+  Serial.flush();
+
+  //-- Sleeping with interrupts off ends the simavr run
+  cli();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sleep_cpu();
+}
+
+void loop() {
+}
@@ -16,17 +16,71 @@
 #include <Servo.h> 
 #include <Oscillator.h>
 #include <EEPROM.h>
-#include <BatReader.h>
 #include <US.h>
 #include <LedMatrix.h>
+#include <AnalogSampler.h>
 
 //-- Library to manage serial commands
 #include <ZowiSerialCommand.h>
 ZowiSerialCommand SCmd;  //The SerialCommand object
 
+//-- Zowi buttons: interrupt-driven & debounced event queue
+#include <ZowiButtons.h>
+ZowiButtons buttons;
+
+//-- Cooperative scheduler for the timed jobs of the main loop
+#include <ZowiScheduler.h>
+ZowiScheduler scheduler;
+
+//-- Low power idle between events
+#include <ZowiPower.h>
+ZowiPower power;
+
+//-- Loop profiler (table after the 'P' reply). Uncomment ZOWI_PROFILING
+//-- to enable it; otherwise the PROFILE_ macros compile to nothing
+//#define ZOWI_PROFILING
+#include <ZowiProfiler.h>
+PROFILE_DECLARE();
+
+#define PROF_LOOP       0
+#define PROF_SCHEDULER  1
+#define PROF_SERIAL     2
+#define PROF_IR         3
+#define PROF_RGB        4
+#define PROF_GESTURE    5
+#define PROF_SING       6
+#define PROF_TONE       7
+
+//-- RAM usage: stack high-water mark and free RAM ('Y' command)
+#include <ZowiMemory.h>
+
+//-- Event trace for post-mortem analysis ('X' command)
+#include <ZowiTrace.h>
+
+//-- Trims, name, colour calibration and user settings kept in the EEPROM
+#include <ZowiSettings.h>
+ZowiSettings settings;
+#define FAULT_SETTINGS 0x100   //Trace fault code (battery faults record the level, 0..100)
+
 //-- Zowi Library
 #include <Zowi.h>
 Zowi zowi;  //This is Zowi!!
+
+//-- PD line following on the IR sensors (MODE 1)
+#include <LineFollower.h>
+LineFollower line;
+
+//-- Tones heard by the noise sensor drive Zowi too (MODE 3)
+#include <ToneDetector.h>
+ToneDetector tones;
+
+//-- Sensor rules uploaded from the app ('J' command), run on the board (MODE 3)
+#include <ZowiRules.h>
+ZowiRules rules;
+
+//-- Animations and melodies uploaded from the app ('Q' command), played on the board
+#include <ZowiClips.h>
+ZowiClips clips;
  
 //---------------------------------------------------------
 //-- Configuration of pins where the servos are attached
@@ -48,8 +102,6 @@ RR => |-|               |-| <= RL
 #define PIN_SecondButton 6
 #define PIN_ThirdButton 7
 
-#define MAX_LOOPS             1000
-
 ///////////////////////////////////////////////////////////////////
 //-- Global Variables -------------------------------------------//
 ///////////////////////////////////////////////////////////////////
@@ -64,6 +116,11 @@ int T=1000;              //Initial duration of movement
 int moveId=0;            //Number of movement
 int moveSize=15;         //Asociated with the height of some movements
 
+//-- Colour program steps, measured by the odometry
+#define ORDER_STRAIGHT_MM 200    //Was 2 s forward
+#define ORDER_BACK_MM     250    //Was 2.5 s back
+#define ORDER_TURN_DEG    90
+
 typedef enum
 {
   STOP = 0,
@@ -74,22 +131,40 @@ typedef enum
 } State;
 
 //---------------------------------------------------------
-//-- Zowi has 5 modes:
-//--    * MODE = 0: Zowi is awaiting  
-//--    * MODE = 1: Dancing mode!  
-//--    * MODE = 2: Obstacle detector mode  
-//--    * MODE = 3: Noise detector mode   
-//--    * MODE = 4: ZowiPAD or any Teleoperation mode (listening SerialPort). 
+//-- Zowi has 4 modes:
+//--    * MODE = 0: Zowi is awaiting (low power)
+//--    * MODE = 1: Line follower & colour program (buttons A and B)
+//--    * MODE = 2: Colour sensor calibration
+//--    * MODE = 3: ZowiPAD or any Teleoperation mode (movements, tones, rules)
+//-- A long press on a button goes to the next mode, the 'Z' command
+//-- sets it and a movement command ('M') goes to MODE 3. Serial
+//-- commands are answered in every mode.
 //---------------------------------------------------------
+#define NUMBER_OF_MODES 4
 volatile int MODE=1; //State of zowi in the principal state machine. 
 
-volatile bool buttonPushed=false;  //Variable to remember when a button has been pushed
+volatile bool buttonPushed=false;  //Set by the button interrupt: cuts short what Zowi is doing
 volatile bool buttonAPushed=false; //Variable to remember when A button has been pushed
 volatile bool buttonBPushed=false; //Variable to remember when B button has been pushed
 
-unsigned long previousMillis=0;
+int8_t sleepTask;          //Zowi falls asleep every 80 seconds in MODE 0
+int8_t showModeTask;       //Ends the display of the MODE number
+int8_t motionTask;         //Keeps the teleoperated movement going (MODE 3)
+int8_t greetTask;          //The greeting after a reset, step by step
+int8_t rulesTask;          //Checks the sensor rules (MODE 3)
+uint8_t greetStep=0;
+bool showingMode=false;    //The MODE number is on the mouth
+bool stepStarted=false;    //A movement step is running and owes its final Ack
+bool standingBy=false;     //Servos detached and mouth off while awaiting (MODE 0)
+uint8_t lineState=LINE_LOST;   //Line follower state (MODE 1)
 
 bool obstacleDetected = false;
+bool traceSaved = false;   //The low battery alarm saved the trace on the EEPROM
+
+//-- Boot times ('U' command): millis() at the end of setup() and when the
+//-- loop saw the first serial byte. The bootloader runs before millis() starts
+unsigned long readyTime=0;
+unsigned long firstCommandTime=0;
 
 typedef enum
 {
@@ -101,16 +176,10 @@ typedef enum
   YELLOW,
 } Color;
 
-int green[4] = {GREEN, 73, 95, 94};
-int blue[4] = {BLUE, 78, 112, 110};
-int red[4] = {RED, 173, 73, 73};
-int black[4] = {BLACK, 15, 15, 15};
-int black_2[4] = {BLACK, 43, 34, 35};
-int yellow[4] = {YELLOW, 237, 180, 177};
+#define NUMBER_OF_COLORS SETTINGS_COLORS
 
-#define NUMBER_OF_COLORS 6
-
-int *colors[NUMBER_OF_COLORS] = {green, blue, red, black, black_2, yellow};
+//Colour of each calibrated reading in the settings
+const uint8_t colorIds[NUMBER_OF_COLORS] = {GREEN, BLUE, RED, BLACK, BLACK, YELLOW};
 
 int color_index = 0;
 int color_orders[15] = {};
@@ -129,44 +198,43 @@ int returnColor(int *RGBval) {
   bool found;
 
   for (int i = 0; i < NUMBER_OF_COLORS; i++) {
+    const uint8_t *rgb = settings.get().colors[i];
+
     found = true;
-    for (int j = 1; j < 4; j++) {
-      if (colors[i][j] - 15 > RGBval[j - 1] || colors[i][j] + 15 < RGBval[j - 1]) {
+    for (int j = 0; j < 3; j++) {
+      if (rgb[j] - 15 > RGBval[j] || rgb[j] + 15 < RGBval[j]) {
         found = false;
         break;
       }
     }
 
     if (found == true)
-      return colors[i][0];
+      return colorIds[i];
   }
 
   return WHITE;
 }
 
-int executeOrder(int order) {
-  bool found;
-
+void executeOrder(int order) {
   for (int i = 0; i < NUMBER_OF_ORDERS; i++) {
     if (orders_color[i][0] != order)
       continue;
 
     switch (orders_color[i][1]) {
     case MOVESTRAIGHT:
-      zowi.forward(2000);
+      zowi.driveDistance(ORDER_STRAIGHT_MM);
       break;
     case MOVELEFT:
-      zowi.left_order(1010);
+      zowi.rotateBy(ORDER_TURN_DEG);
       break;
     case MOVERIGHT:
-      zowi.right_order(850);
+      zowi.rotateBy(-ORDER_TURN_DEG);
       break;
     case STOP:
       zowi.stop(100);
       break;
     case MOVEBACK:
-      zowi.back(2500);
-      zowi.stop(100);
+      zowi.driveDistance(-ORDER_BACK_MM);
       break;
     default:
       break;
@@ -182,18 +250,52 @@ void setup(){
   //Serial communication initialization
   Serial.begin(115200);  
 
-  pinMode(PIN_SecondButton,INPUT);
-  pinMode(PIN_ThirdButton,INPUT);
+  buttons.init(PIN_SecondButton,PIN_ThirdButton);
+  buttons.onPress(onButtonPress);
   
   //Set the servo pins
   zowi.init(PIN_RL,PIN_RR,false);
- 
-  //Uncomment this to set the servo trims manually and save on EEPROM 
-    //zowi.setTrims(TRIM_YL, TRIM_YR, TRIM_RL, TRIM_RR);
-    //zowi.saveTrimsOnEEPROM(); //Uncomment this only for one upload when you finaly set the trims.
 
+  //A pushed button cuts short any song, gesture or movement in progress
+  zowi.setCancelSource(&buttonPushed);
+
+  //The wheels keep their speed with the encoder feedback
+  zowi.setSpeedControl(true);
+  line.init(IR_LEFT_PIN, IR_RIGHT_PIN);
+
+  //Whistle or play one of these notes for the movement next to it
+  tones.init(PIN_NoiseSensor);
+  tones.addTone(note_C6);   //M 3: forward
+  tones.addTone(note_E6);   //M 4: back
+  tones.addTone(note_G6);   //M 1: left
+  tones.addTone(note_C7);   //M 2: right
+  tones.addTone(note_A5);   //Stop
+
+  //Rules kept in the EEPROM by the last 'J S'
+  rules.init(readRuleSensor, runRuleAction);
+  rules.load();
+
+  //Clips kept in the EEPROM by the last 'Q S'
+  clips.load();
+ 
   //Set a random seed
-  randomSeed(analogRead(A6));
+  randomSeed(AnalogSampler::analogRead(A6));
+
+  //First trace record: the cause of the last reset
+  Trace.record(TRACE_BOOT, MCUSR);
+
+  //Trims, name and calibration are read once from the EEPROM
+  if (settings.load()==SETTINGS_CORRUPT){
+    Trace.record(TRACE_FAULT, FAULT_SETTINGS);
+  }
+  zowi.setTrims(settings.get().trims[0], settings.get().trims[1], 0, 0);
+
+  //Uncomment this to set the servo trims manually and keep them in the settings
+    //settings.get().trims[0]=TRIM_YL; settings.get().trims[1]=TRIM_YR;
+    //settings.save(); //Uncomment this only for one upload when you finaly set the trims.
+    //zowi.setTrims(TRIM_YL, TRIM_YR, 0, 0);
+
+  zowi.setBatteryThresholds(settings.get().batteryLow, settings.get().batteryCritical);
 
   //Setup callbacks for SerialCommand commands 
   SCmd.addCommand("S", receiveStop);      //  sendAck & sendFinalAck
@@ -210,22 +312,32 @@ void setup(){
   SCmd.addCommand("N", requestNoise);
   SCmd.addCommand("B", requestBattery);
   SCmd.addCommand("I", requestProgramId);
+  SCmd.addCommand("W", requestPower);
+  SCmd.addCommand("Y", requestMemory);
+  SCmd.addCommand("X", requestTrace);
+  SCmd.addCommand("O", requestPose);
+  SCmd.addCommand("V", requestLimits);
+  SCmd.addCommand("U", requestBoot);
+  SCmd.addCommand("J", receiveRules);
+  SCmd.addCommand("Q", receiveClip);
+  SCmd.addCommand("Z", receiveMode);
+  SCmd.addCommand("P", requestProfile);
   SCmd.addDefaultHandler(receiveStop);
 
 
 
-  //Zowi wake up!
+  //Zowi wake up! Nothing has moved since init(): at rest without
+  //the half second of home()
   //zowi.sing(S_connection);
-  zowi.home();
+  restNow();
 
 
   //If Zowi's name is '&' (factory name) means that is the first time this program is executed.
   //This first time, Zowi mustn't do anything. Just born at the factory!
-  //5 = EEPROM address that contains first name character
-  if (EEPROM.read(5)==name_fac){ 
+  if (settings.get().name[0]==name_fac){ 
 
-    EEPROM.put(5, name_fir); //From now, the name is '#'
-    EEPROM.put(6, '\0'); 
+    strcpy(settings.get().name, "#"); //From now, the name is '#'
+    settings.save();
     zowi.putMouth(culito);
 
     while(true){    
@@ -236,99 +348,91 @@ void setup(){
 
   //Send Zowi name, programID & battery level.
   requestName();
-  delay(50);
   requestProgramId();
-  delay(50);
   requestBattery();
-  
-  //Checking battery
-  ZowiLowBatteryAlarm();
-
-
- // Animation Uuuuuh - A little moment of initial surprise
- //-----
-  for(int i=0; i<2; i++){
-      for (int i=0;i<8;i++){
-        if(buttonPushed){break;}  
-        zowi.putAnimationMouth(littleUuh,i);
-        delay(150);
-      }
-  }
- //-----
-
-
-  //Smile for a happy Zowi :)
-  if(!buttonPushed){ 
-    zowi.putMouth(smile);
-    //zowi.sing(S_happy);
-    delay(200);
-  }
-
-
-  //If Zowi's name is '#' means that Zowi hasn't been baptized
-  //In this case, Zowi does a longer greeting
-  //5 = EEPROM address that contains first name character
-  if (EEPROM.read(5)==name_fir){ 
-
-    if(!buttonPushed){  
-        zowi.back(0.5);
-        zowi.forward(0.5);
-        delay(200); 
-    }
-
-    if(!buttonPushed){ 
-        zowi.putMouth(smallSurprise);
-        zowi.home();
-    }  
-  }
 
+  //Timed jobs of the main loop
+  sleepTask = scheduler.addPeriodic(sleepWhenAwaiting, settings.get().sleepTime*1000UL, TASK_IDLE);
+  showModeTask = scheduler.addOneShot(endShowMode, 0, TASK_MOUTH);
+  scheduler.stop(showModeTask);
+  motionTask = scheduler.addPeriodic(keepMoving, 10, TASK_MOTION);
+  rulesTask = scheduler.addPeriodic(checkRules, RULES_PERIOD_MS, TASK_SENSOR);
 
-  if(!buttonPushed){ 
-    zowi.putMouth(happyOpen);
-  }
-
-  previousMillis = millis();
+  //The battery check and the greeting run from the loop, so Zowi
+  //answers commands and buttons from now on
+  greetTask = scheduler.addOneShot(greet, 0, TASK_MOUTH);
+  modeTasks();
 
+  readyTime = millis();
+  Trace.record(TRACE_READY, readyTime);
 }
 
 ///////////////////////////////////////////////////////////////////
 //-- Principal Loop ---------------------------------------------//
 ///////////////////////////////////////////////////////////////////
 void loop() {
+  PROFILE_SCOPE(PROF_LOOP, "loop");
   int RGBValues[3] = {};
   int col;
 
-  if (Serial.available()>0 && MODE!=3){
-
-    MODE=1;
-    //zowi.putMouth(happyOpen);
+  if (Serial.available()>0){
+    if (firstCommandTime==0) firstCommandTime = millis();
+    power.serialActivity();
+  }
 
-    buttonPushed=false;
+  //The greeting gives way to the first command or button
+  if (scheduler.isActive(greetTask) && (Serial.available()>0 || buttons.available())){
+    endGreeting();
   }
 
-  //First attemp to initial software
-  if (buttonPushed){  
+  //A press cuts short the action running when it came, not the next one
+  buttonPushed=false;
 
-    zowi.home();
+  //Commands are answered in every mode
+  {
+    PROFILE_SCOPE(PROF_SERIAL, "serial");
+    SCmd.readSerial();
+  }
 
-    delay(100); //Wait for all buttons 
-    //zowi.sing(S_buttonPushed);
-    delay(200); //Wait for all buttons 
+  {
+    PROFILE_SCOPE(PROF_SCHEDULER, "scheduler");
+    scheduler.run();
+  }
 
-    zowi.putMouth(MODE);
- 
-    int showTime = 2000;
-    while((showTime>0)){ //Wait to show the MODE number 
-        
-        showTime-=10;
-        delay(10);
+  //Battery crossing to low or critical (with hysteresis, once per crossing)
+  uint8_t batteryState;
+  if (zowi.batteryChanged(batteryState) && batteryState!=BatReader::BAT_OK){
+    ZowiLowBatteryAlarm();
+  }
+
+  //Presses are queued by the button interrupts, even while Zowi was busy.
+  //A long press goes to the next MODE; in MODE 1, A starts the line follower
+  //and the colour reading, B runs the colour program
+  ZowiButtonEvent event;
+  while (buttons.read(event)) {
+    Trace.record(TRACE_BUTTON, (event.type << 8) | event.buttons);
+    if (event.type == BUTTON_LONGPRESS) {
+      nextMode();
+      continue;
     }
-     
-    //zowi.putMouth(happyOpen);
+    if (event.type != BUTTON_PRESS || MODE != 1)
+      continue;
 
-    buttonPushed=false;
+    if (event.buttons == BUTTON_B)
+      buttonBPushed = true;
 
-  }else{
+    if (event.buttons == BUTTON_A && buttonAPushed == false) {
+      buttonAPushed = true;
+      line.reset();
+      lineState = LINE_LOST;
+      if (color_index != 0) {
+        color_index = 0;
+        memset(color_orders, 0, sizeof(color_orders));            
+      }
+    }
+  }
+
+  if (!showingMode && !scheduler.isActive(greetTask)){
 
     switch (MODE) {
 
@@ -336,34 +440,24 @@ void loop() {
       //---------------------------------------------------------
       case 0:
       
-        //Every 80 seconds in this mode, Zowi falls asleep 
-        if (millis()-previousMillis>=80000){
-            ZowiSleeping_withInterrupts(); //ZZzzzzz...
-            previousMillis=millis();         
+        //Every 80 seconds in this mode, Zowi falls asleep (sleepTask).
+        //In between, servos and mouth are off and the CPU sleeps until
+        //the next task, a button or serial data. It only powers down
+        //once the app has been quiet for POWER_SERIAL_QUIET_MS
+        if (!standingBy){
+            zowi.home();
+            zowi.clearMouth();
+            standingBy=true;
+        }
+        if (power.sleep(scheduler.timeToNext())){
+            scheduler.wake();
         }
-
         break;
         
 
-      //-- MODE 1 - Noise detector mode
+      //-- MODE 1 - Line follower & colour program
       //---------------------------------------------------------  
       case 1:
-      
-          static uint8_t sensorLeft = 0;
-          static uint8_t sensorRight = 0;
-          static State state = STOP;
-          static int loops = 0;
-
-         if (buttonBPushed == false)
-           buttonBPushed = digitalRead(PIN_ThirdButton);
-
-         if (buttonAPushed == false) {
-           buttonAPushed = digitalRead(PIN_SecondButton);
-           if (buttonAPushed == true && color_index != 0) {
-             color_index = 0;
-             memset(color_orders, 0, sizeof(color_orders));            
-           }
-         }
 
          if (buttonBPushed == true) {
            if (color_index != 0 && color_orders[color_index - 1] == BLACK) {
@@ -380,7 +474,12 @@ void loop() {
              return;
            }
          } else if (buttonAPushed == true) {
-           if (zowi.getRGB(RGBValues)) {
+           bool colorRead;
+           {
+             PROFILE_SCOPE(PROF_RGB, "rgb");
+             colorRead = zowi.getRGB(RGBValues);
+           }
+           if (colorRead) {
              col = returnColor(RGBValues);
              if (col >= 0) {
                if (col == WHITE) {
@@ -395,45 +494,28 @@ void loop() {
              }
            }
 
-           sensorLeft = zowi.getIR(LEFT);
-           sensorRight = zowi.getIR(RIGHT);
-           if ((sensorLeft == LOW) && (sensorRight == LOW)) {
-             zowi.forward(10);
-             loops = 0;
-             state = MOVESTRAIGHT;
-             zowi.putMouth(smile);
-           } else if ((sensorLeft == LOW) && (sensorRight == HIGH)) {
-             zowi.left(10);
-             loops = 0;
-             state = MOVELEFT;
-             zowi.putMouth(smile);
-           } else if ((sensorLeft == HIGH) && (sensorRight == LOW)) {
-             zowi.right(10);
-             loops = 0;
-             state = MOVERIGHT;
-             zowi.putMouth(smile);
-           } else if ((sensorLeft == HIGH) && (sensorRight == HIGH)) {
-             if (loops <= MAX_LOOPS) {
-               if (state == MOVERIGHT) {
-                 zowi.right(10);
-                 loops++;
-                 zowi.putMouth(smile);
-               } else if (state == MOVELEFT) {
-                 zowi.left(10);
-                 loops++;
-                 zowi.putMouth(smile);
-               } else {
+           //The follower runs at its own fixed rate: new wheel speeds
+           //every LINE_PERIOD_MS, the mouth only changes with the state
+           int speedLeft, speedRight;
+           bool lineUpdated;
+           {
+             PROFILE_SCOPE(PROF_IR, "ir");
+             lineUpdated = line.update(speedLeft, speedRight);
+           }
+           if (lineUpdated) {
+             uint8_t newState = line.getState();
+             if (newState != LINE_LOST) {
+               zowi.setWheelSpeed(speedLeft, speedRight);
+             }
+             if ((newState == LINE_LOST) != (lineState == LINE_LOST)) {
+               if (newState == LINE_LOST) {
                  zowi.stop(10);
-                 loops = 0;
-                 state = STOP;
                  zowi.putMouth(sad);
+               } else {
+                 zowi.putMouth(smile);
                }
-             } else {
-               zowi.stop(10);
-               loops = 0;
-               state = STOP;
-               zowi.putMouth(sad);
              }
+             lineState = newState;
            }
            if (color_index != 0 && color_orders[color_index - 1] == BLACK) {
              //zowi.forward(3000);
@@ -452,32 +534,42 @@ void loop() {
         break;
         
       case 2: //Calibration RGB
-        char buf[200];
-        
         if (zowi.getRGB(RGBValues)) {
           col = returnColor(RGBValues);
           for (int i = 0; i < 3; i++) {
-            sprintf(buf, "RGB[%d] = %d", i, RGBValues[i]);
-            Serial.println(buf);
+            Serial.print(F("RGB["));
+            Serial.print(i);
+            Serial.print(F("] = "));
+            Serial.println(RGBValues[i]);
           }
         }
       break;
 
-      //-- MODE 2 - ZowiPAD or any Teleoperation mode (listening SerialPort) 
+      //-- MODE 3 - ZowiPAD or any Teleoperation mode (listening SerialPort) 
       //---------------------------------------------------------
       case 3:
 
-        SCmd.readSerial();
-        
-        //If Zowi is moving yet
-        if (zowi.getRestState()==false){  
-          move(moveId);
+        //If Zowi is moving yet, motionTask keeps the movement going
+
+        //A block of the noise sensor every TONE_PERIOD_MS
+        {
+          PROFILE_SCOPE(PROF_TONE, "tone");
+          ToneEvent heard;
+          if (tones.update() && tones.read(heard)){
+            receiveTone(heard.tone);
+          }
+        }
+
+        //Nothing to do until the next byte or timer tick
+        if (Serial.available()==0){
+            power.idle();
         }
       
         break;   
 
            
       default:
+          Trace.record(TRACE_MODE, 1);
           MODE=1;
           break;
     }
@@ -492,22 +584,191 @@ void loop() {
 //-- Functions --------------------------------------------------//
 //////////////////////////////////////////////////////////////////        /
 
+//-- Button interrupt hook: a press raises the cancel flag at once, so
+//-- the song, gesture or movement in progress stops at its next step
+void onButtonPress(uint8_t){
+
+    buttonPushed=true;
+}
+
+
+//-- Scheduler task: every 80 seconds awaiting, Zowi falls asleep
+void sleepWhenAwaiting(){
+
+    if (MODE==0){
+        ZowiSleeping_withInterrupts(); //ZZzzzzz...
+        standingBy=false;
+    }
+}
+
+
+//-- Scheduler task: the MODE number has been shown long enough
+void endShowMode(){
+
+    //zowi.putMouth(happyOpen);
+    showingMode=false;
+}
+
+
+//-- Function to change the MODE. What Zowi was doing stops, and the
+//-- tasks of the new MODE take over
+void setMode(int mode){
+
+    if (mode<0 || mode>=NUMBER_OF_MODES){
+        return;
+    }
+    if (mode!=MODE){
+        Trace.record(TRACE_MODE, mode);
+    }
+    MODE=mode;
+
+    zowi.home();
+    buttonAPushed=false;
+    buttonBPushed=false;
+    stepStarted=false;
+    standingBy=false;
+    modeTasks();
+}
+
+
+//-- Function to start the periodic tasks of the current MODE and stop
+//-- the rest. Only MODE 3 moves on commands and checks the rules: in
+//-- MODE 0 the sleep task is left alone, so the CPU can power down
+void modeTasks(){
+
+    if (MODE==3){
+        scheduler.start(motionTask);
+        scheduler.start(rulesTask);
+    }else{
+        scheduler.stop(motionTask);
+        scheduler.stop(rulesTask);
+    }
+}
+
+
+//-- Function to go to the next MODE (long press), showing its number
+//-- for 2 seconds without blocking
+void nextMode(){
+
+    setMode((MODE+1)%NUMBER_OF_MODES);
+
+    zowi.putMouth(MODE);
+    showingMode=true;
+    scheduler.start(showModeTask, 2000);
+}
+
+
+//-- Scheduler task: the greeting after a reset, one step per run
+void greet(){
+
+  const uint8_t uuhSteps=16;          //Two rounds of the 8 frames
+  bool baptized = (settings.get().name[0]!=name_fir);
+  unsigned long next=0;               //ms to the next step, 0 = done
+
+  //Checking battery
+  if (greetStep==0 && zowi.getBatteryState()!=BatReader::BAT_OK){
+    ZowiLowBatteryAlarm();
+  }
+
+  if (greetStep<uuhSteps){
+    //Animation Uuuuuh - A little moment of initial surprise
+    zowi.putAnimationMouth(littleUuh, greetStep%8);
+    next=150;
+  }else if (greetStep==uuhSteps){
+    //Smile for a happy Zowi :)
+    zowi.putMouth(smile);
+    next=200;
+  }else if (greetStep==uuhSteps+1 && !baptized){
+    //If Zowi's name is '#' means that Zowi hasn't been baptized
+    //In this case, Zowi does a longer greeting
+    zowi.back(0.5);
+    zowi.forward(0.5);
+    next=200;
+  }else if (greetStep==uuhSteps+2 && !baptized){
+    zowi.putMouth(smallSurprise);
+    zowi.stop(500, false);
+    next=500;
+  }else{
+    if (!zowi.getRestState()){ restNow(); }
+    zowi.putMouth(happyOpen);
+  }
+
+  greetStep++;
+  if (next){
+    scheduler.start(greetTask, next);
+  }
+}
+
+
+//-- Cuts the greeting short, stopping the wheels if it moved them
+void endGreeting(){
+
+  scheduler.stop(greetTask);
+  if (!zowi.getRestState()){ restNow(); }
+}
+
+
+//-- Zowi at rest at once: servos detached, as home() leaves them
+void restNow(){
+
+  zowi.detachServos();
+  zowi.setRestState(true);
+}
+
+
+//-- Scheduler task: start the next step of the current movement when the previous one is over
+void keepMoving(){
+
+    if (MODE!=3 || zowi.isMoving()){
+        return;
+    }
+
+    if (stepStarted){ //The previous step is over (unless a command already stopped Zowi)
+        stepStarted=false;
+        if (zowi.getRestState()==false){
+            sendFinalAck();
+        }
+    }
+
+    if (zowi.getRestState()==false){
+        move(moveId);
+    }
+}
+
+
+//-- Scheduler task: the sensor rules react on their own in MODE 3, without
+//-- waiting for the app. Not while the greeting or the MODE number is on
+void checkRules(){
+
+    if (MODE!=3 || showingMode || scheduler.isActive(greetTask)){
+        return;
+    }
+    rules.evaluate();
+}
+
+
 //-- Function to read distance sensor & to actualize obstacleDetected variable
 void obstacleDetector(){
 
-   int distance = zowi.getDistance();
+   int distance = zowi.getDistanceCm();
+   bool wasDetected = obstacleDetected;
 
-        if(distance<15){
+        if(distance<settings.get().obstacleDistance){
           obstacleDetected = true;
         }else{
           obstacleDetected = false;
         }
+
+        if (obstacleDetected != wasDetected){
+          Trace.record(TRACE_SENSOR, distance);
+        }
 }
 
 
 //-- Function to receive Stop command.
 void receiveStop(){
 
+    traceCommand('S', 0);
     sendAck();
     zowi.home();
     sendFinalAck();
@@ -619,7 +880,9 @@ void receiveTrims(){
 
     }else{ //Save it on EEPROM
       zowi.setTrims(trim_YL, trim_YR, trim_RL, trim_RR);
-      zowi.saveTrimsOnEEPROM(); //Uncomment this only for one upload when you finaly set the trims.
+      settings.get().trims[0]=trim_YL;
+      settings.get().trims[1]=trim_YR;
+      settings.save();
     } 
 
     sendFinalAck();
@@ -680,6 +943,11 @@ void receiveMovement(){
 
     sendAck();
 
+    //The pad of the app takes Zowi to the teleoperation mode
+    if (MODE!=3){
+        setMode(3);
+    }
+
     if (zowi.getRestState()==true){
         zowi.setRestState(false);
     }
@@ -707,10 +975,38 @@ void receiveMovement(){
     else{
       moveSize =15;
     }
+
+    traceCommand('M', moveId);
+}
+
+
+//-- Function to turn a tone heard into a movement, as the 'M' command
+//-- with the default duration would
+const uint8_t toneMoves[] = {3, 4, 1, 2, 0};
+
+void receiveTone(uint8_t tone){
+
+    startMove(toneMoves[tone]);
 }
 
 
-//-- Function to execute the right movement according the movement command received.
+//-- Function to start a movement without a command: moveId, 1000 ms steps
+void startMove(int id){
+
+    moveId = id;
+    T = 1000;
+    traceCommand('M', moveId);
+
+    if (moveId == 0){
+        zowi.home();
+    }else if (zowi.getRestState()==true){
+        zowi.setRestState(false);
+    }
+}
+
+
+//-- Function to start the right movement according the movement command received.
+//-- It doesn't wait for the movement: keepMoving() sends the final Ack when the step is over.
 void move(int moveId){
 
   bool manualMode = false;
@@ -720,24 +1016,26 @@ void move(int moveId){
       zowi.home();
       break;
     case 1: //M 1 1000 
-      zowi.left(T);
+      zowi.left(T, false);
       break;
     case 2: //M 2 1000 
-      zowi.right(T);
+      zowi.right(T, false);
       break;
     case 3: //M 3 1000 
-      zowi.forward(T);
+      zowi.forward(T, false);
       break;
     case 4: //M 4 1000 
-      zowi.back(T);
+      zowi.back(T, false);
       break;
     default:
         manualMode = true;
       break;
   }
 
-  if(!manualMode){
+  if(moveId==0){
     sendFinalAck();
+  }else if(!manualMode){
+    stepStarted = true;
   }
        
 }
@@ -746,6 +1044,8 @@ void move(int moveId){
 //-- Function to receive gesture commands
 void receiveGesture(){
 
+    PROFILE_SCOPE(PROF_GESTURE, "gesture");
+
     //sendAck & stop if necessary
     sendAck();
     zowi.home(); 
@@ -755,7 +1055,7 @@ void receiveGesture(){
     int gesture = 0;
     char *arg; 
     arg = SCmd.next(); 
-    if (arg != NULL) {gesture=atoi(arg);}
+    if (arg != NULL) {gesture=atoi(arg); traceCommand('H', gesture);}
     else 
     {
       zowi.putMouth(xMouth);
@@ -763,6 +1063,14 @@ void receiveGesture(){
       zowi.clearMouth();
     }
 
+    doGesture(gesture);
+
+    sendFinalAck();
+}
+
+//-- Function to play a gesture by its 'H' command number (1..13)
+void doGesture(int gesture){
+
     switch (gesture) {
       case 1: //H 1 
         zowi.playGesture(ZowiHappy);
@@ -806,13 +1114,13 @@ void receiveGesture(){
       default:
         break;
     }
-
-    sendFinalAck();
 }
 
 //-- Function to receive sing commands
 void receiveSing(){
 
+    PROFILE_SCOPE(PROF_SING, "sing");
+
     //sendAck & stop if necessary
     sendAck();
     zowi.home(); 
@@ -822,7 +1130,7 @@ void receiveSing(){
     int sing = 0;
     char *arg; 
     arg = SCmd.next(); 
-    if (arg != NULL) {sing=atoi(arg);}
+    if (arg != NULL) {sing=atoi(arg); traceCommand('K', sing);}
     else 
     {
       zowi.putMouth(xMouth);
@@ -830,6 +1138,14 @@ void receiveSing(){
       zowi.clearMouth();
     }
 
+    doSing(sing);
+
+    sendFinalAck();
+}
+
+//-- Function to sing a song by its 'K' command number (1..19)
+void doSing(int sing){
+
     switch (sing) {
       case 1: //K 1 
         zowi.sing(S_connection);
@@ -891,8 +1207,6 @@ void receiveSing(){
       default:
         break;
     }
-
-    sendFinalAck();
 }
 
 
@@ -903,21 +1217,15 @@ void receiveName(){
     sendAck();
     zowi.home(); 
 
-    char newZowiName[11] = "";  //Variable to store data read from Serial.
-    int eeAddress = 5;          //Location we want the data to be in EEPROM.
     char *arg; 
     arg = SCmd.next(); 
     
     if (arg != NULL) {
 
-      //Complete newZowiName char string
-      int k = 0;
-      while((*arg) && (k<11)){ 
-          newZowiName[k]=*arg++;
-          k++;
-      }
-      
-      EEPROM.put(eeAddress, newZowiName); 
+      //Up to 10 characters, the rest is cut
+      strncpy(settings.get().name, arg, SETTINGS_NAME_LENGTH);
+      settings.get().name[SETTINGS_NAME_LENGTH]='\0';
+      settings.save(); 
     }
     else 
     {
@@ -936,17 +1244,7 @@ void requestName(){
 
     zowi.home(); //stop if necessary
 
-    char actualZowiName[11]= "";  //Variable to store data read from EEPROM.
-    int eeAddress = 5;            //EEPROM address to start reading from
-
-    //Get the float data from the EEPROM at position 'eeAddress'
-    EEPROM.get(eeAddress, actualZowiName);
-
-    Serial.print(F("&&"));
-    Serial.print(F("E "));
-    Serial.print(actualZowiName);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('E', settings.get().name);
 }
 
 
@@ -955,12 +1253,254 @@ void requestDistance(){
 
     zowi.home();  //stop if necessary  
 
-    int distance = zowi.getDistance();
-    Serial.print(F("&&"));
-    Serial.print(F("D "));
-    Serial.print(distance);
-    Serial.println(F("%%"));
-    Serial.flush();
+    int distance = zowi.getDistanceCm();
+    SCmd.sendReply('D', distance);
+}
+
+
+//-- Function to send the odometry pose: x, y (mm), heading (degrees,
+//-- counterclockwise) and distance driven (mm) since the last reset
+//-- O     : send the pose
+//-- O 1   : send the pose and start over from (0, 0, 0)
+void requestPose(){
+
+    OdometryPose pose;
+    zowi.getPose(pose);
+
+    SCmd.beginReply('O');
+    SCmd.appendReply(pose.x);
+    SCmd.appendReply(pose.y);
+    SCmd.appendReply((long)pose.heading);
+    SCmd.appendReply(pose.distance);
+    SCmd.sendReply();
+
+    if (SCmd.next() != NULL){
+        zowi.resetPose();
+    }
+}
+
+
+//-- Function to send the battery state (0 ok, 1 low, 2 critical) and
+//-- the limits in force: speed (%), wheel ramp (deg/s per step, 0 none),
+//-- LED duty (%), sound duty (%)
+//-- V              : send them
+//-- V low critical : battery thresholds (%), kept in the EEPROM
+void requestLimits(){
+
+    char *arg = SCmd.next();
+    if (arg != NULL){
+        int low = atoi(arg);
+        arg = SCmd.next();
+        int critical = (arg != NULL) ? atoi(arg) : settings.get().batteryCritical;
+
+        if (critical >= 0 && critical < low && low <= 100){
+            settings.get().batteryLow = low;
+            settings.get().batteryCritical = critical;
+            settings.save();
+            zowi.setBatteryThresholds(low, critical);
+        }
+    }
+
+    const ZowiLimits &limits = zowi.getLimits();
+
+    SCmd.beginReply('V');
+    SCmd.appendReply((long)zowi.getBatteryState());
+    SCmd.appendReply((long)limits.speed);
+    SCmd.appendReply((long)limits.ramp);
+    SCmd.appendReply((long)limits.leds);
+    SCmd.appendReply((long)limits.sound);
+    SCmd.sendReply();
+}
+
+
+//-- Function to edit and send the sensor rules (see ZowiRules.h). They run
+//-- in MODE 3; values as in the defines of ZowiRules.h:
+//-- J                      : send the number of rules and a mask of the slots in use
+//-- J slot                 : send the rule in the slot ("J slot" alone if it is free)
+//-- J slot sensor compare threshold hysteresis action arg
+//--                        : store a rule (action 0 frees the slot) and send it back
+//--                          (a mouth past the last predefined one is refused)
+//-- J S                    : keep the rules in the EEPROM, for the next boots
+//-- J C                    : free every slot (then J S to clear the EEPROM too)
+//-- Example: J 0 0 0 15 5 1 6 (distance < 15 cm -> gesture 6, again beyond 20 cm)
+void receiveRules(){
+
+    char *arg = SCmd.next();
+    int slot = -1;
+
+    if (arg != NULL && arg[0]=='S'){
+        rules.save();
+    }else if (arg != NULL && arg[0]=='C'){
+        rules.clear();
+    }else if (arg != NULL){
+        slot = atoi(arg);
+
+        int values[6];
+        uint8_t n = 0;
+        while (n < 6 && (arg = SCmd.next()) != NULL){
+            values[n++] = atoi(arg);
+        }
+        if (n == 6 && slot >= 0){
+            ZowiRule rule = {(uint8_t)values[0], (uint8_t)values[1], (int16_t)values[2],
+                             (uint8_t)values[3], (uint8_t)values[4], (uint8_t)values[5]};
+            //A mouth the table does not have is refused: the slot is sent unchanged
+            if (rule.action != RULE_MOUTH || (values[5] >= 0 && values[5] < MOUTH_SHAPES)){
+                rules.set(slot, rule);
+            }
+        }
+    }
+
+    SCmd.beginReply('J');
+    if (slot < 0){
+        uint8_t mask = 0;
+        ZowiRule rule;
+        for (uint8_t i=0; i<RULES_MAX; i++){
+            if (rules.get(i, rule)){ mask |= 1 << i; }
+        }
+        SCmd.appendReply((long)rules.count());
+        SCmd.appendReply((long)mask);
+    }else{
+        ZowiRule rule;
+        SCmd.appendReply((long)slot);
+        if (rules.get(slot, rule)){
+            SCmd.appendReply((long)rule.sensor);
+            SCmd.appendReply((long)rule.compare);
+            SCmd.appendReply((long)rule.threshold);
+            SCmd.appendReply((long)rule.hysteresis);
+            SCmd.appendReply((long)rule.action);
+            SCmd.appendReply((long)rule.arg);
+        }
+    }
+    SCmd.sendReply();
+}
+
+
+//-- Sensor reader of the rules: the value of a RULE_ sensor
+int readRuleSensor(uint8_t sensor){
+
+    switch (sensor){
+      case RULE_DISTANCE:
+        return zowi.getDistanceCm();
+      case RULE_NOISE:
+        return zowi.getNoise();
+      case RULE_IR:
+        return (zowi.getIR(LEFT)==HIGH ? 1 : 0) | (zowi.getIR(RIGHT)==HIGH ? 2 : 0);
+      default:
+        return zowi.getBatteryPercent()/100;
+    }
+}
+
+
+//-- Action of a rule that fired: as the command would, without the Acks
+void runRuleAction(uint8_t action, uint8_t arg){
+
+    switch (action){
+      case RULE_GESTURE:
+        traceCommand('H', arg);
+        zowi.home();
+        doGesture(arg);
+        break;
+      case RULE_SING:
+        traceCommand('K', arg);
+        zowi.home();
+        doSing(arg);
+        break;
+      case RULE_MOUTH:
+        zowi.putMouth(arg);
+        break;
+      case RULE_MOVE:
+        startMove(arg);
+        break;
+      case RULE_CLIP:
+        traceCommand('Q', arg);
+        zowi.home();
+        playClip(arg);
+        break;
+    }
+}
+
+
+//-- Function to upload, play and keep clips: mouth animations and melodies
+//-- played on the board with its own timing (see ZowiClips.h). A clip is
+//-- named by one character; values are decimal, as in the 'T' command.
+//-- Q                      : send the number of clips and the free bytes
+//-- Q B name kind          : begin a clip (kind 0 mouth, 1 melody), replacing one of that name
+//-- Q A value ms [value ms]: append steps to it: LED matrix or Hz (0 = rest), and ms
+//-- Q P name               : play the clip (sendAck & sendFinalAck)
+//-- Q D name               : delete the clip
+//-- Q S                    : keep the clips in the EEPROM, for the next boots
+//-- Q C                    : delete every clip (then Q S to clear the EEPROM too)
+//-- Every form but P answers as Q alone does, so the app sees what fitted.
+//-- Example: Q B a 1, Q A 1047 150 1319 150 0 50, Q A 1568 300, Q P a
+void receiveClip(){
+
+    char *arg = SCmd.next();
+    char op = (arg != NULL) ? arg[0] : 0;
+
+    if (op=='P'){
+        sendAck();
+        zowi.home();
+        arg = SCmd.next();
+        if (arg != NULL){
+            traceCommand('Q', arg[0]);
+            playClip(arg[0]);
+        }
+        sendFinalAck();
+        return;
+    }
+
+    if (op=='B' || op=='D'){
+        char *name = SCmd.next();
+        if (name != NULL && op=='D'){
+            clips.remove(name[0]);
+        }else if (name != NULL && (arg = SCmd.next()) != NULL){
+            clips.begin(name[0], atoi(arg));
+        }
+    }else if (op=='A'){
+        char *value;
+        while ((value = SCmd.next()) != NULL && (arg = SCmd.next()) != NULL){
+            if (!clips.append(strtoul(value, NULL, 10), atoi(arg))){ break; }
+        }
+    }else if (op=='S'){
+        clips.save();
+    }else if (op=='C'){
+        clips.clear();
+    }
+
+    SCmd.beginReply('Q');
+    SCmd.appendReply((long)clips.count());
+    SCmd.appendReply((long)clips.getFree());
+    SCmd.sendReply();
+}
+
+
+//-- Function to play a clip from the cache. A button cuts it short
+void playClip(char name){
+
+    int8_t clip = clips.find(name);
+    if (clip == NO_CLIP){
+        return;
+    }
+
+    bool mouth = (clips.getKind(clip) == CLIP_MOUTH);
+    ZowiClipStep step;
+
+    for (uint8_t i=0; i<clips.getSteps(clip); i++){
+        clips.getStep(clip, i, step);
+
+        int result;
+        if (mouth){
+            zowi.putMouth(step.value, false);
+            result = zowi.pause(step.ms);
+        }else if (step.value == 0){
+            result = zowi.pause(step.ms);
+        }else{
+            result = zowi._tone(step.value, step.ms, 1);
+        }
+        if (result == ZOWI_CANCELLED){
+            break;
+        }
+    }
 }
 
 
@@ -970,11 +1510,7 @@ void requestNoise(){
     zowi.home();  //stop if necessary
 
     int microphone= zowi.getNoise(); //analogRead(PIN_NoiseSensor);
-    Serial.print(F("&&"));
-    Serial.print(F("N "));
-    Serial.print(microphone);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('N', microphone);
 }
 
 
@@ -983,14 +1519,7 @@ void requestBattery(){
 
     zowi.home();  //stop if necessary
 
-    //The first read of the batery is often a wrong reading, so we will discard this value. 
-    double batteryLevel = zowi.getBatteryLevel();
-
-    Serial.print(F("&&"));
-    Serial.print(F("B "));
-    Serial.print(batteryLevel);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('B', zowi.getBatteryPercent(), 2);  //Two decimals, as Serial.print(double) did
 }
 
 
@@ -999,35 +1528,137 @@ void requestProgramId(){
 
     zowi.home();   //stop if necessary
 
-    Serial.print(F("&&"));
-    Serial.print(F("I "));
-    Serial.print(programID);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('I', programID);
+}
+
+
+//-- Function to send the power report: estimated average current (mA)
+//-- and the time spent in idle and power-down since reset (s)
+void requestPower(){
+
+    SCmd.beginReply('W');
+    SCmd.appendReply((long)(power.getAverageCurrent()/10), 2);
+    SCmd.appendReply((long)(power.getTime(POWER_IDLE)/100), 1);
+    SCmd.appendReply((long)(power.getTime(POWER_DOWN)/100), 1);
+    SCmd.sendReply();
+}
+
+
+//-- Function to send the boot times (ms since the start), for the scripts
+//-- that reconnect after every reset:
+//-- U     : end of setup(), first serial byte seen (0 = none yet), now
+void requestBoot(){
+
+    SCmd.beginReply('U');
+    SCmd.appendReply((long)readyTime);
+    SCmd.appendReply((long)firstCommandTime);
+    SCmd.appendReply((long)millis());
+    SCmd.sendReply();
+}
+
+
+//-- Function to change or send the MODE:
+//-- Z       : send the MODE
+//-- Z mode  : change to the MODE (0..3) and send it
+void receiveMode(){
+
+    char *arg = SCmd.next();
+    if (arg != NULL){
+        setMode(atoi(arg));
+    }
+    SCmd.sendReply('Z', MODE);
+}
+
+
+//-- Function to send the loop timing, worst cases since boot or the last reset:
+//-- P     : loop latency between two scheduler runs (us), longest task (us),
+//--         task deadline misses, replies dropped with a full TX buffer.
+//--         With ZOWI_PROFILING the profiler table follows
+//-- P 1   : send them and start over
+void requestProfile(){
+
+    unsigned long maxRunTime = 0;
+    unsigned int misses = 0;
+    for (int8_t i=0; i<MAXSCHEDULERTASKS; i++){
+        if (scheduler.getMaxRunTime(i) > maxRunTime) maxRunTime = scheduler.getMaxRunTime(i);
+        misses += scheduler.getDeadlineMisses(i);
+    }
+
+    SCmd.beginReply('P');
+    SCmd.appendReply((long)scheduler.getMaxLatency());
+    SCmd.appendReply((long)maxRunTime);
+    SCmd.appendReply((long)misses);
+    SCmd.appendReply((long)SCmd.getDroppedReplies());
+    SCmd.sendReply();
+
+    PROFILE_REPORT(Serial);
+
+    if (SCmd.next() != NULL){
+        scheduler.resetStats();
+        PROFILE_RESET();
+    }
+}
+
+
+//-- Function to send the RAM report (bytes):
+//-- Y     : free RAM now, lowest free RAM since boot, stack high-water mark, static RAM
+//-- Y 1   : also print the RAM taken by each global object
+void requestMemory(){
+
+    SCmd.beginReply('Y');
+    SCmd.appendReply((long)ZowiMemory::getFreeRam());
+    SCmd.appendReply((long)ZowiMemory::getMinFreeRam());
+    SCmd.appendReply((long)ZowiMemory::getStackHighWater());
+    SCmd.appendReply((long)ZowiMemory::getStaticRam());
+    SCmd.sendReply();
+
+    if (SCmd.next() != NULL){
+        ZowiMemory::printItem(Serial, F("zowi"), sizeof(zowi));
+        ZowiMemory::printItem(Serial, F("SCmd"), sizeof(SCmd));
+        ZowiMemory::printItem(Serial, F("scheduler"), sizeof(scheduler));
+        ZowiMemory::printItem(Serial, F("buttons"), sizeof(buttons));
+        ZowiMemory::printItem(Serial, F("power"), sizeof(power));
+        ZowiMemory::printItem(Serial, F("settings"), sizeof(settings));
+        ZowiMemory::printItem(Serial, F("rules"), sizeof(rules));
+        ZowiMemory::printItem(Serial, F("clips"), sizeof(clips));
+        ZowiMemory::printItem(Serial, F("Serial"), sizeof(Serial));
+        ZowiMemory::printItem(Serial, F("color_orders"), sizeof(color_orders));
+    }
+}
+
+
+//-- Function to send the event trace (binary, see ZowiTrace.h)
+//-- X     : records in RAM
+//-- X 1   : records saved on EEPROM by the last fault
+void requestTrace(){
+
+    if (SCmd.next() == NULL){
+        Trace.dump(Serial);
+    }else{
+        Trace.dumpSnapshot(Serial);   //Count 0 if there is no snapshot
+    }
+}
+
+
+//-- Records a serial command in the trace: letter and first argument
+void traceCommand(char command, int arg){
+
+    Trace.record(TRACE_COMMAND, ((uint16_t)command << 8) | (arg & 0xFF));
 }
 
 
 //-- Function to send Ack comand (A)
+//-- The reply is queued in one write and never waits for the TX buffer
 void sendAck(){
 
-  delay(30);
-
-  Serial.print(F("&&"));
-  Serial.print(F("A"));
-  Serial.println(F("%%"));
-  Serial.flush();
+  SCmd.sendReply('A');
 }
 
 
 //-- Function to send final Ack comand (F)
 void sendFinalAck(){
 
-  delay(30);
-
-  Serial.print(F("&&"));
-  Serial.print(F("F"));
-  Serial.println(F("%%"));
-  Serial.flush();
+  SCmd.sendReply('F');
 }
 
 
@@ -1037,20 +1668,32 @@ void sendFinalAck(){
 
 void ZowiLowBatteryAlarm(){
 
-    double batteryLevel = zowi.getBatteryLevel();
+    uint8_t batteryState=zowi.getBatteryState();
+    if(batteryState!=BatReader::BAT_OK){
 
-    if(batteryLevel<45){
+      //Keep the trace of what led here across the coming reset. Once per
+      //boot, and at the LOW level: an EEPROM write cut short by a brown-out
+      //at the critical level would leave the EEPROM corrupted
+      Trace.record(TRACE_FAULT, zowi.getBatteryPercent()/100);
+      if (!traceSaved && batteryState==BatReader::BAT_LOW){
+        Trace.snapshot();
+        traceSaved=true;
+      }
         
-      while(!buttonPushed){
+      //Until a button is pressed or the battery recovers (charging)
+      ZowiButtonEvent event;
+      while(!buttonPushed && zowi.getBatteryState()!=BatReader::BAT_OK){
+
+          if(buttons.read(event) && event.type==BUTTON_PRESS){break;}
 
           zowi.putMouth(thunder);
           zowi.bendTones (880, 2000, 1.04, 8, 3);  //A5 = 880
           
-          delay(30);
+          zowi.pause(30);
 
           zowi.bendTones (2000, 880, 1.02, 8, 3);  //A5 = 880
           zowi.clearMouth();
-          delay(500);
+          zowi.pause(500);
       } 
     }
 }
@@ -1077,7 +1720,7 @@ void ZowiSleeping_withInterrupts(){
       zowi.putAnimationMouth(dreamMouth,2);
       zowi.bendTones (300, 500, 1.04, 10, 10);   
 
-    delay(500);
+    zowi.pause(500);
     
     if(buttonPushed){break;}
       zowi.putAnimationMouth(dreamMouth,1);
@@ -1087,7 +1730,7 @@ void ZowiSleeping_withInterrupts(){
       zowi.putAnimationMouth(dreamMouth,0);
       zowi.bendTones (250, 100, 1.04, 10, 1); 
     
-    delay(500);
+    zowi.pause(500);
   } 
 
   if(!buttonPushed){
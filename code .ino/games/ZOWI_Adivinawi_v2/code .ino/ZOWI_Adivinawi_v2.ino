@@ -12,21 +12,29 @@
 #include <Servo.h>
 #include <Oscillator.h>
 #include <EEPROM.h>
-#include <BatReader.h>
 #include <US.h>
 #include <LedMatrix.h>
 
-//-- Library to manage external interruptions
-#include <EnableInterrupt.h> 
+//-- Library to manage Zowi buttons (interrupt-driven & debounced)
+#include <ZowiButtons.h>
+ZowiButtons buttons;
 
 //-- Library to manage serial commands
 #include <ZowiSerialCommand.h>
 ZowiSerialCommand SCmd;  //The SerialCommand object
 
+//-- Trims and name kept in the EEPROM (shared with ZOWI_BASE_v2)
+#include <ZowiSettings.h>
+ZowiSettings settings;
+
 //-- Zowi Library
 #include <Zowi.h>
 Zowi zowi;  //This is Zowi!!
 
+//-- Claps heard by the noise sensor, as timestamped patterns
+#include <ClapDetector.h>
+ClapDetector claps;
+
 //---------------------------------------------------------
 //-- Configuration of pins where the servos are attached
 /*
@@ -81,6 +89,7 @@ volatile int MODE=0; //State of zowi in the principal state machine.
 volatile bool buttonPushed=false;  //Variable to remember when a button has been pushed
 volatile bool buttonAPushed=false; //Variable to remember when A button has been pushed
 volatile bool buttonBPushed=false; //Variable to remember when B button has been pushed
+bool handlingButtons=false;        //True while the loop reacts to a button push
 
 unsigned long previousMillis=0;
 
@@ -89,6 +98,8 @@ int randomSteps=0;
 
 bool obstacleDetected = false;
 
+ClapEvent clap;  //Last clap pattern heard
+
 unsigned long int rock_symbol=    0b00000000001100011110011110001100;
 unsigned long int paper_symbol=   0b00011110010010010010010010011110;
 unsigned long int scissors_symbol=0b00000010010100001000010100000010;
@@ -106,22 +117,30 @@ void setup() {
   //Serial communication initialization
   Serial.begin(115200);  
 
-  pinMode(PIN_SecondButton,INPUT);
-  pinMode(PIN_ThirdButton,INPUT);
-  
   //Set the servo pins
-  zowi.init(PIN_YL,PIN_YR,PIN_RL,PIN_RR,true);
+  zowi.init(PIN_RL,PIN_RR,false);
+
+  //Trims and name are read once from the EEPROM
+  settings.load();
+  zowi.setTrims(settings.get().trims[0], settings.get().trims[1], 0, 0);
  
-  //Uncomment this to set the servo trims manually and save on EEPROM 
-    //zowi.setTrims(TRIM_YL, TRIM_YR, TRIM_RL, TRIM_RR);
-    //zowi.saveTrimsOnEEPROM(); //Uncomment this only for one upload when you finaly set the trims.
+  //Uncomment this to set the servo trims manually and keep them in the settings
+    //settings.get().trims[0]=TRIM_YL; settings.get().trims[1]=TRIM_YR;
+    //settings.save(); //Uncomment this only for one upload when you finaly set the trims.
+    //zowi.setTrims(TRIM_YL, TRIM_YR, 0, 0);
 
   //Set a random seed
-  randomSeed(analogRead(A6));
+  randomSeed(zowi.getNoise());
+
+  //The noise sensor is sampled in the background from now on
+  claps.init(PIN_NoiseSensor);
 
   //Interrumptions
-  enableInterrupt(PIN_SecondButton, secondButtonPushed, RISING);
-  enableInterrupt(PIN_ThirdButton, thirdButtonPushed, RISING);
+  buttons.init(PIN_SecondButton, PIN_ThirdButton);
+  buttons.onPress(buttonsPushed);
+
+  //A pushed button cuts short any song, gesture or movement in progress
+  zowi.setCancelSource(buttonInterrupts);
 
   //Setup callbacks for SerialCommand commands 
   SCmd.addCommand("S", receiveStop);      //  sendAck & sendFinalAck
@@ -140,9 +159,7 @@ void setup() {
 
   //Send Zowi name, programID & battery level.
   requestName();
-  delay(50);
   requestProgramId();
-  delay(50);
   requestBattery();
   
   //Checking battery
@@ -191,8 +208,7 @@ void loop() {
     zowi.putMouth(happyOpen);
 
     //Disable Pin Interruptions
-    disableInterrupt(PIN_SecondButton);
-    disableInterrupt(PIN_ThirdButton);
+    buttons.end();
 
     buttonPushed=false;
   }
@@ -201,6 +217,8 @@ void loop() {
   //First attemp to initial software
   if (buttonPushed){  
 
+    handlingButtons=true;
+    zowi.putMouth(smallSurprise);
     zowi.home();
 
     delay(100); //Wait for all buttons 
@@ -228,6 +246,10 @@ void loop() {
     buttonPushed=false;
     buttonAPushed=false;
     buttonBPushed=false;
+    handlingButtons=false;
+
+    //Only the claps heard from now on count, not the songs above
+    claps.flush();
 
   }else{
 
@@ -250,11 +272,8 @@ void loop() {
       //---------------------------------------------------------
       case 1:
         
-        delay(50);
-        
-        if (zowi.getNoise()>=680){ //740
-  
-          delay(50);
+        if (claps.read(clap)){
+
           ZowiMagics(2);
 
           int randomNum = random(1,3); //1,2  - YES, NO
@@ -285,12 +304,12 @@ void loop() {
                 zowi.bendTones(note_A5, note_D6, 1.02, 7, 4);
                 zowi.bendTones(note_D6, note_G6, 1.02, 10, 1);
                 zowi.bendTones(note_G6, note_A5, 1.02, 10, 1);
-                delay(15);
+                zowi.pause(15);
               }
 
               if (!buttonPushed){ 
                 zowi.bendTones(note_A5, note_E5, 1.02, 20, 4);
-                delay(400);
+                zowi.pause(400);
                 zowi._moveServos(200, headLeft2); 
               }
               
@@ -304,12 +323,12 @@ void loop() {
           zowi.home();
 
           if (!buttonPushed){
-            delay(2000);
+            zowi.pause(2000);
           } 
 
           if (!buttonPushed){ 
             zowi.clearMouth();
-            delay(500);
+            zowi.pause(500);
           }  
 
           if (!buttonPushed){
@@ -319,10 +338,12 @@ void loop() {
 
           if (!buttonPushed){
             zowi.clearMouth();
-            delay(200); 
+            zowi.pause(200); 
             zowi.putMouth(interrogation);
           }  
 
+          //Zowi's own sounds are not claps
+          claps.flush();
         }
         break;
 
@@ -331,11 +352,8 @@ void loop() {
       //---------------------------------------------------------  
       case 2:
 
-        delay(50);
+        if (claps.read(clap)){
 
-        if (zowi.getNoise()>=680){ //740
-          
-          delay(50);
           ZowiMagics(1);
 
           int randomNum = random(1,7); //1-6
@@ -350,17 +368,17 @@ void loop() {
           }  
           
           for(int i=0; i<4; i++){
-              if (!buttonPushed){ zowi.clearMouth(); delay(200);}
-              if (!buttonPushed){ zowi.putMouth(randomNum); delay(200);}
+              if (!buttonPushed){ zowi.clearMouth(); zowi.pause(200);}
+              if (!buttonPushed){ zowi.putMouth(randomNum); zowi.pause(200);}
           }
           
           if (!buttonPushed){
-            delay(2300);
+            zowi.pause(2300);
           }
 
           if (!buttonPushed){ 
             zowi.clearMouth();
-            delay(100);
+            zowi.pause(100);
           }  
 
           if (!buttonPushed){
@@ -370,10 +388,11 @@ void loop() {
 
           if (!buttonPushed){
             zowi.clearMouth();
-            delay(200); 
+            zowi.pause(200); 
             zowi.putMouth(interrogation);
           } 
 
+          claps.flush();
         }
  
 
@@ -383,11 +402,7 @@ void loop() {
       //---------------------------------------------------------
       case 3:
 
-        delay(50);
-
-        if (zowi.getNoise()>=680){ //740
-          
-          delay(50);
+        if (claps.read(clap)){
           
           switch (random(0,3)){
 
@@ -411,12 +426,12 @@ void loop() {
           }
 
           if (!buttonPushed){
-            delay(2500);
+            zowi.pause(2500);
           }
 
           if (!buttonPushed){ 
             zowi.clearMouth();
-            delay(100);
+            zowi.pause(100);
           }  
 
           if (!buttonPushed){
@@ -426,9 +441,11 @@ void loop() {
 
           if (!buttonPushed){
             zowi.clearMouth();
-            delay(200); 
+            zowi.pause(200); 
             zowi.putMouth(interrogation);
           } 
+
+          claps.flush();
         }
         break;
 
@@ -492,33 +509,28 @@ void ZowiMagics(int repetitions){
         } 
  
         if(!buttonPushed){
-          delay(300);
+          zowi.pause(300);
           zowi.putMouth(happyOpen);
         }
         
 }
 
 
-//-- Function executed when second button is pushed
-void secondButtonPushed(){ 
+//-- Function executed (from the button interrupt) when a debounced press is confirmed
+void buttonsPushed(uint8_t button){ 
 
-    buttonAPushed=true;
+    if(button==BUTTON_A){ buttonAPushed=true; }
+    if(button==BUTTON_B){ buttonBPushed=true; }
 
-    if(!buttonPushed){
-        buttonPushed=true;
-        zowi.putMouth(smallSurprise);
-    }    
+    buttonPushed=true;      //The surprise mouth is drawn by loop(): not from an interrupt
 }
 
-//-- Function executed when third button is pushed
-void thirdButtonPushed(){ 
 
-    buttonBPushed=true;
+//-- Cancel source for zowi: a button push stops the current animation,
+//-- but not the songs played while the push itself is being handled
+bool buttonInterrupts(){
 
-    if(!buttonPushed){
-        buttonPushed=true;
-        zowi.putMouth(smallSurprise);
-    }
+    return buttonPushed && !handlingButtons;
 }
 
 
@@ -539,21 +551,15 @@ void receiveName(){
     sendAck();
     zowi.home(); 
 
-    char newZowiName[11] = "";  //Variable to store data read from Serial.
-    int eeAddress = 5;          //Location we want the data to be in EEPROM.
     char *arg; 
     arg = SCmd.next(); 
     
     if (arg != NULL) {
 
-      //Complete newZowiName char string
-      int k = 0;
-      while((*arg) && (k<11)){ 
-          newZowiName[k]=*arg++;
-          k++;
-      }
-      
-      EEPROM.put(eeAddress, newZowiName); 
+      //Up to 10 characters, the rest is cut
+      strncpy(settings.get().name, arg, SETTINGS_NAME_LENGTH);
+      settings.get().name[SETTINGS_NAME_LENGTH]='\0';
+      settings.save(); 
     }
     else 
     {
@@ -572,17 +578,7 @@ void requestName(){
 
     zowi.home(); //stop if necessary
 
-    char actualZowiName[11]= "";  //Variable to store data read from EEPROM.
-    int eeAddress = 5;            //EEPROM address to start reading from
-
-    //Get the float data from the EEPROM at position 'eeAddress'
-    EEPROM.get(eeAddress, actualZowiName);
-
-    Serial.print(F("&&"));
-    Serial.print(F("E "));
-    Serial.print(actualZowiName);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('E', settings.get().name);
 }
 
 
@@ -591,14 +587,7 @@ void requestBattery(){
 
     zowi.home();  //stop if necessary
 
-    //The first read of the batery is often a wrong reading, so we will discard this value. 
-    double batteryLevel = zowi.getBatteryLevel();
-
-    Serial.print(F("&&"));
-    Serial.print(F("B "));
-    Serial.print(batteryLevel);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('B', zowi.getBatteryPercent(), 2);  //Two decimals, as Serial.print(double) did
 }
 
 
@@ -607,35 +596,22 @@ void requestProgramId(){
 
     zowi.home();   //stop if necessary
 
-    Serial.print(F("&&"));
-    Serial.print(F("I "));
-    Serial.print(programID);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('I', programID);
 }
 
 
 //-- Function to send Ack comand (A)
+//-- The reply is queued in one write and never waits for the TX buffer
 void sendAck(){
 
-  delay(30);
-
-  Serial.print(F("&&"));
-  Serial.print(F("A"));
-  Serial.println(F("%%"));
-  Serial.flush();
+  SCmd.sendReply('A');
 }
 
 
 //-- Function to send final Ack comand (F)
 void sendFinalAck(){
 
-  delay(30);
-
-  Serial.print(F("&&"));
-  Serial.print(F("F"));
-  Serial.println(F("%%"));
-  Serial.flush();
+  SCmd.sendReply('F');
 }
 
 
@@ -645,20 +621,18 @@ void sendFinalAck(){
 
 void ZowiLowBatteryAlarm(){
 
-    double batteryLevel = zowi.getBatteryLevel();
-
-    if(batteryLevel<45){
+    if(zowi.getBatteryState()!=BatReader::BAT_OK){
         
       while(!buttonPushed){
 
           zowi.putMouth(thunder);
           zowi.bendTones (880, 2000, 1.04, 8, 3);  //A5 = 880
           
-          delay(30);
+          zowi.pause(30);
 
           zowi.bendTones (2000, 880, 1.02, 8, 3);  //A5 = 880
           zowi.clearMouth();
-          delay(500);
+          zowi.pause(500);
       } 
     }
 }
@@ -685,7 +659,7 @@ void ZowiSleeping_withInterrupts(){
       zowi.putAnimationMouth(dreamMouth,2);
       zowi.bendTones (300, 500, 1.04, 10, 10);   
 
-    delay(500);
+    zowi.pause(500);
     
     if(buttonPushed){break;}
       zowi.putAnimationMouth(dreamMouth,1);
@@ -695,7 +669,7 @@ void ZowiSleeping_withInterrupts(){
       zowi.putAnimationMouth(dreamMouth,0);
       zowi.bendTones (250, 100, 1.04, 10, 1); 
     
-    delay(500);
+    zowi.pause(500);
   } 
 
   if(!buttonPushed){
@@ -12,17 +12,21 @@
 #include <Servo.h>
 #include <Oscillator.h>
 #include <EEPROM.h>
-#include <BatReader.h>
 #include <US.h>
 #include <LedMatrix.h>
 
-//-- Library to manage external interruptions
-#include <EnableInterrupt.h> 
+//-- Library to manage Zowi buttons (interrupt-driven & debounced)
+#include <ZowiButtons.h>
+ZowiButtons buttons;
 
 //-- Library to manage serial commands
 #include <ZowiSerialCommand.h>
 ZowiSerialCommand SCmd;  //The SerialCommand object
 
+//-- Trims and name kept in the EEPROM (shared with ZOWI_BASE_v2)
+#include <ZowiSettings.h>
+ZowiSettings settings;
+
 //-- Zowi Library
 #include <Zowi.h>
 Zowi zowi;  //This is Zowi!!
@@ -81,6 +85,7 @@ volatile int MODE=0; //State of zowi in the principal state machine.
 volatile bool buttonPushed=false;  //Variable to remember when a button has been pushed
 volatile bool buttonAPushed=false; //Variable to remember when A button has been pushed
 volatile bool buttonBPushed=false; //Variable to remember when B button has been pushed
+bool handlingButtons=false;        //True while the loop reacts to a button push
 
 unsigned long previousMillis=0;
 
@@ -106,22 +111,27 @@ void setup() {
   //Serial communication initialization
   Serial.begin(115200);  
 
-  pinMode(PIN_SecondButton,INPUT);
-  pinMode(PIN_ThirdButton,INPUT);
-  
   //Set the servo pins
-  zowi.init(PIN_YL,PIN_YR,PIN_RL,PIN_RR,true);
+  zowi.init(PIN_RL,PIN_RR,false);
+
+  //Trims and name are read once from the EEPROM
+  settings.load();
+  zowi.setTrims(settings.get().trims[0], settings.get().trims[1], 0, 0);
  
-  //Uncomment this to set the servo trims manually and save on EEPROM 
-    //zowi.setTrims(TRIM_YL, TRIM_YR, TRIM_RL, TRIM_RR);
-    //zowi.saveTrimsOnEEPROM(); //Uncomment this only for one upload when you finaly set the trims.
+  //Uncomment this to set the servo trims manually and keep them in the settings
+    //settings.get().trims[0]=TRIM_YL; settings.get().trims[1]=TRIM_YR;
+    //settings.save(); //Uncomment this only for one upload when you finaly set the trims.
+    //zowi.setTrims(TRIM_YL, TRIM_YR, 0, 0);
 
   //Set a random seed
-  randomSeed(analogRead(A6));
+  randomSeed(zowi.getNoise());
 
   //Interrumptions
-  enableInterrupt(PIN_SecondButton, secondButtonPushed, RISING);
-  enableInterrupt(PIN_ThirdButton, thirdButtonPushed, RISING);
+  buttons.init(PIN_SecondButton, PIN_ThirdButton);
+  buttons.onPress(buttonsPushed);
+
+  //A pushed button cuts short any song, gesture or movement in progress
+  zowi.setCancelSource(buttonInterrupts);
 
   //Setup callbacks for SerialCommand commands 
   SCmd.addCommand("S", receiveStop);      //  sendAck & sendFinalAck
@@ -139,9 +149,7 @@ void setup() {
 
   //Send Zowi name, programID & battery level.
   requestName();
-  delay(50);
   requestProgramId();
-  delay(50);
   requestBattery();
   
   //Checking battery
@@ -190,8 +198,7 @@ void loop() {
     zowi.putMouth(happyOpen);
 
     //Disable Pin Interruptions
-    disableInterrupt(PIN_SecondButton);
-    disableInterrupt(PIN_ThirdButton);
+    buttons.end();
 
     buttonPushed=false;
   }
@@ -200,6 +207,8 @@ void loop() {
   //First attemp to initial software
   if (buttonPushed){  
 
+    handlingButtons=true;
+    zowi.putMouth(smallSurprise);
     zowi.home();
 
     delay(100); //Wait for all buttons 
@@ -225,6 +234,7 @@ void loop() {
     buttonPushed=false;
     buttonAPushed=false;
     buttonBPushed=false;
+    handlingButtons=false;
     alarmActivated = false;
     previousMillis = millis();
 
@@ -258,7 +268,7 @@ void loop() {
         }else{
 
           delay(100);
-          int obstacleDistance = zowi.getDistance();
+          int obstacleDistance = zowi.getDistanceCm();
           int noise = zowi.getNoise();
           delay(100);
         
@@ -271,11 +281,11 @@ void loop() {
                   zowi.putMouth(alarm_symbol,0);
                   zowi.bendTones (note_A5, note_A7, 1.04, 5, 2);  //A5 = 880 , A7 = 3520
           
-                  delay(20);
+                  zowi.pause(20);
 
                   zowi.bendTones (note_A7, note_A5, 1.02, 5, 2);  //A5 = 880 , A7 = 3520
                   zowi.clearMouth();
-                  delay(300);
+                  zowi.pause(300);
               } 
           }
 
@@ -299,7 +309,7 @@ void loop() {
         }else{
 
           delay(100);
-          int obstacleDistance = zowi.getDistance();
+          int obstacleDistance = zowi.getDistanceCm();
           int noise = zowi.getNoise();
           delay(100);
         
@@ -312,11 +322,11 @@ void loop() {
                   zowi.putMouth(alarm_symbol,0);
                   zowi.bendTones (note_A5, note_A7, 1.04, 5, 2);  //A5 = 880 , A7 = 3520
           
-                  delay(20);
+                  zowi.pause(20);
 
                   zowi.bendTones (note_A7, note_A5, 1.02, 5, 2);  //A5 = 880 , A7 = 3520
                   zowi.clearMouth();
-                  delay(300);
+                  zowi.pause(300);
               } 
           }
 
@@ -326,9 +336,9 @@ void loop() {
               
               if (!buttonPushed){   
 
-                delay(100);
-                initDistance = zowi.getDistance();
-                delay(100);
+                zowi.pause(100);
+                initDistance = zowi.getDistanceCm();
+                zowi.pause(100);
                 initDistance -= 10;
               }
                 
@@ -362,28 +372,23 @@ void loop() {
 //-- Functions --------------------------------------------------//
 ///////////////////////////////////////////////////////////////////
 
-//-- Function executed when second button is pushed
-void secondButtonPushed(){ 
+//-- Function executed (from the button interrupt) when a debounced press is confirmed
+void buttonsPushed(uint8_t button){ 
 
-    buttonAPushed=true;
+    if(button==BUTTON_A){ buttonAPushed=true; }
+    if(button==BUTTON_B){ buttonBPushed=true; }
 
-    if(!buttonPushed){
-        buttonPushed=true;
-        zowi.putMouth(smallSurprise);
-    }    
+    buttonPushed=true;      //The surprise mouth is drawn by loop(): not from an interrupt
 }
 
-//-- Function executed when third button is pushed
-void thirdButtonPushed(){ 
 
-    buttonBPushed=true;
 
-    if(!buttonPushed){
-        buttonPushed=true;
-        zowi.putMouth(smallSurprise);
-    }
-}
+//-- Cancel source for zowi: a button push stops the current animation,
+//-- but not the songs played while the push itself is being handled
+bool buttonInterrupts(){
 
+    return buttonPushed && !handlingButtons;
+}
 
 
 //-- Function to receive Stop command.
@@ -403,21 +408,15 @@ void receiveName(){
     sendAck();
     zowi.home(); 
 
-    char newZowiName[11] = "";  //Variable to store data read from Serial.
-    int eeAddress = 5;          //Location we want the data to be in EEPROM.
     char *arg; 
     arg = SCmd.next(); 
     
     if (arg != NULL) {
 
-      //Complete newZowiName char string
-      int k = 0;
-      while((*arg) && (k<11)){ 
-          newZowiName[k]=*arg++;
-          k++;
-      }
-      
-      EEPROM.put(eeAddress, newZowiName); 
+      //Up to 10 characters, the rest is cut
+      strncpy(settings.get().name, arg, SETTINGS_NAME_LENGTH);
+      settings.get().name[SETTINGS_NAME_LENGTH]='\0';
+      settings.save(); 
     }
     else 
     {
@@ -436,17 +435,7 @@ void requestName(){
 
     zowi.home(); //stop if necessary
 
-    char actualZowiName[11]= "";  //Variable to store data read from EEPROM.
-    int eeAddress = 5;            //EEPROM address to start reading from
-
-    //Get the float data from the EEPROM at position 'eeAddress'
-    EEPROM.get(eeAddress, actualZowiName);
-
-    Serial.print(F("&&"));
-    Serial.print(F("E "));
-    Serial.print(actualZowiName);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('E', settings.get().name);
 }
 
 
@@ -456,14 +445,7 @@ void requestBattery(){
 
     zowi.home();  //stop if necessary
 
-    //The first read of the batery is often a wrong reading, so we will discard this value. 
-    double batteryLevel = zowi.getBatteryLevel();
-
-    Serial.print(F("&&"));
-    Serial.print(F("B "));
-    Serial.print(batteryLevel);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('B', zowi.getBatteryPercent(), 2);  //Two decimals, as Serial.print(double) did
 }
 
 
@@ -472,35 +454,22 @@ void requestProgramId(){
 
     zowi.home();   //stop if necessary
 
-    Serial.print(F("&&"));
-    Serial.print(F("I "));
-    Serial.print(programID);
-    Serial.println(F("%%"));
-    Serial.flush();
+    SCmd.sendReply('I', programID);
 }
 
 
 //-- Function to send Ack comand (A)
+//-- The reply is queued in one write and never waits for the TX buffer
 void sendAck(){
 
-  delay(30);
-
-  Serial.print(F("&&"));
-  Serial.print(F("A"));
-  Serial.println(F("%%"));
-  Serial.flush();
+  SCmd.sendReply('A');
 }
 
 
 //-- Function to send final Ack comand (F)
 void sendFinalAck(){
 
-  delay(30);
-
-  Serial.print(F("&&"));
-  Serial.print(F("F"));
-  Serial.println(F("%%"));
-  Serial.flush();
+  SCmd.sendReply('F');
 }
 
 
@@ -510,20 +479,18 @@ void sendFinalAck(){
 
 void ZowiLowBatteryAlarm(){
 
-    double batteryLevel = zowi.getBatteryLevel();
-
-    if(batteryLevel<45){
+    if(zowi.getBatteryState()!=BatReader::BAT_OK){
         
       while(!buttonPushed){
 
           zowi.putMouth(thunder);
           zowi.bendTones (880, 2000, 1.04, 8, 3);  //A5 = 880
           
-          delay(30);
+          zowi.pause(30);
 
           zowi.bendTones (2000, 880, 1.02, 8, 3);  //A5 = 880
           zowi.clearMouth();
-          delay(500);
+          zowi.pause(500);
       } 
     }
 }
@@ -550,7 +517,7 @@ void ZowiSleeping_withInterrupts(){
       zowi.putAnimationMouth(dreamMouth,2);
       zowi.bendTones (300, 500, 1.04, 10, 10);   
 
-    delay(500);
+    zowi.pause(500);
     
     if(buttonPushed){break;}
       zowi.putAnimationMouth(dreamMouth,1);
@@ -560,7 +527,7 @@ void ZowiSleeping_withInterrupts(){
       zowi.putAnimationMouth(dreamMouth,0);
       zowi.bendTones (250, 100, 1.04, 10, 1); 
     
-    delay(500);
+    zowi.pause(500);
   } 
 
   if(!buttonPushed){
@@ -581,7 +548,7 @@ void ZowiArmingAlarmSystem(){
       zowi.putMouth(arming_symbol,0);
       zowi._tone(note_A7,50,0); //bip'
       zowi.clearMouth();
-      delay(950);   
+      zowi.pause(950);   
 
       if(buttonPushed){break;}
 
@@ -589,9 +556,9 @@ void ZowiArmingAlarmSystem(){
 
     if(!buttonPushed){
       alarmActivated = true;
-      delay(100);
-      initDistance = zowi.getDistance();
-      delay(100);
+      zowi.pause(100);
+      initDistance = zowi.getDistanceCm();
+      zowi.pause(100);
       initDistance -= 10;
       previousMillis=millis(); 
     }
@@ -603,16 +570,16 @@ void ZowiGuardian(){
 
     if (!buttonPushed){ 
       zowi.putMouth(smallSurprise); 
-      delay(100);
+      zowi.pause(100);
       zowi.sing(S_cuddly);
-      delay(500);
+      zowi.pause(500);
     }  
     
     if (!buttonPushed){ 
       zowi.putMouth(angry);
       zowi.bendTones(note_A5, note_D6, 1.02, 20, 4);
       zowi.bendTones(note_A5, note_E5, 1.02, 20, 4);
-      delay(300);
+      zowi.pause(300);
       zowi.putMouth(lineMouth);
     }  
 
@@ -625,35 +592,35 @@ void ZowiGuardian(){
 
     if (!buttonPushed){ 
         zowi.putMouth(angry);
-        delay(500); 
+        zowi.pause(500); 
     }  
 
 
     if (!buttonPushed){ 
         zowi._moveServos(1000, headLeft2);
-        delay(400);
+        zowi.pause(400);
     }
 
     if (!buttonPushed){ 
         zowi.home();
-        delay(400);
+        zowi.pause(400);
     }
 
     if (!buttonPushed){   
         zowi._moveServos(1000, headRight2); 
-        delay(400);
+        zowi.pause(400);
     }
 
     if (!buttonPushed){ 
-        delay(300);
+        zowi.pause(300);
         zowi.home();
         zowi.putMouth(smile); 
-        delay(100);
+        zowi.pause(100);
     }
       
     if (!buttonPushed){   
         zowi.sing(S_happy_short);
-        delay(800);
+        zowi.pause(800);
         zowi.clearMouth();
     }       
 
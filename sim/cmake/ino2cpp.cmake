@@ -0,0 +1,35 @@
+#--------------------------------------------------------------
+#-- ino2cpp.cmake
+#-- Turn an Arduino sketch into a C++ translation unit the way
+#-- the Arduino builder does: include Arduino.h and forward
+#-- declare every top-level function before the sketch body.
+#--
+#-- Usage: cmake -DINO=<sketch.ino> -DOUT=<sketch.cpp> -P ino2cpp.cmake
+#--------------------------------------------------------------
+file(READ "${INO}" body)
+
+set(prototypes "")
+string(REGEX MATCHALL
+  "\n[A-Za-z_][A-Za-z0-9_]*[ \t*&]+[*&]*[A-Za-z_][A-Za-z0-9_]*[ \t]*\\([^\n;{}()]*\\)[ \t]*\\{"
+  candidates "${body}")
+
+foreach(candidate IN LISTS candidates)
+  string(STRIP "${candidate}" candidate)
+  string(REGEX REPLACE "[ \t]*\\{$" "" candidate "${candidate}")
+  if(candidate MATCHES "^(else|return|typedef|case|do|while|for|if|switch)[ \t(]")
+    continue()
+  endif()
+  if(candidate MATCHES "[ \t*&](setup|loop)[ \t]*\\(")
+    continue()
+  endif()
+  string(APPEND prototypes "${candidate};\n")
+endforeach()
+
+file(WRITE "${OUT}.tmp"
+  "// Generated from ${INO} -- do not edit\n"
+  "#include <Arduino.h>\n"
+  "${prototypes}"
+  "#line 1 \"${INO}\"\n"
+  "#include \"${INO}\"\n")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different "${OUT}.tmp" "${OUT}")
+file(REMOVE "${OUT}.tmp")
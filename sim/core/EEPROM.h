@@ -0,0 +1,46 @@
+//--------------------------------------------------------------
+//-- EEPROM.h (host simulation)
+//-- 1 KB EEPROM in RAM with a physical write counter
+//--------------------------------------------------------------
+#ifndef EEPROM_h
+#define EEPROM_h
+
+#include <inttypes.h>
+#include <stdint.h>
+
+extern uint8_t sim_eeprom[1024];
+extern unsigned long sim_eeprom_writes;
+
+struct EERef {
+  EERef(const int index) : index(index) {}
+  uint8_t operator*() const { return sim_eeprom[index & 0x3FF]; }
+  operator uint8_t() const { return **this; }
+  EERef &operator=(const EERef &ref) { return *this = *ref; }
+  EERef &operator=(uint8_t in) { sim_eeprom[index & 0x3FF] = in; sim_eeprom_writes++; return *this; }
+  EERef &update(uint8_t in) { return in != *this ? *this = in : *this; }
+  int index;
+};
+
+struct EEPROMClass {
+  EERef operator[](const int idx) { return idx; }
+  uint8_t read(int idx) { return EERef(idx); }
+  void write(int idx, uint8_t val) { (EERef(idx)) = val; }
+  void update(int idx, uint8_t val) { EERef(idx).update(val); }
+  uint16_t length() { return sizeof(sim_eeprom); }
+
+  template <typename T> T &get(int idx, T &t) {
+    uint8_t *ptr = (uint8_t *)&t;
+    for (int count = sizeof(T); count; --count, ++idx) *ptr++ = EERef(idx);
+    return t;
+  }
+
+  template <typename T> const T &put(int idx, const T &t) {
+    const uint8_t *ptr = (const uint8_t *)&t;
+    for (int count = sizeof(T); count; --count, ++idx) EERef(idx).update(*ptr++);
+    return t;
+  }
+};
+
+static EEPROMClass EEPROM;
+
+#endif // EEPROM_h
@@ -0,0 +1,34 @@
+//--------------------------------------------------------------
+//-- Servo.h (host simulation)
+//-- Servo stub that records every pulse width change
+//--------------------------------------------------------------
+#ifndef Servo_h
+#define Servo_h
+
+#include <inttypes.h>
+
+#define MIN_PULSE_WIDTH       544
+#define MAX_PULSE_WIDTH      2400
+#define DEFAULT_PULSE_WIDTH  1500
+#define INVALID_SERVO         255
+
+class Servo
+{
+public:
+  Servo();
+  uint8_t attach(int pin);
+  uint8_t attach(int pin, int min, int max);
+  void detach();
+  void write(int value);
+  void writeMicroseconds(int value);
+  int read();
+  int readMicroseconds();
+  bool attached();
+private:
+  int8_t pin;
+  int angle;
+  int min_us;
+  int max_us;
+};
+
+#endif // Servo_h
@@ -0,0 +1,43 @@
+//--------------------------------------------------------------
+//-- avr/interrupt.h (host simulation)
+//-- ISR() bodies become plain functions the virtual core calls
+//--------------------------------------------------------------
+#ifndef sim_avr_interrupt_h
+#define sim_avr_interrupt_h
+
+#include "avr/io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void sim_sei(void);
+void sim_cli(void);
+
+//-- Interrupt vectors the virtual core knows how to raise
+void TIMER0_COMPA_vect(void);
+void TIMER0_COMPB_vect(void);
+void ADC_vect(void);
+void PCINT0_vect(void);
+void PCINT1_vect(void);
+void PCINT2_vect(void);
+void WDT_vect(void);
+#ifdef __cplusplus
+}
+#endif
+
+#define sei() sim_sei()
+#define cli() sim_cli()
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+
+#ifdef __cplusplus
+  #define ISR(vector, ...) extern "C" void vector(void)
+#else
+  #define ISR(vector, ...) void vector(void)
+#endif
+#define EMPTY_INTERRUPT(vector) ISR(vector) {}
+#define reti() return
+
+#endif // sim_avr_interrupt_h
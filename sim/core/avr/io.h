@@ -0,0 +1,142 @@
+//--------------------------------------------------------------
+//-- avr/io.h (host simulation)
+//-- ATmega328P I/O registers backed by a plain byte array
+//--------------------------------------------------------------
+//-- Register names map to the same data-space addresses as on
+//-- the real chip, so code that pokes PORTx/PINx/ADCSRA/... works
+//-- unchanged and the virtual core can observe it.
+//--------------------------------------------------------------
+#ifndef sim_avr_io_h
+#define sim_avr_io_h
+
+#include <stdint.h>
+
+extern volatile uint8_t sim_reg[256];
+
+#define _SFR_MEM8(addr)  (sim_reg[(addr)])
+#define _SFR_MEM16(addr) (*(volatile uint16_t *)(&sim_reg[(addr)]))
+#define _SFR_IO8(addr)   (sim_reg[(addr) + 0x20])
+#define _BV(bit) (1 << (bit))
+#define bit_is_set(sfr, bit)   ((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit) (!((sfr) & _BV(bit)))
+
+//-- Ports
+#define PINB   _SFR_MEM8(0x23)
+#define DDRB   _SFR_MEM8(0x24)
+#define PORTB  _SFR_MEM8(0x25)
+#define PINC   _SFR_MEM8(0x26)
+#define DDRC   _SFR_MEM8(0x27)
+#define PORTC  _SFR_MEM8(0x28)
+#define PIND   _SFR_MEM8(0x29)
+#define DDRD   _SFR_MEM8(0x2A)
+#define PORTD  _SFR_MEM8(0x2B)
+
+//-- Timer 0
+#define TIFR0  _SFR_MEM8(0x35)
+#define TCCR0A _SFR_MEM8(0x44)
+#define TCCR0B _SFR_MEM8(0x45)
+#define TCNT0  _SFR_MEM8(0x46)
+#define OCR0A  _SFR_MEM8(0x47)
+#define OCR0B  _SFR_MEM8(0x48)
+#define TIMSK0 _SFR_MEM8(0x6E)
+#define TOIE0  0
+#define OCIE0A 1
+#define OCIE0B 2
+#define TOV0   0
+#define OCF0A  1
+#define OCF0B  2
+
+//-- Timer 1 (registers only: the virtual core does not run it)
+#define TIFR1  _SFR_MEM8(0x36)
+#define TIMSK1 _SFR_MEM8(0x6F)
+#define TCCR1A _SFR_MEM8(0x80)
+#define TCCR1B _SFR_MEM8(0x81)
+#define TCNT1  _SFR_MEM16(0x84)
+#define TOIE1  0
+#define TOV1   0
+#define CS10   0
+#define CS11   1
+#define CS12   2
+
+//-- External and pin change interrupts
+#define PCIFR  _SFR_MEM8(0x3B)
+#define EIFR   _SFR_MEM8(0x3C)
+#define EIMSK  _SFR_MEM8(0x3D)
+#define PCICR  _SFR_MEM8(0x68)
+#define EICRA  _SFR_MEM8(0x69)
+#define PCMSK0 _SFR_MEM8(0x6B)
+#define PCMSK1 _SFR_MEM8(0x6C)
+#define PCMSK2 _SFR_MEM8(0x6D)
+#define PCIE0  0
+#define PCIE1  1
+#define PCIE2  2
+#define PCINT16 0      //-- RXD (PD0)
+#define PCIF0  0
+#define PCIF1  1
+#define PCIF2  2
+
+//-- Core
+#define SMCR   _SFR_MEM8(0x53)
+#define MCUSR  _SFR_MEM8(0x54)
+#define MCUCR  _SFR_MEM8(0x55)
+#define SPL    _SFR_MEM8(0x5D)
+#define SPH    _SFR_MEM8(0x5E)
+#define SP     _SFR_MEM16(0x5D)
+#define SREG   _SFR_MEM8(0x5F)
+#define WDTCSR _SFR_MEM8(0x60)
+#define PRR    _SFR_MEM8(0x64)
+#define SE     0
+#define SM0    1
+#define SM1    2
+#define SM2    3
+#define WDP0   0
+#define WDP1   1
+#define WDP2   2
+#define WDE    3
+#define WDCE   4
+#define WDP3   5
+#define WDIE   6
+#define WDIF   7
+#define WDRF   3
+#define PRADC     0
+#define PRUSART0  1
+#define PRSPI     2
+#define PRTIM1    3
+#define PRTIM0    5
+#define PRTIM2    6
+#define PRTWI     7
+
+//-- ADC
+#define ADCL   _SFR_MEM8(0x78)
+#define ADCH   _SFR_MEM8(0x79)
+#define ADCW   _SFR_MEM16(0x78)
+#define ADC    _SFR_MEM16(0x78)
+#define ADCSRA _SFR_MEM8(0x7A)
+#define ADCSRB _SFR_MEM8(0x7B)
+#define ADMUX  _SFR_MEM8(0x7C)
+#define DIDR0  _SFR_MEM8(0x7E)
+#define ADPS0  0
+#define ADPS1  1
+#define ADPS2  2
+#define ADIE   3
+#define ADIF   4
+#define ADATE  5
+#define ADSC   6
+#define ADEN   7
+#define ADTS0  0
+#define ADTS1  1
+#define ADTS2  2
+#define MUX0   0
+#define MUX1   1
+#define MUX2   2
+#define MUX3   3
+#define ADLAR  5
+#define REFS0  6
+#define REFS1  7
+
+//-- RAM layout symbols used by stack/heap instrumentation
+#define RAMSTART 0x100
+#define RAMEND   0x8FF
+#define E2END    0x3FF
+
+#endif // sim_avr_io_h
@@ -0,0 +1,27 @@
+//--------------------------------------------------------------
+//-- avr/pgmspace.h (host simulation)
+//-- Flash and RAM share one address space on the host
+//--------------------------------------------------------------
+#ifndef sim_avr_pgmspace_h
+#define sim_avr_pgmspace_h
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr)   (*(void * const *)(addr))
+
+#define memcpy_P  memcpy
+#define strcpy_P  strcpy
+#define strncpy_P strncpy
+#define strcmp_P  strcmp
+#define strncmp_P strncmp
+#define strlen_P  strlen
+
+#endif // sim_avr_pgmspace_h
@@ -0,0 +1,20 @@
+//--------------------------------------------------------------
+//-- avr/power.h (host simulation)
+//--------------------------------------------------------------
+#ifndef sim_avr_power_h
+#define sim_avr_power_h
+
+#include "avr/io.h"
+
+#define power_adc_enable()     (PRR &= (uint8_t)~_BV(PRADC))
+#define power_adc_disable()    (PRR |= (uint8_t)_BV(PRADC))
+#define power_spi_enable()     (PRR &= (uint8_t)~_BV(PRSPI))
+#define power_spi_disable()    (PRR |= (uint8_t)_BV(PRSPI))
+#define power_twi_enable()     (PRR &= (uint8_t)~_BV(PRTWI))
+#define power_twi_disable()    (PRR |= (uint8_t)_BV(PRTWI))
+#define power_timer1_enable()  (PRR &= (uint8_t)~_BV(PRTIM1))
+#define power_timer1_disable() (PRR |= (uint8_t)_BV(PRTIM1))
+#define power_timer2_enable()  (PRR &= (uint8_t)~_BV(PRTIM2))
+#define power_timer2_disable() (PRR |= (uint8_t)_BV(PRTIM2))
+
+#endif // sim_avr_power_h
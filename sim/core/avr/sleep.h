@@ -0,0 +1,33 @@
+//--------------------------------------------------------------
+//-- avr/sleep.h (host simulation)
+//-- sleep_cpu() fast-forwards virtual time to the next wake-up
+//--------------------------------------------------------------
+#ifndef sim_avr_sleep_h
+#define sim_avr_sleep_h
+
+#include "avr/io.h"
+
+#define SLEEP_MODE_IDLE       0
+#define SLEEP_MODE_ADC        _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN   _BV(SM1)
+#define SLEEP_MODE_PWR_SAVE   (_BV(SM0) | _BV(SM1))
+#define SLEEP_MODE_STANDBY    (_BV(SM1) | _BV(SM2))
+#define SLEEP_MODE_EXT_STANDBY (_BV(SM0) | _BV(SM1) | _BV(SM2))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void sim_sleep_cpu(void);
+#ifdef __cplusplus
+}
+#endif
+
+#define set_sleep_mode(mode) \
+  do { SMCR = (SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode); } while (0)
+#define sleep_enable()  do { SMCR |= _BV(SE); } while (0)
+#define sleep_disable() do { SMCR &= ~_BV(SE); } while (0)
+#define sleep_cpu()     sim_sleep_cpu()
+#define sleep_mode()    do { sleep_enable(); sleep_cpu(); sleep_disable(); } while (0)
+#define sleep_bod_disable() do { } while (0)
+
+#endif // sim_avr_sleep_h
@@ -0,0 +1,33 @@
+//--------------------------------------------------------------
+//-- avr/wdt.h (host simulation)
+//--------------------------------------------------------------
+#ifndef sim_avr_wdt_h
+#define sim_avr_wdt_h
+
+#include "avr/io.h"
+
+#define WDTO_15MS   0
+#define WDTO_30MS   1
+#define WDTO_60MS   2
+#define WDTO_120MS  3
+#define WDTO_250MS  4
+#define WDTO_500MS  5
+#define WDTO_1S     6
+#define WDTO_2S     7
+#define WDTO_4S     8
+#define WDTO_8S     9
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void sim_wdt_reset(void);
+#ifdef __cplusplus
+}
+#endif
+
+#define wdt_reset() sim_wdt_reset()
+#define wdt_enable(value) \
+  do { WDTCSR = _BV(WDE) | ((value) & 0x08 ? _BV(WDP3) : 0) | ((value) & 0x07); sim_wdt_reset(); } while (0)
+#define wdt_disable() do { WDTCSR = 0; } while (0)
+
+#endif // sim_avr_wdt_h
@@ -0,0 +1,7 @@
+//--------------------------------------------------------------
+//-- pins_arduino.h (host simulation)
+//--------------------------------------------------------------
+#ifndef sim_pins_arduino_h
+#define sim_pins_arduino_h
+#include "Arduino.h"
+#endif
@@ -0,0 +1,106 @@
+//--------------------------------------------------------------
+//-- sim.h
+//-- Host-side control of the virtual Arduino core
+//--------------------------------------------------------------
+//-- Everything the mock core knows about time, pins, the ADC,
+//-- the serial port and the servos is reachable from here, so a
+//-- scenario can drive the Zowi libraries deterministically.
+//--------------------------------------------------------------
+#ifndef sim_h
+#define sim_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace sim {
+
+//-- Virtual time ------------------------------------------------
+
+//-- Current virtual time, in microseconds since reset
+uint64_t now();
+
+//-- Advance virtual time, firing every timer/ADC/watchdog
+//-- interrupt that falls due on the way
+void advance(uint64_t us);
+
+//-- Cost charged to every millis()/micros()/digitalRead() call,
+//-- so busy waits on the clock always make progress (default 4us)
+void setCallCost(uint32_t us);
+
+//-- Reset time, pins, registers, serial, servos and EEPROM
+void reset();
+
+//-- Run fn when virtual time reaches us (inputs, serial traffic...).
+//-- Scheduled events also wake the CPU from sleep.
+void at(uint64_t us, std::function<void()> fn);
+
+//-- Pins --------------------------------------------------------
+
+//-- Drive an input pin from the outside (buttons, IR sensors...).
+//-- Pin change and external interrupts fire as on the real chip.
+void setPin(uint8_t pin, bool level);
+
+//-- Last level written by the firmware on an output pin
+bool getPin(uint8_t pin);
+
+//-- Analog value seen by analogRead()/the ADC on channel 0..7
+void setAnalog(uint8_t channel, uint16_t value);
+
+//-- Optional waveform: called with the channel and the current
+//-- time every time the channel is converted
+typedef uint16_t (*AnalogSource)(uint8_t channel, uint64_t us);
+void setAnalogSource(uint8_t channel, AnalogSource source);
+
+//-- Echo length returned by pulseIn() (0 = no echo)
+void setPulse(uint8_t pin, unsigned long us);
+
+//-- Serial ------------------------------------------------------
+
+//-- Queue bytes on the RX line. They are lost if the CPU is in
+//-- power-down: the start bit only wakes it through a pin change
+void serialInject(const std::string &bytes);
+
+//-- Everything written by the firmware since the last call
+std::string serialTake();
+
+//-- Bytes written by the firmware that are still in the TX FIFO
+size_t serialPending();
+
+//-- Servos ------------------------------------------------------
+
+struct ServoEvent {
+  uint64_t us;
+  uint8_t  pin;
+  int      angle;   //-- -1 = detach
+};
+
+//-- Every servo write since the last call
+std::vector<ServoEvent> servoTake();
+
+//-- Buzzer ------------------------------------------------------
+
+struct ToneEvent {
+  uint64_t      us;
+  uint8_t       pin;
+  unsigned int  frequency;  //-- 0 = noTone
+  unsigned long duration;
+};
+
+std::vector<ToneEvent> toneTake();
+
+//-- EEPROM ------------------------------------------------------
+
+//-- Number of physical cell writes since reset (wear counter)
+unsigned long eepromWrites();
+
+//-- Power -------------------------------------------------------
+
+//-- Virtual time spent inside sleep_cpu()
+uint64_t sleptTime();
+
+} // namespace sim
+
+#endif // sim_h
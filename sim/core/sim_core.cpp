@@ -0,0 +1,653 @@
+//--------------------------------------------------------------
+//-- sim_core.cpp
+//-- Virtual-time implementation of the Arduino/AVR core
+//--------------------------------------------------------------
+//-- Time only moves when the firmware asks for it (millis,
+//-- micros, delay, analogRead, serial back-pressure, sleep...).
+//-- Every call is charged a small fixed cost, so busy waits on
+//-- the clock terminate and runs are fully deterministic.
+//--------------------------------------------------------------
+#include "Arduino.h"
+#include "Servo.h"
+#include "EEPROM.h"
+#include "avr/sleep.h"
+#include "avr/wdt.h"
+#include "sim.h"
+
+#include <deque>
+#include <functional>
+#include <map>
+
+volatile uint8_t sim_reg[256];
+uint8_t sim_eeprom[1024];
+unsigned long sim_eeprom_writes;
+
+//-- Same symbol the real core keeps its millisecond count in;
+//-- firmware may add to it to account for time spent in power-down
+volatile unsigned long timer0_millis;
+
+HardwareSerial Serial;
+
+//-- Default (empty) interrupt handlers, overridden by ISR() bodies
+extern "C" {
+__attribute__((weak)) void TIMER0_COMPA_vect(void) {}
+__attribute__((weak)) void TIMER0_COMPB_vect(void) {}
+__attribute__((weak)) void ADC_vect(void) {}
+__attribute__((weak)) void PCINT0_vect(void) {}
+__attribute__((weak)) void PCINT1_vect(void) {}
+__attribute__((weak)) void PCINT2_vect(void) {}
+__attribute__((weak)) void WDT_vect(void) {}
+}
+
+namespace {
+
+enum {
+  IRQ_INT0  = 1 << 0,
+  IRQ_INT1  = 1 << 1,
+  IRQ_PCI0  = 1 << 2,
+  IRQ_PCI1  = 1 << 3,
+  IRQ_PCI2  = 1 << 4,
+  IRQ_WDT   = 1 << 5,
+  IRQ_T0A   = 1 << 6,
+  IRQ_T0B   = 1 << 7,
+  IRQ_ADC   = 1 << 8
+};
+
+const uint64_t T0_TICK_US = 1024;
+const uint64_t NEVER = ~(uint64_t)0;
+
+struct State {
+  uint64_t now;
+  uint64_t frozen;          //-- time spent with timer 0 stopped
+  uint64_t slept;
+  uint32_t callCost;
+  bool     busy;
+  bool     inIsr;
+  bool     sleeping;
+  uint8_t  sleepMode;
+  unsigned pending;
+  unsigned long irqCount;
+
+  uint64_t t0Next;
+  bool     adcBusy;
+  uint64_t adcDone;
+  uint64_t wdtNext;
+
+  uint16_t analog[8];
+  sim::AnalogSource source[8];
+  unsigned long pulse[NUM_DIGITAL_PINS + 2];
+
+  void (*extIsr[2])(void);
+  int      extMode[2];
+
+  std::deque<uint8_t> rx;
+  std::deque<uint8_t> tx;
+  std::string wire;
+  double   byteUs;
+  double   txNextDone;
+
+  std::vector<sim::ServoEvent> servos;
+  std::vector<sim::ToneEvent> tones;
+  std::multimap<uint64_t, std::function<void()> > events;
+
+  unsigned long long seed;
+};
+
+State s;
+
+bool t0Running() {
+  return !s.sleeping || s.sleepMode == SLEEP_MODE_IDLE;
+}
+
+bool adcRunning() {
+  return !s.sleeping || s.sleepMode == SLEEP_MODE_IDLE || s.sleepMode == SLEEP_MODE_ADC;
+}
+
+//-- The USART needs the I/O clock, stopped in every mode but idle
+bool uartRunning() {
+  return !s.sleeping || s.sleepMode == SLEEP_MODE_IDLE;
+}
+
+bool pinPort(uint8_t pin, volatile uint8_t **pinReg, volatile uint8_t **ddr,
+             volatile uint8_t **port, uint8_t *mask) {
+  if (pin < 8) {
+    *pinReg = &PIND; *ddr = &DDRD; *port = &PORTD; *mask = 1 << pin;
+  } else if (pin < 14) {
+    *pinReg = &PINB; *ddr = &DDRB; *port = &PORTB; *mask = 1 << (pin - 8);
+  } else if (pin < 20) {
+    *pinReg = &PINC; *ddr = &DDRC; *port = &PORTC; *mask = 1 << (pin - 14);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void runIsr(unsigned irq) {
+  s.inIsr = true;
+  SREG &= ~0x80;
+  switch (irq) {
+    case IRQ_INT0: if (s.extIsr[0]) s.extIsr[0](); break;
+    case IRQ_INT1: if (s.extIsr[1]) s.extIsr[1](); break;
+    case IRQ_PCI0: PCIFR &= ~_BV(PCIF0); PCINT0_vect(); break;
+    case IRQ_PCI1: PCIFR &= ~_BV(PCIF1); PCINT1_vect(); break;
+    case IRQ_PCI2: PCIFR &= ~_BV(PCIF2); PCINT2_vect(); break;
+    case IRQ_WDT:  WDTCSR &= ~_BV(WDIF); WDT_vect(); break;
+    case IRQ_T0A:  TIFR0 &= ~_BV(OCF0A); TIMER0_COMPA_vect(); break;
+    case IRQ_T0B:  TIFR0 &= ~_BV(OCF0B); TIMER0_COMPB_vect(); break;
+    case IRQ_ADC:  ADCSRA &= ~_BV(ADIF); ADC_vect(); break;
+  }
+  SREG |= 0x80;
+  s.inIsr = false;
+  s.irqCount++;
+}
+
+void deliver() {
+  while (s.pending && (SREG & 0x80) && !s.inIsr) {
+    unsigned irq = s.pending & (~s.pending + 1);  //-- lowest = highest priority
+    s.pending &= ~irq;
+    runIsr(irq);
+  }
+}
+
+
+uint64_t adcConversionUs() {
+  uint8_t ps = ADCSRA & 0x07;
+  uint32_t div = ps ? (1u << ps) : 2;
+  return (13ull * div) / (F_CPU / 1000000ull);
+}
+
+uint16_t sampleChannel(uint8_t ch) {
+  ch &= 0x07;
+  uint16_t v = s.source[ch] ? s.source[ch](ch, s.now) : s.analog[ch];
+  return v > 1023 ? 1023 : v;
+}
+
+void adcStartIfRequested() {
+  if (!s.adcBusy && (ADCSRA & _BV(ADEN)) && (ADCSRA & _BV(ADSC)) && !(PRR & _BV(PRADC))) {
+    s.adcBusy = true;
+    s.adcDone = s.now + adcConversionUs();
+  }
+}
+
+void drainTx() {
+  while (!s.tx.empty() && (double)s.now >= s.txNextDone) {
+    s.wire.push_back((char)s.tx.front());
+    s.tx.pop_front();
+    s.txNextDone += s.byteUs;
+  }
+}
+
+uint64_t wdtPeriodUs() {
+  uint8_t p = (WDTCSR & 0x07) | ((WDTCSR & _BV(WDP3)) ? 0x08 : 0);
+  return 16000ull << p;
+}
+
+uint64_t nextEvent() {
+  uint64_t next = NEVER;
+  if (t0Running() && s.t0Next < next) next = s.t0Next;
+  if (s.adcBusy && adcRunning() && s.adcDone < next) next = s.adcDone;
+  if ((WDTCSR & (_BV(WDIE) | _BV(WDE))) && s.wdtNext < next) next = s.wdtNext;
+  if (!s.events.empty() && s.events.begin()->first < next) next = s.events.begin()->first;
+  return next;
+}
+
+void processEvents() {
+  if (t0Running() && s.now >= s.t0Next) {
+    s.t0Next += T0_TICK_US;
+    if (SREG & 0x80) s.irqCount++;       //-- millis() overflow interrupt
+    if ((ADCSRA & _BV(ADATE)) && (ADCSRB & 0x07) == 0x03) ADCSRA |= _BV(ADSC);
+    if (TIMSK0 & _BV(OCIE0A)) { TIFR0 |= _BV(OCF0A); s.pending |= IRQ_T0A; }
+    if (TIMSK0 & _BV(OCIE0B)) { TIFR0 |= _BV(OCF0B); s.pending |= IRQ_T0B; }
+  }
+  if (s.adcBusy && adcRunning() && s.now >= s.adcDone) {
+    s.adcBusy = false;
+    ADC = sampleChannel(ADMUX);
+    ADCSRA |= _BV(ADIF);
+    if ((ADCSRA & _BV(ADATE)) && (ADCSRB & 0x07) == 0) ADCSRA |= _BV(ADSC);
+    else ADCSRA &= ~_BV(ADSC);
+    if (ADCSRA & _BV(ADIE)) s.pending |= IRQ_ADC;
+  }
+  if ((WDTCSR & (_BV(WDIE) | _BV(WDE))) && s.now >= s.wdtNext) {
+    s.wdtNext += wdtPeriodUs();
+    if (WDTCSR & _BV(WDIE)) { WDTCSR |= _BV(WDIF); s.pending |= IRQ_WDT; }
+    else fprintf(stderr, "sim: watchdog reset at %llu us\n", (unsigned long long)s.now);
+  }
+  while (!s.events.empty() && s.events.begin()->first <= s.now) {
+    std::function<void()> fn = s.events.begin()->second;
+    s.events.erase(s.events.begin());
+    fn();
+  }
+  deliver();
+  adcStartIfRequested();
+}
+
+void pinChanged(uint8_t pin, bool level) {
+  if (pin < 8) {
+    if ((PCICR & _BV(PCIE2)) && (PCMSK2 & (1 << pin))) { PCIFR |= _BV(PCIF2); s.pending |= IRQ_PCI2; }
+  } else if (pin < 14) {
+    if ((PCICR & _BV(PCIE0)) && (PCMSK0 & (1 << (pin - 8)))) { PCIFR |= _BV(PCIF0); s.pending |= IRQ_PCI0; }
+  } else if (pin < 20) {
+    if ((PCICR & _BV(PCIE1)) && (PCMSK1 & (1 << (pin - 14)))) { PCIFR |= _BV(PCIF1); s.pending |= IRQ_PCI1; }
+  }
+  int ext = digitalPinToInterrupt(pin);
+  if (ext >= 0 && s.extIsr[ext]) {
+    int mode = s.extMode[ext];
+    if (mode == CHANGE || (mode == RISING && level) || (mode == FALLING && !level))
+      s.pending |= ext ? IRQ_INT1 : IRQ_INT0;
+  }
+  deliver();
+}
+
+struct Boot { Boot() { sim::reset(); } } boot;
+
+} // namespace
+
+//////////////////////////////////////////////////////////////////
+//-- sim:: control API ----------------------------------------//
+//////////////////////////////////////////////////////////////////
+namespace sim {
+
+uint64_t now() { return s.now; }
+
+void advance(uint64_t us) {
+  uint64_t target = s.now + us;
+  if (s.busy) {           //-- called from an ISR or a scheduled event
+    s.now = target;
+    return;
+  }
+  s.busy = true;
+  adcStartIfRequested();
+  for (;;) {
+    uint64_t next = nextEvent();
+    if (next > target) break;
+    if (next > s.now) s.now = next;
+    processEvents();
+  }
+  if (target > s.now) s.now = target;
+  s.busy = false;
+  drainTx();
+}
+
+void setCallCost(uint32_t us) { s.callCost = us; }
+
+void reset() {
+  memset((void *)sim_reg, 0, sizeof(sim_reg));
+  memset(sim_eeprom, 0xFF, sizeof(sim_eeprom));
+  sim_eeprom_writes = 0;
+  timer0_millis = 0;
+  s.now = 0;
+  s.frozen = 0;
+  s.slept = 0;
+  s.callCost = 4;
+  s.busy = s.inIsr = s.sleeping = false;
+  s.pending = 0;
+  s.irqCount = 0;
+  s.t0Next = T0_TICK_US;
+  s.adcBusy = false;
+  s.wdtNext = NEVER;
+  memset(s.analog, 0, sizeof(s.analog));
+  memset(s.source, 0, sizeof(s.source));
+  memset(s.pulse, 0, sizeof(s.pulse));
+  s.extIsr[0] = s.extIsr[1] = 0;
+  s.rx.clear();
+  s.tx.clear();
+  s.wire.clear();
+  s.byteUs = 10e6 / 115200;
+  s.txNextDone = 0;
+  s.servos.clear();
+  s.tones.clear();
+  s.events.clear();
+  s.seed = 1;
+  SP = RAMEND;
+  SREG = 0x80;             //-- init() enables interrupts before setup()
+  ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);   //-- init(): 125 kHz ADC clock
+}
+
+void at(uint64_t us, std::function<void()> fn) {
+  s.events.insert(std::make_pair(us, fn));
+}
+
+void setPin(uint8_t pin, bool level) {
+  volatile uint8_t *in, *ddr, *port;
+  uint8_t mask;
+  if (!pinPort(pin, &in, &ddr, &port, &mask)) return;
+  bool old = (*in & mask) != 0;
+  if (level) *in |= mask; else *in &= ~mask;
+  if (old != level) pinChanged(pin, level);
+}
+
+bool getPin(uint8_t pin) {
+  volatile uint8_t *in, *ddr, *port;
+  uint8_t mask;
+  if (!pinPort(pin, &in, &ddr, &port, &mask)) return false;
+  return (*port & mask) != 0;
+}
+
+void setAnalog(uint8_t channel, uint16_t value) { s.analog[channel & 7] = value; }
+void setAnalogSource(uint8_t channel, AnalogSource source) { s.source[channel & 7] = source; }
+void setPulse(uint8_t pin, unsigned long us) { if (pin < NUM_DIGITAL_PINS + 2) s.pulse[pin] = us; }
+
+//-- In power-down the start bit can only wake the CPU: the
+//-- oscillator starts up after the whole line has gone by
+void serialInject(const std::string &bytes) {
+  if (uartRunning()) {
+    for (size_t i = 0; i < bytes.size(); i++)
+      if (s.rx.size() < SERIAL_RX_BUFFER_SIZE - 1) s.rx.push_back((uint8_t)bytes[i]);
+    if (SREG & 0x80) s.irqCount++;       //-- USART RX complete interrupt
+  }
+  setPin(0, false);                      //-- start bit on RXD (PD0)
+  setPin(0, true);
+}
+
+std::string serialTake() {
+  drainTx();
+  std::string out;
+  out.swap(s.wire);
+  return out;
+}
+
+size_t serialPending() { drainTx(); return s.tx.size(); }
+
+std::vector<ServoEvent> servoTake() {
+  std::vector<ServoEvent> out;
+  out.swap(s.servos);
+  return out;
+}
+
+std::vector<ToneEvent> toneTake() {
+  std::vector<ToneEvent> out;
+  out.swap(s.tones);
+  return out;
+}
+
+unsigned long eepromWrites() { return sim_eeprom_writes; }
+
+uint64_t sleptTime() { return s.slept; }
+
+} // namespace sim
+
+//////////////////////////////////////////////////////////////////
+//-- AVR intrinsics -------------------------------------------//
+//////////////////////////////////////////////////////////////////
+extern "C" void sim_sei(void) {
+  SREG |= 0x80;
+  deliver();
+}
+
+extern "C" void sim_cli(void) {
+  SREG &= ~0x80;
+}
+
+extern "C" void sim_wdt_reset(void) {
+  s.wdtNext = s.now + wdtPeriodUs();
+}
+
+extern "C" void sim_sleep_cpu(void) {
+  if (!(SMCR & _BV(SE)) || s.busy) return;
+  s.sleeping = true;
+  s.sleepMode = SMCR & (_BV(SM0) | _BV(SM1) | _BV(SM2));
+  s.busy = true;
+  uint64_t start = s.now;
+  uint64_t limit = s.now + 60000000ull;  //-- never hang a scenario
+  unsigned long irqs = s.irqCount;
+  while (s.irqCount == irqs) {
+    adcStartIfRequested();
+    uint64_t next = nextEvent();
+    if (next == NEVER || next > limit) { s.now = limit; break; }
+    if (next > s.now) s.now = next;
+    processEvents();
+  }
+  s.busy = false;
+  s.slept += s.now - start;
+  if (s.sleepMode != SLEEP_MODE_IDLE) {
+    s.frozen += s.now - start;
+    s.t0Next = s.now - (s.now % T0_TICK_US) + T0_TICK_US;
+  }
+  s.sleeping = false;
+  drainTx();
+}
+
+//////////////////////////////////////////////////////////////////
+//-- Arduino API ----------------------------------------------//
+//////////////////////////////////////////////////////////////////
+extern "C" {
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  volatile uint8_t *in, *ddr, *port;
+  uint8_t mask;
+  if (!pinPort(pin, &in, &ddr, &port, &mask)) return;
+  if (mode == OUTPUT) {
+    *ddr |= mask;
+  } else {
+    *ddr &= ~mask;
+    if (mode == INPUT_PULLUP) *port |= mask; else *port &= ~mask;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  volatile uint8_t *in, *ddr, *port;
+  uint8_t mask;
+  if (!pinPort(pin, &in, &ddr, &port, &mask)) return;
+  if (val) *port |= mask; else *port &= ~mask;
+  if (*ddr & mask) {
+    if (val) *in |= mask; else *in &= ~mask;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  volatile uint8_t *in, *ddr, *port;
+  uint8_t mask;
+  sim::advance(s.callCost);
+  if (!pinPort(pin, &in, &ddr, &port, &mask)) return LOW;
+  return (*in & mask) ? HIGH : LOW;
+}
+
+int analogRead(uint8_t pin) {
+  uint8_t ch = pin >= 14 ? pin - 14 : pin;
+  sim::advance(104);
+  return sampleChannel(ch);
+}
+
+void analogReference(uint8_t) {}
+void analogWrite(uint8_t pin, int val) { pinMode(pin, OUTPUT); digitalWrite(pin, val > 127); }
+
+unsigned long millis(void) {
+  sim::advance(s.callCost);
+  return (unsigned long)((s.now - s.frozen) / 1000) + timer0_millis;
+}
+
+unsigned long micros(void) {
+  sim::advance(s.callCost);
+  return (unsigned long)(s.now - s.frozen) + timer0_millis * 1000ul;
+}
+
+void delay(unsigned long ms) { sim::advance((uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { sim::advance(us); }
+void yield(void) {}
+
+void attachInterrupt(uint8_t num, void (*fn)(void), int mode) {
+  if (num < 2) { s.extIsr[num] = fn; s.extMode[num] = mode; }
+}
+
+void detachInterrupt(uint8_t num) {
+  if (num < 2) s.extIsr[num] = 0;
+}
+
+} // extern "C"
+
+unsigned long pulseIn(uint8_t pin, uint8_t, unsigned long timeout) {
+  unsigned long p = pin < NUM_DIGITAL_PINS + 2 ? s.pulse[pin] : 0;
+  if (p == 0 || p > timeout) {
+    sim::advance(timeout);
+    return 0;
+  }
+  sim::advance(p + 20);
+  return p;
+}
+
+void tone(uint8_t pin, unsigned int frequency, unsigned long duration) {
+  sim::ToneEvent e = { s.now, pin, frequency, duration };
+  s.tones.push_back(e);
+}
+
+void noTone(uint8_t pin) {
+  sim::ToneEvent e = { s.now, pin, 0, 0 };
+  s.tones.push_back(e);
+}
+
+long random(long howbig) {
+  if (howbig == 0) return 0;
+  s.seed = s.seed * 6364136223846793005ull + 1442695040888963407ull;
+  return (long)((s.seed >> 33) % (unsigned long)howbig);
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) { if (seed) s.seed = seed; }
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+//////////////////////////////////////////////////////////////////
+//-- Serial ---------------------------------------------------//
+//////////////////////////////////////////////////////////////////
+void HardwareSerial::begin(unsigned long baud, uint8_t) {
+  s.byteUs = 10e6 / (double)baud;
+}
+
+void HardwareSerial::end() {}
+
+int HardwareSerial::available(void) { return (int)s.rx.size(); }
+
+int HardwareSerial::peek(void) { return s.rx.empty() ? -1 : s.rx.front(); }
+
+int HardwareSerial::read(void) {
+  if (s.rx.empty()) return -1;
+  int c = s.rx.front();
+  s.rx.pop_front();
+  return c;
+}
+
+int HardwareSerial::availableForWrite(void) {
+  drainTx();
+  return SERIAL_TX_BUFFER_SIZE - 1 - (int)s.tx.size();
+}
+
+void HardwareSerial::flush(void) {
+  drainTx();
+  while (!s.tx.empty()) {
+    sim::advance((uint64_t)(s.txNextDone - (double)s.now) + 1);
+    drainTx();
+  }
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  drainTx();
+  while (s.tx.size() >= SERIAL_TX_BUFFER_SIZE - 1) {   //-- back-pressure, like the real core
+    sim::advance((uint64_t)(s.txNextDone - (double)s.now) + 1);
+    drainTx();
+  }
+  if (s.tx.empty()) s.txNextDone = (double)s.now + s.byteUs;
+  s.tx.push_back(c);
+  return 1;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(const __FlashStringHelper *str) { return write(reinterpret_cast<const char *>(str)); }
+size_t Print::print(const char str[]) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char b, int base) { return print((unsigned long)b, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+
+size_t Print::print(long n, int base) {
+  if (base == 10 && n < 0) return print('-') + printNumber((unsigned long)-n, 10);
+  return printNumber((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) { return printNumber(n, base); }
+size_t Print::print(double n, int digits) { return printFloat(n, digits); }
+
+size_t Print::println(void) { return write("\r\n"); }
+size_t Print::println(const __FlashStringHelper *s) { return print(s) + println(); }
+size_t Print::println(const char c[]) { return print(c) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char b, int base) { return print(b, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) base = 10;
+  do {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::printFloat(double number, uint8_t digits) {
+  if (isnan(number)) return print("nan");
+  if (isinf(number)) return print("inf");
+  char buf[40];
+  snprintf(buf, sizeof(buf), "%.*f", digits, number);
+  return print(buf);
+}
+
+//////////////////////////////////////////////////////////////////
+//-- Servo ----------------------------------------------------//
+//////////////////////////////////////////////////////////////////
+Servo::Servo() : pin(-1), angle(90), min_us(MIN_PULSE_WIDTH), max_us(MAX_PULSE_WIDTH) {}
+
+uint8_t Servo::attach(int p) { return attach(p, MIN_PULSE_WIDTH, MAX_PULSE_WIDTH); }
+
+uint8_t Servo::attach(int p, int mn, int mx) {
+  pin = p;
+  min_us = mn;
+  max_us = mx;
+  pinMode(p, OUTPUT);
+  return 0;
+}
+
+void Servo::detach() {
+  if (pin < 0) return;
+  sim::ServoEvent e = { s.now, (uint8_t)pin, -1 };
+  s.servos.push_back(e);
+  pin = -1;
+}
+
+void Servo::write(int value) {
+  if (value < MIN_PULSE_WIDTH) {
+    angle = constrain(value, 0, 180);
+    if (pin >= 0) {
+      sim::ServoEvent e = { s.now, (uint8_t)pin, angle };
+      s.servos.push_back(e);
+    }
+  } else {
+    writeMicroseconds(value);
+  }
+}
+
+void Servo::writeMicroseconds(int value) {
+  value = constrain(value, min_us, max_us);
+  write((int)map(value, min_us, max_us, 0, 180));
+}
+
+int Servo::read() { return angle; }
+int Servo::readMicroseconds() { return (int)map(angle, 0, 180, min_us, max_us); }
+bool Servo::attached() { return pin >= 0; }
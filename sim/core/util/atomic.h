@@ -0,0 +1,24 @@
+//--------------------------------------------------------------
+//-- util/atomic.h (host simulation)
+//--------------------------------------------------------------
+#ifndef sim_util_atomic_h
+#define sim_util_atomic_h
+
+#include "avr/interrupt.h"
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON      1
+#define NONATOMIC_RESTORESTATE 0
+#define NONATOMIC_FORCEOFF     1
+
+struct SimAtomicGuard {
+  uint8_t sreg;
+  bool    once;
+  SimAtomicGuard() : sreg(SREG), once(true) { cli(); }
+  ~SimAtomicGuard() { if (sreg & 0x80) sei(); }
+};
+
+#define ATOMIC_BLOCK(type) \
+  for (SimAtomicGuard _sim_atomic; _sim_atomic.once; _sim_atomic.once = false)
+
+#endif // sim_util_atomic_h
@@ -0,0 +1,210 @@
+//--------------------------------------------------------------
+//-- zowi_sim.cpp
+//-- Run a Zowi sketch on the host against the virtual core
+//--------------------------------------------------------------
+//-- Usage: zowi_sim [--time ms] [--loop-cost us] [scenario]
+//--
+//-- A scenario is a text file with one timed input per line:
+//--     <ms> serial <command>     (the '\r' terminator is added)
+//--     <ms> pin <pin> <0|1>
+//--     <ms> analog <channel> <value>
+//--     <ms> pulse <pin> <us>     (ultrasonic echo length)
+//--     <ms> tone <channel> <Hz> [amplitude]
+//--                               (sine on an analog channel, 0 Hz = off)
+//--     <ms> expect <regex>       (check of the serial output)
+//-- Lines starting with '#' are ignored. The battery input (A7)
+//-- starts at ~4.0 V so the low battery alarm stays quiet.
+//--
+//-- Each expect must match the output printed by <ms>, after
+//-- the match of the expect before it, so a scenario checks the
+//-- replies in order. The run lasts --time ms (10 s by default,
+//-- or until 1 s after the last line of the scenario).
+//--
+//-- Everything the firmware prints goes to stdout; a summary of
+//-- the run goes to stderr. The exit code is 1 if an expect
+//-- failed, so the scenarios under sim/scenarios run as tests.
+//--------------------------------------------------------------
+#include <Arduino.h>
+#include "sim.h"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct Expect {
+  uint64_t us;
+  std::string pattern;
+  int line;
+};
+
+static std::vector<Expect> expects;
+static uint64_t lastInput;
+
+//-- Sine waves on the analog channels (noise sensor tones)
+static double toneHz[8];
+static int toneAmplitude[8];
+
+static uint16_t toneSource(uint8_t channel, uint64_t us)
+{
+  return 512 + (int)(toneAmplitude[channel] * sin(2 * M_PI * toneHz[channel] * us / 1e6));
+}
+
+//-- The output and the virtual time at the end of each piece
+static std::string output;
+static std::vector<std::pair<uint64_t, size_t> > outputTimes;
+
+static void takeOutput()
+{
+  std::string text = sim::serialTake();
+  if (text.empty()) return;
+  std::cout << text;
+  output += text;
+  outputTimes.push_back(std::make_pair(sim::now(), output.size()));
+}
+
+//-- Bytes of output printed by virtual time us
+static size_t outputBy(uint64_t us)
+{
+  size_t size = 0;
+  for (size_t i = 0; i < outputTimes.size() && outputTimes[i].first <= us; i++) size = outputTimes[i].second;
+  return size;
+}
+
+static int checkExpects(const char *path)
+{
+  int failed = 0;
+  size_t cursor = 0;
+
+  for (size_t i = 0; i < expects.size(); i++) {
+    const Expect &e = expects[i];
+    size_t end = outputBy(e.us);
+    std::smatch match;
+    std::string text = end > cursor ? output.substr(cursor, end - cursor) : std::string();
+
+    if (std::regex_search(text, match, std::regex(e.pattern))) {
+      cursor += match.position(0) + match.length(0);
+    } else {
+      std::cerr << path << ":" << e.line << ": expect '" << e.pattern
+                << "' not found by " << e.us / 1000 << " ms\n";
+      failed++;
+    }
+  }
+  return failed;
+}
+
+static bool loadScenario(const char *path)
+{
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "zowi_sim: cannot open " << path << "\n";
+    return false;
+  }
+
+  std::string line;
+  int lineNo = 0;
+  while (std::getline(in, line)) {
+    lineNo++;
+    if (line.empty() || line[0] == '#') continue;
+
+    std::istringstream fields(line);
+    unsigned long ms;
+    std::string kind;
+    if (!(fields >> ms >> kind)) continue;
+    uint64_t at = (uint64_t)ms * 1000;
+    if (at > lastInput) lastInput = at;
+
+    if (kind == "serial") {
+      std::string text;
+      std::getline(fields >> std::ws, text);
+      text += '\r';
+      sim::at(at, [text]() { sim::serialInject(text); });
+    } else if (kind == "pin") {
+      int pin, level;
+      fields >> pin >> level;
+      sim::at(at, [pin, level]() { sim::setPin(pin, level != 0); });
+    } else if (kind == "analog") {
+      int channel, value;
+      fields >> channel >> value;
+      sim::at(at, [channel, value]() { sim::setAnalog(channel, value); });
+    } else if (kind == "pulse") {
+      int pin;
+      unsigned long us;
+      fields >> pin >> us;
+      sim::at(at, [pin, us]() { sim::setPulse(pin, us); });
+    } else if (kind == "tone") {
+      int channel = 0, amplitude = 300;
+      double hz = 0;
+      fields >> channel >> hz >> amplitude;
+      channel &= 7;
+      sim::at(at, [channel, hz, amplitude]() {
+        toneHz[channel] = hz;
+        toneAmplitude[channel] = amplitude;
+        sim::setAnalogSource(channel, hz > 0 ? toneSource : 0);
+      });
+    } else if (kind == "expect") {
+      Expect e;
+      e.us = at;
+      e.line = lineNo;
+      std::getline(fields >> std::ws, e.pattern);
+      expects.push_back(e);
+    } else {
+      std::cerr << path << ":" << lineNo << ": unknown input '" << kind << "'\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long runMs = 0;
+  unsigned long loopCostUs = 10;
+  const char *scenario = 0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--time" && i + 1 < argc) runMs = strtoul(argv[++i], 0, 10);
+    else if (arg == "--loop-cost" && i + 1 < argc) loopCostUs = strtoul(argv[++i], 0, 10);
+    else scenario = argv[i];
+  }
+
+  sim::reset();
+  sim::setAnalog(7, 820);   //-- healthy battery (~4.0 V) unless the scenario says otherwise
+  if (scenario && !loadScenario(scenario)) return 1;
+  if (runMs == 0) runMs = scenario ? lastInput / 1000 + 1000 : 10000;
+
+  std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();
+  uint64_t end = (uint64_t)runMs * 1000;
+  unsigned long loops = 0;
+  size_t servoWrites = 0;
+  size_t tones = 0;
+
+  setup();
+  while (sim::now() < end) {
+    loop();
+    loops++;
+    sim::advance(loopCostUs);
+
+    takeOutput();
+    servoWrites += sim::servoTake().size();
+    tones += sim::toneTake().size();
+  }
+  sim::advance(10000);    //-- let the TX FIFO drain
+  takeOutput();
+  std::cout << std::flush;
+
+  double wallMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - wallStart).count();
+  std::cerr << "zowi_sim: " << sim::now() / 1000 << " ms virtual in "
+            << wallMs << " ms wall, " << loops << " loops, "
+            << servoWrites << " servo writes, " << tones << " tones, "
+            << sim::eepromWrites() << " EEPROM writes, "
+            << sim::sleptTime() / 1000 << " ms asleep\n";
+
+  return (scenario && checkExpects(scenario)) ? 1 : 0;
+}